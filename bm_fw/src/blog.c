@@ -0,0 +1,80 @@
+/******************************************************************************************************************************
+*
+*   AMP Configuration Variable Management
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   blog.c
+*
+*   Binary logging, see blog.h
+*
+******************************************************************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xtime_l.h>
+
+#include "remoteproc.h"
+#include "trace_buf.h"
+#include "blog.h"
+
+
+/******************************************************************************************************************************
+*   G L O B A L S
+*/
+
+// the records are written to a trace_buf, its text area is a multiple of the record size so records never wrap
+static struct trace_buf ring;
+
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+void blog_init(void)
+{
+    struct fw_rsc_trace rsc;
+
+    rpmsg_get_blog_buf_settings(&rsc);
+    if ((rsc.len % sizeof(struct blog_rec)) != 0)
+        return;
+    trace_buf_init(&ring, (void*)(rsc.da), rsc.len);
+}
+
+
+void blog_write(uint32_t fmt, const uint32_t* args)
+{
+    struct blog_rec r;
+    XTime t;
+    uint32_t n = fmt & (BLOG_FMT_ALIGN-1);
+
+    XTime_GetTime(&t);
+    r.fmt = fmt;
+    r.time_lo = (uint32_t)t;
+    r.time_hi = (uint32_t)(t >> 32);
+    memcpy(r.arg, args, n * sizeof(uint32_t));
+    memset(r.arg + n, 0, (BLOG_MAX_ARGS - n) * sizeof(uint32_t));
+    trace_buf_write(&ring, &r, sizeof(r));
+}
@@ -0,0 +1,98 @@
+/******************************************************************************************************************************
+*
+*   AMP Configuration Variable Management
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   blog.h
+*
+*   Binary logging for hot paths: BLOG() stores the address of its format string, a timestamp and the raw (integer)
+*   arguments in a ring, the text is never formatted on the firmware. The format strings are collected in the
+*   .blog_fmt section of the ELF file, tools/blogdec reads the ring (/debug/cfg_mgmt/fw_blog) and the ELF file and
+*   prints the messages.
+*
+******************************************************************************************************************************/
+
+#ifndef __BLOG_H__
+#define __BLOG_H__
+
+#include <stdint.h>
+
+
+/******************************************************************************************************************************
+*   C O N F I G
+*/
+
+// max. number of arguments of BLOG(), all of them are stored as 32 bit integers (no strings, no floats)
+#define BLOG_MAX_ARGS           5
+
+// the format string addresses are aligned to this, the low bits of the first record word hold the argument count
+#define BLOG_FMT_ALIGN          8
+
+
+
+/******************************************************************************************************************************
+*   S T R U C T S
+*/
+
+// one log record, one cache line. Keep in sync with tools/blogdec.
+struct blog_rec {
+    uint32_t fmt;           // address of the format string | number of arguments
+    uint32_t time_lo;       // global timer (COUNTS_PER_SECOND)
+    uint32_t time_hi;
+    uint32_t arg[BLOG_MAX_ARGS];
+};
+
+
+
+/******************************************************************************************************************************
+*   M A C R O S
+*/
+
+#define BLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, N, ...)     N
+
+// log a message, fmt must be a string literal with at most BLOG_MAX_ARGS integer conversions (%d %i %u %x %X %o %c)
+// eg BLOG("rx: src=x%x len=%u", src, len);
+#define BLOG(fmt, ...) \
+    do { \
+        static const char __blog_fmt[] __attribute__((section(".blog_fmt"), aligned(BLOG_FMT_ALIGN), used)) = fmt; \
+        enum { __blog_n = BLOG_NARGS_(0, ##__VA_ARGS__, 7, 6, 5, 4, 3, 2, 1, 0) }; \
+        (void)sizeof(char[(__blog_n <= BLOG_MAX_ARGS) ? 1 : -1]);  /* too many arguments */ \
+        const uint32_t __blog_args[] = { 0, ##__VA_ARGS__ }; \
+        blog_write((uint32_t)__blog_fmt | __blog_n, __blog_args + 1); \
+    } while (0)
+
+
+
+/******************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+// set up the ring in the blog trace buffer of the resource table, BLOG() does nothing before this was called
+void blog_init(void);
+
+// store a record, fmt is the format string address with the argument count in the low bits (see BLOG)
+// This is not interrupt safe, don't use BLOG() in interrupt handlers.
+void blog_write(uint32_t fmt, const uint32_t* args);
+
+#endif
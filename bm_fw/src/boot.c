@@ -0,0 +1,98 @@
+/******************************************************************************************************************************
+*
+*   AMP Configuration Variable Management
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   boot.c
+*
+*   Boot timeline, see boot.h
+*
+******************************************************************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#include <xtime_l.h>
+
+#include "boot.h"
+
+
+/******************************************************************************************************************************
+*   G L O B A L S
+*/
+
+static struct {
+    const char* name;
+    XTime time;
+} phases[BOOT_MAX_PHASES];
+
+static int n_phases = 0;
+
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+// global timer ticks to us
+static uint32_t to_us(XTime t)
+{
+    return (uint32_t)(t / (COUNTS_PER_SECOND / 1000000));
+}
+
+
+void boot_mark(const char* name)
+{
+    XTime t;
+
+    XTime_GetTime(&t);
+    if (n_phases >= BOOT_MAX_PHASES)
+        return;
+    phases[n_phases].name = name;
+    phases[n_phases].time = t;
+    n_phases++;
+
+    // also keep it in the trace buffer, which can be read even if rpmsg never comes up
+    fprintf(stderr, "boot: %s at %u us\n", name, (unsigned int)to_us(t - phases[0].time));
+}
+
+
+int boot_print(char* p, int max)
+{
+    int n = 0;
+
+    if (max <= 0)
+        return 0;
+    p[0] = 0;
+    for (int i=0; (i<n_phases) && (n<max); i++)
+    {
+        XTime prev = (i > 0) ? phases[i-1].time : phases[0].time;
+        n += snprintf(p+n, max-n, "boot %-12s %8u us (+%u us)\n", phases[i].name,
+            (unsigned int)to_us(phases[i].time - phases[0].time), (unsigned int)to_us(phases[i].time - prev));
+    }
+    if (n >= max)
+        n = max-1;
+    return n;
+}
@@ -0,0 +1,60 @@
+/******************************************************************************************************************************
+*
+*   AMP Configuration Variable Management
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   boot.h
+*
+*   Boot timeline: records when each init phase of the firmware was done. The records are written to the trace
+*   buffer and can be read from linux with the statistics (fw_stats file of the cfg_mgmt module).
+*
+******************************************************************************************************************************/
+
+#ifndef __BOOT_H__
+#define __BOOT_H__
+
+#include <stdint.h>
+
+
+/******************************************************************************************************************************
+*   C O N F I G
+*/
+
+// max. number of phases recorded, further calls of boot_mark are ignored
+#define BOOT_MAX_PHASES     12
+
+
+
+/******************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+// record the end of init phase name (has to be a static string), the first call defines time 0
+void boot_mark(const char* name);
+
+// print the timeline (one line per phase: time since the first phase and since the previous one) to p
+// returns the number of characters written (at most max-1, the text is \0 terminated)
+int boot_print(char* p, int max);
+
+#endif
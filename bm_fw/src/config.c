@@ -35,11 +35,16 @@
 */
 #include <xil_printf.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "config.h"
 #include "config_vars.h"
 #include "remoteproc.h"
+#include "sched.h"
+#include "boot.h"
+#include "xtime_l.h"
 
 
 
@@ -60,6 +65,7 @@
 #define REQ_RD_MAX  5       // read max limit
 #define REQ_NAME    6       // read name of variable with given index (0..N_VARS-1)
 #define REQ_DESC    7       // read description text of variable with given index
+#define REQ_STATS   8       // read statistics as text, index 0: vrings, 1..MAX_RPMSG_CH: channel index-1, tasks, boot
 
 
 // BM to kernel (response)
@@ -71,15 +77,20 @@
 #define RES_RD_MAX  133
 #define RES_NAME    134
 #define RES_DESC    135
+#define RES_STATS   136
+#define RES_RD_VOL  137     // like RES_RD_VAL, but the variable has a read callback so its value may change any time
+#define RES_CHANGED 138     // notification (not a reply): the firmware modified the value of variable ind
+
+// sequence number of notifications, the kernel never uses it for requests
+#define CFG_SEQ_NOTIFY  0xffffffff
 
 #define RES_REQ_ERR 255     // unknown request
 
 
-// configure size (max length) of the data field in messages exchanged with BM application
-//#define MSG_DATA_SIZE 	(DATA_LEN_MAX-sizeof(cfgMsg_t))
-// This is a super uggly hack, I have not found a good solution yet. (Total message length is 512 bytes, leave
-// space for headers
-#define MSG_DATA_SIZE 	(400)
+// configure size (max length) of the data field in messages exchanged with the kernel
+// The channel uses fragmentation (RPMSG_CH_F_FRAG), so a message is not limited to one vring buffer. Only the
+// used part of the data field is transmitted. This has to match the kernel module.
+#define MSG_DATA_SIZE 	(1024)
 
 
 /******************************************************************************************************************************
@@ -97,13 +108,15 @@ typedef struct __attribute__((packed))       // make sure it has no holes (kerne
     int32_t     ind;    // config variable index (<0 means unkown/undefined)
     int32_t     val;    // numerical value (for WR req, RD resp, etc)
     uint32_t    len;    // length of data section (in bytes)
-    uint8_t     data[MSG_DATA_SIZE]; // opt. data section, total messages has to fit into TX_BUFFER_SIZEs
+    uint8_t     data[MSG_DATA_SIZE]; // opt. data section, only len bytes are transmitted
 } cfgMsg_t;
 
+// length of a message without data section
+#define CFG_MSG_HDR_LEN     offsetof(cfgMsg_t, data)
+
 
 // allocate a TX buffer to send replies to the kernel
-#define CFG_BUF_LEN     DATA_LEN_MAX
-uint8_t cfgMsgTxBuf[CFG_BUF_LEN];
+static cfgMsg_t cfgMsgTxBuf;
 
 
 
@@ -122,6 +135,48 @@ void config_msg_handler(struct rpmsg_channel* ch, uint8_t* data, uint32_t len);
 // set new value for variable at index i in global variable array
 int cfgSetInd(int i, int32_t val, bool trigCb);
 
+// like cfgSetInd, notify: tell the kernel about the change (not for its own writes)
+static int setInd(int i, int32_t val, bool trigCb, bool notify);
+
+// send a reply message to the kernel
+static void cfgSendReply(cfgMsg_t* rep);
+
+// like snprintf, but returns the number of characters written to p (not counting the \0), so the result can be
+// accumulated without checks: n += scnprintf(p+n, max-n, ..) never makes n larger than max-1
+static int scnprintf(char* p, int max, const char* fmt, ...)
+{
+    va_list args;
+    int n;
+
+    if (max <= 0)
+        return 0;
+    va_start(args, fmt);
+    n = vsnprintf(p, max, fmt, args);
+    va_end(args);
+    if (n < 0)
+        return 0;
+    return (n < max) ? n : (max - 1);
+}
+
+// print a log2 histogram of RPMSG_CB_HIST_BINS bins (upper bound of the bin in us and count) and a newline to p,
+// at most max bytes, returns the number of characters (like scnprintf)
+static int print_hist(char* p, int max, const uint32_t* hist)
+{
+    int n = 0;
+    for (int i=0; i<RPMSG_CB_HIST_BINS; i++)
+    {
+        if (i < (RPMSG_CB_HIST_BINS-1))
+            n += scnprintf(p+n, max-n, " <%u:%u", 1u<<i, (unsigned int)hist[i]);
+        else
+            n += scnprintf(p+n, max-n, " >=%u:%u", 1u<<(i-1), (unsigned int)hist[i]);
+    }
+    n += scnprintf(p+n, max-n, "\n");
+    return n;
+}
+
+// print the transport statistics selected by ind to the data section of rep
+static int cfgPrintStats(int32_t ind, cfgMsg_t* rep);
+
 
 
 /******************************************************************************************************************************
@@ -132,7 +187,7 @@ int cfgSetInd(int i, int32_t val, bool trigCb);
 void cfgInit()
 {
     // announce a rpmsg channel for communication with the kernel
-    rpmsg_config = rpmsg_create_ch ("cfg_mgmt", &config_msg_handler);
+    rpmsg_config = rpmsg_create_ch_ex ("cfg_mgmt", &config_msg_handler, RPMSG_CH_F_FRAG);
 
 }
 
@@ -140,7 +195,10 @@ void cfgInit()
 void config_msg_handler(struct rpmsg_channel* ch, uint8_t* data, uint32_t len)
 {
     cfgMsg_t* req = (cfgMsg_t*)data;  // request message from kernel
-    cfgMsg_t* rep = (cfgMsg_t*)cfgMsgTxBuf;   // reply message to kernel
+    cfgMsg_t* rep = &cfgMsgTxBuf;   // reply message to kernel
+
+    if (len < CFG_MSG_HDR_LEN)
+        return;     // not a valid request
 
     // copy message sequence number (for request / reply matching) and variable index
     rep->seq = req->seq;
@@ -153,7 +211,7 @@ void config_msg_handler(struct rpmsg_channel* ch, uint8_t* data, uint32_t len)
         // simply reply with an OK message
         rep->type = RES_OK;
         rep->val = 0;   // could send some data here
-        rpmsg_send(rpmsg_config, (void*)rep, sizeof(*rep));
+        cfgSendReply(rep);
         return;
     }
 
@@ -161,7 +219,17 @@ void config_msg_handler(struct rpmsg_channel* ch, uint8_t* data, uint32_t len)
     {
         rep->type = RES_N_VARS;
         rep->val = n_vars;
-        rpmsg_send(rpmsg_config, (void*)rep, sizeof(*rep));
+        cfgSendReply(rep);
+        return;
+    }
+
+    if (req->type == REQ_STATS)
+    {
+        if (cfgPrintStats(req->ind, rep))
+            rep->type = RES_STATS;
+        else
+            rep->type = RES_ID_ERR;
+        cfgSendReply(rep);
         return;
     }
 
@@ -188,7 +256,7 @@ void config_msg_handler(struct rpmsg_channel* ch, uint8_t* data, uint32_t len)
     if ((ind >= n_vars) || (ind < 0))
     {
         rep->type = RES_ID_ERR;
-        rpmsg_send(rpmsg_config, (void*)rep, sizeof(*rep));
+        cfgSendReply(rep);
         return;
     }
 
@@ -196,8 +264,9 @@ void config_msg_handler(struct rpmsg_channel* ch, uint8_t* data, uint32_t len)
     switch (req->type)
     {
        case REQ_WR:
-            // write request from kernel, set new value
-            if (cfgSetInd(ind, req->val, true) == 1)
+            // write request from kernel, set new value. The kernel invalidates its cache itself, it needs no
+            // notification (changes made by the write callback are notified)
+            if (setInd(ind, req->val, true, false) == 1)
                 rep->type = RES_OK;
             else
                 rep->type = RES_ID_ERR;
@@ -209,7 +278,8 @@ void config_msg_handler(struct rpmsg_channel* ch, uint8_t* data, uint32_t len)
             if (vars[ind].rd_cb != NULL)
                 vars[ind].rd_cb(&vars[ind], true, vars[ind].rd_cb_data);
             rep->val = vars[ind].val;
-            rep->type = RES_RD_VAL;
+            // the kernel must not cache values which come from a read callback, we can't notify changes
+            rep->type = (vars[ind].rd_cb != NULL) ? RES_RD_VOL : RES_RD_VAL;
             break;
 
         case REQ_RD_MIN:
@@ -227,8 +297,8 @@ void config_msg_handler(struct rpmsg_channel* ch, uint8_t* data, uint32_t len)
         case REQ_NAME:
             // send variable name to kernel
             rep->len = strlen(vars[ind].name);
-            if (rep->len > (CFG_BUF_LEN-sizeof(cfgMsg_t)))
-                rep->len = (CFG_BUF_LEN-sizeof(cfgMsg_t));
+            if (rep->len > MSG_DATA_SIZE)
+                rep->len = MSG_DATA_SIZE;
             strncpy((char*)(rep->data), vars[ind].name, rep->len);
             rep->val = vars[ind].val;    // just send the current value as well
             rep->type = RES_NAME;
@@ -237,8 +307,8 @@ void config_msg_handler(struct rpmsg_channel* ch, uint8_t* data, uint32_t len)
         case REQ_DESC:
             // send variable name to kernel
             rep->len = strlen(vars[ind].desc);
-            if (rep->len > (CFG_BUF_LEN-sizeof(cfgMsg_t)))
-                rep->len = (CFG_BUF_LEN-sizeof(cfgMsg_t));
+            if (rep->len > MSG_DATA_SIZE)
+                rep->len = MSG_DATA_SIZE;
             strncpy((char*)(rep->data), vars[ind].desc, rep->len);
             rep->val = vars[ind].val;    // just send the current value as well
             rep->type = RES_DESC;
@@ -250,7 +320,89 @@ void config_msg_handler(struct rpmsg_channel* ch, uint8_t* data, uint32_t len)
 
     }
     // send the reply to the server
-    rpmsg_send(rpmsg_config, (void*)rep, sizeof(*rep));
+    cfgSendReply(rep);
+}
+
+
+// send a reply message to the kernel, the message is queued if there is no free tx buffer right now
+// so we don't have to wait for linux. We only block if the tx queue is full as well.
+static void cfgSendReply(cfgMsg_t* rep)
+{
+    int len = CFG_MSG_HDR_LEN + rep->len;   // don't send the unused part of the data section
+    if (rpmsg_send_async(rpmsg_config, (void*)rep, len, NULL, NULL) == RPMSG_ERR_QFULL)
+        rpmsg_send(rpmsg_config, (void*)rep, len);
+}
+
+
+// print the transport statistics selected by ind to the data section of rep (as text)
+// ind 0 selects the vrings, 1..MAX_RPMSG_CH the channel with index ind-1, the next SCHED_MAX_TASKS indices the
+// scheduler tasks (unused channels and tasks give an empty text) and the last one the boot timeline
+// returns 1 on success, 0 if ind is invalid
+static int cfgPrintStats(int32_t ind, cfgMsg_t* rep)
+{
+    char* p = (char*)(rep->data);
+    const int max = MSG_DATA_SIZE - 1;     // the kernel appends a \0
+    int n = 0;
+
+    rep->len = 0;
+    rep->val = 0;
+    if (ind == 0)
+    {
+        for (int i=0; i<(2*RPMSG_N_VDEV); i++)
+        {
+            struct rpmsg_vring_stats vs;
+            rpmsg_get_vring_stats(i, &vs);
+            n += scnprintf(p+n, max-n, "vdev%d vring%d: bufs %u kicks_sent %u kicks_rcvd %u empty %u\n", i/2, i%2,
+                (unsigned int)vs.bufs, (unsigned int)vs.kicks_sent, (unsigned int)vs.kicks_rcvd,
+                (unsigned int)vs.empty);
+        }
+        // kick latency histogram: upper bound of the bin (us) and count
+        struct rpmsg_kick_stats ks;
+        rpmsg_get_kick_stats(&ks);
+        n += scnprintf(p+n, max-n, "kicks: events %u dropped %u lat_max %u us\nkicks lat_us:", (unsigned int)ks.events,
+            (unsigned int)ks.dropped, (unsigned int)ks.lat_max);
+        n += print_hist(p+n, max-n, ks.lat_hist);
+        rep->len = n;
+        return 1;
+    }
+
+    if (ind == (1 + MAX_RPMSG_CH + SCHED_MAX_TASKS))
+    {
+        rep->len = boot_print(p, max);
+        return 1;
+    }
+
+    if (ind > MAX_RPMSG_CH)
+    {
+        struct sched_stats ts;
+        if (sched_get_stats(ind-1-MAX_RPMSG_CH, &ts))
+            return 0;
+        if (ts.name != NULL)
+            n = scnprintf(p, max, "task %s (period %u ms): runs %u overruns %u jitter %u us (max %u us) run_max %u us\n",
+                ts.name, (unsigned int)(ts.period * 1000 / SCHED_TICK_HZ), (unsigned int)ts.runs,
+                (unsigned int)ts.overruns, (unsigned int)ts.jitter_last, (unsigned int)ts.jitter_max,
+                (unsigned int)ts.run_max);
+        rep->len = n;
+        return 1;
+    }
+
+    struct rpmsg_channel* ch = rpmsg_get_ch(ind-1);
+    if (ch == NULL)
+        return 0;
+    if (ch->state == CH_UNUSED)
+        return 1;
+
+    struct rpmsg_ch_stats* s = &(ch->stats);
+    n += scnprintf(p+n, max-n,
+        "%s (x%x vdev %u): tx %u msgs %u bytes, rx %u msgs %u bytes, tx_stalls %u, txq_full %u, blocked %u us, cb_max %u us\n",
+        ch->name, (unsigned int)ch->local_addr, (unsigned int)ch->vdev, (unsigned int)s->tx_msgs, (unsigned int)s->tx_bytes,
+        (unsigned int)s->rx_msgs, (unsigned int)s->rx_bytes, (unsigned int)s->tx_stalls, (unsigned int)ch->txq_full,
+        (unsigned int)(s->block_time / (COUNTS_PER_SECOND / 1000000)), (unsigned int)s->cb_max);
+    // callback time histogram: upper bound of the bin (us) and count
+    n += scnprintf(p+n, max-n, "%s cb_us:", ch->name);
+    n += print_hist(p+n, max-n, s->cb_hist);
+    rep->len = n;
+    return 1;
 }
 
 
@@ -397,10 +549,16 @@ int cfgSetId(int id, int32_t val, bool trigCb)
 // trigCb: trigger a callback if this is true
 // returns 1 on success and 0 on error
 int cfgSetInd(int i, int32_t val, bool trigCb)
+{
+    return setInd(i, val, trigCb, true);
+}
+
+
+static int setInd(int i, int32_t val, bool trigCb, bool notify)
 {
     if (i < 0)
         return 0;
-	if (i > n_vars)
+	if (i >= n_vars)
         return 0;
 
     // limit new value
@@ -408,6 +566,9 @@ int cfgSetInd(int i, int32_t val, bool trigCb)
         val = vars[i].max;
     if (val < vars[i].min)
         val = vars[i].min;
+    // the kernel caches values, it is notified of changes made by the firmware from the main loop (cfgNotifyPoll)
+    if (notify && (vars[i].val != val))
+        vars[i].changed = 1;
     // set new value
     vars[i].val = val;
     // execute the callback if requested and available
@@ -417,6 +578,40 @@ int cfgSetInd(int i, int32_t val, bool trigCb)
 }
 
 
+// send a notification for one changed variable, see config.h
+int cfgNotifyPoll()
+{
+    static int next = 0;    // round robin, so one busy variable can't starve the others
+    cfgMsg_t* msg = &cfgMsgTxBuf;
+
+    // the kernel's address is known once it has sent a request, don't take queue entries needed for replies
+    if ((rpmsg_config == NULL) || (rpmsg_config->state != CH_UP) || (rpmsg_config->txq_len > 0))
+        return 0;
+
+    for (int k=0; k<n_vars; k++)
+    {
+        int i = (next + k) % n_vars;
+        if (!vars[i].changed)
+            continue;
+        // clear the flag first, a change made while we send is notified again
+        vars[i].changed = 0;
+        msg->seq = CFG_SEQ_NOTIFY;
+        msg->type = RES_CHANGED;
+        msg->ind = i;
+        msg->val = vars[i].val;
+        msg->len = 0;
+        if (rpmsg_send_async(rpmsg_config, (void*)msg, CFG_MSG_HDR_LEN, NULL, NULL) != RPMSG_OK)
+        {
+            vars[i].changed = 1;
+            return 0;
+        }
+        next = i + 1;
+        return 1;
+    }
+    return 0;
+}
+
+
 int cfgSetCallback(int id, cfgCallback_t cb, bool read, void* data)
 {
     // check all ids
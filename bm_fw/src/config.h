@@ -73,6 +73,7 @@ struct cfg_var
 	void*           rd_cb_data; // read access cb private data
 	cfgCallback_t   wr_cb;      // write access callback
 	void*           wr_cb_data; // read access cb private data
+	volatile uint8_t changed;   // value modified, the kernel has not been notified yet (see cfgNotifyPoll)
 };
 
 typedef struct cfg_var cfgVar_t;
@@ -123,6 +124,11 @@ int cfgGetStructName(const char* n, cfgVar_t* v);
 // returns 1 on success and 0 on error
 int cfgSetId(int id, int32_t val, bool trigCb);
 
+// notify the kernel of variables which were modified by the firmware (cfgSetId), it caches their values.
+// Has to be called periodically from the main loop, sends at most one notification per call.
+// returns 1 if a notification was sent, 0 otherwise
+int cfgNotifyPoll();
+
 // (un)register a callback function
 // id: variable id for which this callback is registered
 // cb: pointer to callback
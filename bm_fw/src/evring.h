@@ -0,0 +1,107 @@
+/******************************************************************************************************************************
+*
+*   RPMSG Implementation for Bare Metal Applications
+*
+*   (c) 2015
+*   Lukas Schrittwieser
+*
+*******************************************************************************************************************************
+*
+*  Event ring: lock-free single producer / single consumer queue of small events, eg from an interrupt handler
+*  (producer) to the main loop (consumer). The producer only writes head, the consumer only writes tail, so no
+*  locks and no disabled interrupts are needed. Each event carries an id and a 32 bit timestamp.
+*
+******************************************************************************************************************************/
+
+#ifndef __EVRING__
+#define __EVRING__
+
+#include <stdint.h>
+
+
+/******************************************************************************************************************************
+*   C O N F I G                                                                                                              */
+
+// number of events the ring can hold, must be a power of 2
+#ifndef EVRING_SIZE
+#define EVRING_SIZE                 64
+#endif
+
+#if (EVRING_SIZE < 2) || ((EVRING_SIZE & (EVRING_SIZE-1)) != 0)
+#error EVRING_SIZE must be a power of 2
+#endif
+
+// orders the accesses to the event entries and the indices, also a compiler barrier
+#define evring_barrier()            __sync_synchronize()
+
+
+
+/******************************************************************************************************************************
+*   S T R U C T S                                                                                                            */
+
+struct evring_event {
+    uint32_t id;
+    uint32_t time;
+};
+
+// head and tail are free running, head-tail is the number of events in the ring
+struct evring {
+    volatile uint32_t head;     // written by the producer only
+    volatile uint32_t tail;     // written by the consumer only
+    volatile uint32_t dropped;  // events lost because the ring was full, written by the producer only
+    struct evring_event ev[EVRING_SIZE];
+};
+
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N                                                                                              */
+
+static inline void evring_init(struct evring* r)
+{
+    r->head = 0;
+    r->tail = 0;
+    r->dropped = 0;
+}
+
+// producer: add an event, returns 0 on success or -1 if the ring is full (the event is counted in dropped)
+static inline int evring_put(struct evring* r, uint32_t id, uint32_t time)
+{
+    uint32_t head = r->head;
+
+    if ((head - r->tail) >= EVRING_SIZE)
+    {
+        r->dropped++;
+        return -1;
+    }
+    r->ev[head & (EVRING_SIZE-1)].id = id;
+    r->ev[head & (EVRING_SIZE-1)].time = time;
+    // the event has to be visible before the consumer sees the new head
+    evring_barrier();
+    r->head = head + 1;
+    return 0;
+}
+
+// consumer: remove the oldest event and copy it to e, returns 1 if there was one, 0 if the ring is empty
+static inline int evring_get(struct evring* r, struct evring_event* e)
+{
+    uint32_t tail = r->tail;
+
+    if (tail == r->head)
+        return 0;
+    // don't read the entry before head
+    evring_barrier();
+    *e = r->ev[tail & (EVRING_SIZE-1)];
+    // the entry has to be read before the producer may overwrite it
+    evring_barrier();
+    r->tail = tail + 1;
+    return 1;
+}
+
+// consumer: number of events in the ring
+static inline uint32_t evring_count(struct evring* r)
+{
+    return r->head - r->tail;
+}
+
+#endif
@@ -47,6 +47,23 @@
 #include "config.h"
 #include "config_vars.h"
 #include "uart.h"
+#include "stdout_buf.h"
+#include "trace_buf.h"
+#include "blog.h"
+#include "sched.h"
+#include "boot.h"
+#ifdef VRING_BENCH
+#include "vring_bench.h"
+#endif
+
+
+
+/******************************************************************************************************************************
+*   C O N F I G
+*/
+
+// time to wait for DRIVER_OK in the vdev status before remoteproc_ready falls back to checking for rx buffers
+#define VDEV_READY_TIMEOUT_MS   1000
 
 
 
@@ -60,7 +77,7 @@ volatile uint32_t* const pLed = (void*)(0x41210000);
 // Instance of the interrupt controller driver's data structure, this contains all information required by the driver
 XScuGic IntcInst;
 
-// SCU private timer is used to periodically execute the scara controller
+// SCU private timer generates the system tick (SCHED_TICK_HZ) for the scheduler
 XScuTimer timerInst;
 
 // rpmsg channel for STDIO
@@ -68,8 +85,6 @@ struct rpmsg_channel* rpmsg_stdio = NULL;
 
 static int stdio_init = 0;
 
-volatile uint32_t sys_tick = 0;
-
 
 
 /******************************************************************************************************************************
@@ -88,6 +103,8 @@ void var_cb (struct cfg_var* var, bool isread, void* data);
 
 void stdio_msg_handler(struct rpmsg_channel* ch, uint8_t* data, uint32_t len);
 
+void led_task(void* arg);
+
 size_t _write(int fd, const void* data, size_t len);
 
 
@@ -98,28 +115,48 @@ size_t _write(int fd, const void* data, size_t len);
 
 int main(void)
 {
-    int i=0;
-    int led = 0;
     int busy;
+    int ret;
 
+    boot_mark("start");
     (*pLed) = 1;
 
     mmu_init();
-
-    // wait several milliseconds to give the kernel time to boot, otherwise the kernel oopses
-    for (i=0; i<2500; i++)
-        usleep(1000);
-
-    (*pLed) = 2;
+    blog_init();
+    boot_mark("mmu");
 
     puts("CFG_MGMT - Example Firmware");
 
+#ifdef VRING_BENCH
+    vring_bench();
+#endif
+
     irq_init();
 
-    //sys_timer_init();
+    sched_init();
+    sys_timer_init();
+    boot_mark("irq");
+
+    (*pLed) = 2;
 
-    remoteproc_init();
+    // linux starts us while its rpmsg driver is still probing, wait until it has set up the vrings and added its
+    // rx buffers (DRIVER_OK), otherwise the kernel oopses on our name service announcements. Don't rely on DRIVER_OK
+    // alone: after VDEV_READY_TIMEOUT_MS also accept vdevs whose first rx buffer has been added
+    for (uint32_t polls=0; (ret = remoteproc_ready(polls >= (VDEV_READY_TIMEOUT_MS * 10))) == 0; polls++)
+        usleep(100);
+    boot_mark((ret == RPROC_READY_RX_BUF) ? "vdev ready (rx buf)" : "vdev ready");
+
+    if ((ret < 0) || (remoteproc_init() != RPMSG_OK))
+    {
+        // the kernel's vring setup doesn't match VRING_SIZE / PACKET_LEN_MAX (see trace buffer) or its driver
+        // failed, we can't talk to it
+        puts("remoteproc_init failed");
+        (*pLed) = 0xFF;
+        while (1)
+            __asm__ __volatile__ ("wfe" ::: "memory");
+    }
     puts("remoteproc_init done");
+    boot_mark("remoteproc");
 
     //FILE* fp = fdopen(3, "w");
     //fprintf(fp, "trace file print\n");
@@ -127,63 +164,41 @@ int main(void)
 
     (*pLed) = 3;
 
-    // create a channel for stdio messages
+    // create a channel for stdio messages, it uses the bulk vdev so printf bursts don't delay config replies
+    // Output is buffered until the kernel driver has connected (stdout_buf_drain), so we don't have to wait for it.
     puts("creating stdio channel");
     stdio_init = 0;
-    rpmsg_stdio = rpmsg_create_ch ("bm_stdio", stdio_msg_handler);
-
-    *pLed = 4;
-
-    // wait until the kernel has told us his rpmsg address (it sends a dummy message)
-    while (!stdio_init)
-    {
-        if (!rpmsg_poll())
-            __asm__ __volatile__ ("wfe" ::: "memory");
-    }
-
-    (*pLed) = led = 5;
-
-    /*fflush(stdout);
-    while(1)
-        __asm("nop");*/
+    rpmsg_stdio = rpmsg_create_ch_ex ("bm_stdio", stdio_msg_handler, RPMSG_CH_F_BULK);
 
     cfgInit();
+    boot_mark("channels");
+
+    (*pLed) = 5;
 
     printf("registering wr callback: %d\n", cfgSetCallback(CFG_VAR_2, &var_cb, false, NULL));
     printf("registering rd callback: %d\n", cfgSetCallback(CFG_VAR_1, &var_cb, true, NULL));
 
+    // blink the LEDs to show that we are alive
+    sched_add("led", led_task, NULL, SCHED_MS(1000), SCHED_MS(1000), SCHED_PRIO_LOW);
+
     puts("init done");
+    boot_mark("init done");
 
     while(1)
     {
         busy = 0;
         // periodically call the rpmsg workhorse
         busy |= rpmsg_poll();
-
-        //if (i < sys_tick)
-        //{
-          //  i = sys_tick + 2000;
-
-        usleep(1000);
-
-        i++;
-        if (i > 1000)
-        {
-            i = 0;
-            // show the variable values
-            /*int32_t v;
-            cfgGetValId(CFG_VAR_1, &v);
-            printf("var1: %d  ", (int)v);
-            cfgGetValId(CFG_VAR_2, &v);
-            printf("var2: %d\n", (int)v);*/
-            //(*pLed) = led++;
-        }
-
-        // go to sleep to save energy
+        // send buffered stdout data to linux
+        busy |= stdout_buf_drain(rpmsg_stdio);
+        // tell the kernel about config variables changed by the firmware
+        busy |= cfgNotifyPoll();
+        // run the tasks which are due
+        busy |= sched_run();
+
+        // go to sleep to save energy, the system tick wakes us up at least every 1/SCHED_TICK_HZ
         if (!busy)
-        {
-        //    __asm__ __volatile__ ("wfe" ::: "memory");
-        }
+            __asm__ __volatile__ ("wfe" ::: "memory");
     }
 }
 
@@ -250,14 +265,13 @@ void sys_timer_init()
     // enable SCU timer interrupt
     XScuGic_Enable(&IntcInst, XPAR_SCUTIMER_INTR);
 
-    // enable timer for periodic execution of scara controller
+    // enable timer for the system tick
     // lookup config
     XScuTimer_Config* timerCfg = XScuTimer_LookupConfig(XPAR_SCUTIMER_DEVICE_ID);
     // init timer config
     XScuTimer_CfgInitialize(&timerInst, timerCfg, XPS_SCU_PERIPH_BASE);
     // configure interrupt frq, timer runs at HALF cpu clock rate (see TRM)
-    uint32_t tmr_cmp = (XPAR_PS7_CORTEXA9_1_CPU_CLK_FREQ_HZ / 2 / 1000) - 1;
-    tmr_cmp = 1000000;
+    uint32_t tmr_cmp = (XPAR_PS7_CORTEXA9_1_CPU_CLK_FREQ_HZ / 2 / SCHED_TICK_HZ) - 1;
     XScuTimer_LoadTimer(&timerInst, tmr_cmp);
     XScuTimer_EnableAutoReload(&timerInst);
     XScuTimer_SetPrescaler(&timerInst, 0);
@@ -268,11 +282,17 @@ void sys_timer_init()
 }
 
 void sys_timer_ISR(void* data)
+{
+    XScuTimer_ClearInterruptStatus(&timerInst);
+    // only count the tick, the tasks are run from the main loop
+    sched_tick();
+}
+
+// periodic task, counts on the LEDs
+void led_task(void* arg)
 {
     static uint32_t led = 0;
-    sys_tick++;
-    if ((sys_tick%1000) == 0)
-        *pLed = led++;
+    *pLed = led++;
 }
 
 // callback function for variable read/write
@@ -316,54 +336,36 @@ int _open(const char *name, int flags, ...)
 
 size_t _write(int fd, const void* data, size_t len)
 {
-    static char* trace_buf = NULL;
-    static int trace_ind = 0;
-    static int trace_size = 0;
+    static struct trace_buf trace;
+    static int trace_ok = 0;
     size_t done=0;
 
-    if (!trace_buf)
+    if (!trace_ok)
     {
         // load trace buffer settings from remoteproc
         struct fw_rsc_trace rsc_trace;
         rpmsg_get_trace_buf_settings (&rsc_trace);
-        trace_buf = (void*)(rsc_trace.da);
-        trace_size = rsc_trace.len;
-        trace_ind = 0;
+        trace_ok = (trace_buf_init(&trace, (void*)(rsc_trace.da), rsc_trace.len) == 0);
     }
 
     switch (fd)
     {
     case STDOUT_FILENO:
-        // if we have a stdio channel via rpmsg, transmit the data (in chunks as big as possible)
-        if ((rpmsg_stdio != NULL) && stdio_init)
+        // if we have a stdio channel via rpmsg, the data is buffered and sent from the main loop (stdout_buf_drain)
+        // Writing never blocks, output before the kernel has connected is kept as long as it fits into the buffer.
+        if (rpmsg_stdio != NULL)
         {
-            /*memcpy(trace_buf+trace_ind, "STDOUT: ", 8);
-            trace_ind += 8;*/
-            done = 0;
-            while (len > done)
-            {
-                size_t n = len - done;
-                n = ((DATA_LEN_MAX-1) < n) ? DATA_LEN_MAX-1 : n;
-                rpmsg_send(rpmsg_stdio, (void*)( ((uint8_t*)data) + done), n);
-                done += n;
-            }
+            done = stdout_buf_write(data, len);
+            break;
         }
+        // no stdio channel yet, use the trace buffer
     case STDERR_FILENO:
     case 3:
         // send data on FD3 to the trace buffer only (eg. for debugging rpmsg communication
         // which must not trigger a new rpmsg transmission)
-        if (trace_buf)
-        {
-            // limit length to trace buffer size
-            if ((trace_size-trace_ind) > len)
-            {
-                memcpy(trace_buf+trace_ind, data, len);
-                trace_ind += len;
-            }
-            done = len;
-            //Xil_DCacheFlush();  // make new data visible to other core
-            Xil_DCacheFlushRange((unsigned int)trace_buf, trace_size);
-        }
+        // the trace buffer is circular, the oldest data is overwritten
+        if (trace_ok)
+            done = trace_buf_write(&trace, data, len);
         break;
     default:
         printf("%s: unknown fd: %d\n", __func__, fd);
@@ -380,8 +382,9 @@ void stdio_msg_handler(struct rpmsg_channel* ch, uint8_t* data, uint32_t len)
         // this is the first message from the kernel, which is used to tell the rpmsg logic
         // the kernel side address. we can igonre it as there is no meaningful data in it
         stdio_init = 1;
+        boot_mark("stdio up");
         return;
     }
-    data[len] = '\0';
-    fprintf(stderr, "stdio input: %s", data);
+    // data is not \0 terminated, don't write past len (this is linux' buffer)
+    fprintf(stderr, "stdio input: %.*s", (int)len, (char*)data);
 }
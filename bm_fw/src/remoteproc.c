@@ -11,19 +11,33 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <string.h>
 //#include <xil_cache.h>
 #include <xil_cache_l.h>
 #include <xil_mmu.h>
 #include <xscugic.h>
+#include <xpseudo_asm_gcc.h>
+#include <xtime_l.h>
 
 #include "remoteproc_kernel.h"
 #include "remoteproc.h"
 #include "virtio_ring.h"
+#include "evring.h"
+#include "blog.h"
 
 
 // enable debug message printing
 //#define DBG_MSG
 
+// send cpu to sleep until the next interrupt (the BSP has no macro for this, the host simulator provides its own)
+#ifndef wfe
+#define wfe()       __asm__ __volatile__ ("wfe" ::: "memory")
+#endif
+
+// global timer ticks per microsecond (statistics)
+#define TICKS_PER_US    (COUNTS_PER_SECOND / 1000000)
+
 
 /* Linux host needs to know what resources are required by the bare metal
  * firmware.
@@ -31,6 +45,12 @@
  * This table is accessed by the kernel during initialisation of the remoteproc
  * driver in order to setup the system for AMP.
  */
+// rpmsg vdev entry, the kernel expects its vrings right after it
+struct rpmsg_vdev_rsc {
+	struct fw_rsc_vdev vdev;
+	struct fw_rsc_vdev_vring vring[2];
+};
+
 struct resource_table {
 	unsigned int version;
 	unsigned int num;
@@ -38,12 +58,11 @@ struct resource_table {
 	unsigned int offset[NO_RESOURCE_ENTRIES];
 	/* text carveout entry */
 	struct fw_rsc_carveout text_cout;
-	/* rpmsg vdev entry */
-	struct fw_rsc_vdev rpmsg_vdev;
-	struct fw_rsc_vdev_vring rpmsg_vring0;
-	struct fw_rsc_vdev_vring rpmsg_vring1;
-	/* trace entry */
+	/* rpmsg vdev entries (control vdev first) */
+	struct rpmsg_vdev_rsc rpmsg[RPMSG_N_VDEV];
+	/* trace entries: text log and binary log (blog.c) */
 	struct fw_rsc_trace trace;
+	struct fw_rsc_trace blog;
 	// describe the HW we need, this will be enabled in the TLB
 	//struct fw_rsc_mmu slcr;
 	struct fw_rsc_mmu uart0;
@@ -51,33 +70,43 @@ struct resource_table {
 	struct fw_rsc_mmu leds;
 };
 
+/* rpmsg vdev entry n with its two vrings */
+/* Note: we don't set an address here as this did not work with some kernels, the kernel will
+   deside where the buffers go and replace the value (the same holds for the notify ids) */
+#define RPMSG_VDEV_ENTRY(n) \
+	{ { TYPE_VDEV, VIRTIO_ID_RPMSG, 0, RPMSG_IPU_C0_FEATURES, 0, 0, 0, 2, { 0, 0 } /* no config data */ }, \
+	  { { 0, 0x1000, VRING_SIZE, 2*(n)+1, 0 }, { 0, 0x1000, VRING_SIZE, 2*(n)+2, 0 } } }
+
 struct resource_table __resource resources = {
 	1, /* we're the first version that implements this */
-	3, /* number of entries in the table */
+	3 + RPMSG_N_VDEV, /* number of entries in the table */
 	{ 0, 0, }, /* reserved, must be zero */
 	/* offsets to entries */
 	{
 		offsetof(struct resource_table, text_cout),
-		offsetof(struct resource_table, rpmsg_vdev),
+		offsetof(struct resource_table, rpmsg[0]),
+#if RPMSG_N_VDEV > 1
+		offsetof(struct resource_table, rpmsg[1]),
+#endif
 		offsetof(struct resource_table, trace),
+		offsetof(struct resource_table, blog),
 	},
 
 	/* End of ELF file */
 	//{ TYPE_CARVEOUT, 0, 0, ELF_END, 0, 0, "TEXT/DATA", },
 	{ TYPE_CARVEOUT, ELF_START, ELF_START, (ELF_LEN), 0, 0, "TEXT/DATA", },
 
-	/* rpmsg vdev entry */
-	{ TYPE_VDEV, VIRTIO_ID_RPMSG, 0, RPMSG_IPU_C0_FEATURES, 0, 0, 0, 2,
-			{ 0, 0 }, /* no config data */ },
-
-	/* the two vrings */
-	/* Note: we don't set an address here as this did not work with some kernels, the kernel will
-	   deside where the buffers go and replace the value */
-	{ 0, 0x1000, VRING_SIZE, 1, 0 },
-	{ 0, 0x1000, VRING_SIZE, 2, 0 },
+	/* rpmsg vdevs */
+	{
+		RPMSG_VDEV_ENTRY(0),
+#if RPMSG_N_VDEV > 1
+		RPMSG_VDEV_ENTRY(1),
+#endif
+	},
 
 	/* Trace buffer */
 	{ TYPE_TRACE, TRACE_BUFFER_START, TRACE_BUFFER_SIZE, 0, "trace_buffer", },
+	{ TYPE_TRACE, BLOG_BUFFER_START, BLOG_BUFFER_SIZE, 0, "blog_buffer", },
 
 	/* Could add peripherals here (only needed for systems with an IOMMU */
 };
@@ -85,37 +114,92 @@ struct resource_table __resource resources = {
 // allocate memory for the channels
 struct rpmsg_channel channels[MAX_RPMSG_CH] = {{0}};
 
+// element of a channel's tx queue, holds a copy of a message until a vring buffer becomes available
+struct rpmsg_txq_entry {
+    struct rpmsg_txq_entry* next;
+    rpmsg_tx_callback* cb;      // completion callback (optional)
+    void* priv;                 // passed to cb
+    uint32_t len;
+    uint8_t data[DATA_LEN_MAX];
+};
+
+// static pool of tx queue entries, unused entries are chained in txq_free_list
+static struct rpmsg_txq_entry txq_pool[RPMSG_TXQ_POOL_SIZE];
+static struct rpmsg_txq_entry* txq_free_list = NULL;
+static unsigned int txq_free_cnt = 0;   // number of entries in txq_free_list
+
+// reassembly buffer for fragmented messages
+struct rpmsg_frag_rx {
+    int in_use;
+    uint16_t msg_id;
+    uint32_t total;         // total message length
+    uint32_t received;      // number of bytes received so far
+    uint8_t buf[RPMSG_FRAG_MSG_MAX];
+};
+static struct rpmsg_frag_rx frag_rx_slots[RPMSG_FRAG_RX_SLOTS];
+
+// handles for rx buffers held by channel callbacks
+static struct rpmsg_rx_buf rx_hold_bufs[RPMSG_RX_HOLD_MAX];
+static unsigned int rx_held = 0;    // number of handles in use
+
+// rx message which is currently passed to a channel callback (for rpmsg_rx_hold)
+struct rx_cur_msg {
+    uint8_t* data;
+    uint32_t len;
+    int32_t desc;           // descriptor index, <0 if no callback is active or message was reassembled
+    int held;               // set by rpmsg_rx_hold
+};
+static struct rx_cur_msg rx_cur = { NULL, 0, -1, 0 };
 
-uint32_t next_rpmsg_addr = APP_ADDR_START;
 
-volatile unsigned int txvring_kicks = 0;
-volatile unsigned int rxvring_kicks = 0;
+uint32_t next_rpmsg_addr = APP_ADDR_START;
 
-// vring resources as used by virtio_ring.c
-static struct vring tx_vring;
-static struct vring rx_vring;
+// kicks from linux, the interrupt handlers queue an event (interrupt id and time) which is processed by kick_task
+static struct evring kick_events;
+// number of kicks processed per interrupt and their latency (interrupt to kick_task)
+static unsigned int txvring_kicks = 0;
+static unsigned int rxvring_kicks = 0;
+static struct rpmsg_kick_stats kick_stats;
+
+// state of a vdev (vring pair), index 0 has the highest priority
+struct rpmsg_vdev {
+    struct vring tx_vring;      // vring0: messages to linux
+    struct vring rx_vring;      // vring1: messages from linux
+    int rx_pending;             // linux has kicked us, rx_vring has to be checked
+};
+static struct rpmsg_vdev vdevs[RPMSG_N_VDEV];
 
 // interrupt controller driver data structure is defined in main file
 extern XScuGic IntcInst;
 
 extern volatile uint32_t* const pLed;
 
-void block_send_message(u32 src, u32 dst, const void *data, u32 len);
-void read_message(void);
+void block_send_message(struct rpmsg_vdev* vd, u32 src, u32 dst, const void *data, u32 len);
+void read_message(struct rpmsg_vdev* vd);
+int __send_message(struct rpmsg_vdev* vd, u32 src, u32 dst, const void *prefix, u32 prefix_len,
+        const void *data, u32 len, int kick);
 
-static int txvring_task(void);
-static int rxvring_task(void);
+static int kick_task(void);
+static void time_hist(uint32_t* hist, uint32_t* max, uint32_t ticks);
+static int vdev_task(struct rpmsg_vdev* vd, unsigned int budget);
+static int rx_task(struct rpmsg_vdev* vd, unsigned int budget);
+static int txq_task(struct rpmsg_vdev* vd);
+
+static void rx_deliver(struct rpmsg_channel* ch, int32_t desc, uint8_t* data, uint32_t len);
+static void rx_fragment(struct rpmsg_channel* ch, int32_t desc, uint8_t* data, uint32_t len);
 
 
 
 
 // This has to be called periodically by the main loop to perform data processing
+// The vdevs are served in order of priority: the control vdev is drained completely, at most RPMSG_BULK_BUDGET
+// messages are read from the bulk vdev per call so new control messages are not delayed for long.
 // returns 0 if there is no peding work (might enter wait loop)
 int rpmsg_poll()
 {
-    int ret = 0;
-    ret |= txvring_task();
-    ret |= rxvring_task();
+    int ret = kick_task();
+    for (int i=0; i<RPMSG_N_VDEV; i++)
+        ret |= vdev_task(&vdevs[i], (i == RPMSG_VDEV_CTRL) ? 0 : RPMSG_BULK_BUDGET);
     return ret;
 }
 
@@ -123,102 +207,162 @@ int rpmsg_poll()
 void kick_linux()
 {
 #ifdef DBG_MSG
-    fprintf(stderr, "kicking linux\n");
+    BLOG("kicking linux");
 #endif // DBG_MSG
     XScuGic_SoftwareIntr(&IntcInst, NOTIFY_LINUX_IRQ, 1);
 }
 
 
-void txvring_irq(void *data)
+static inline uint32_t kick_time(void)
 {
-	txvring_kicks++;
+    XTime t;
+    XTime_GetTime(&t);
+    return (uint32_t)t;
 }
 
-static int txvring_task(void)
+void txvring_irq(void *data)
 {
-    static unsigned int processed_kicks = 0;
-
-    if (txvring_kicks != processed_kicks) {
-        processed_kicks++;
-        // the kernel has sent us something, invalidate our L1 cache to get new data
-        Xil_L1DCacheFlush();
-#ifdef DBG_MSG
-        fprintf(stderr, "received TX kick\n");
-#endif
-        return 1;   // might have more work to do
-    }
-    return 0;
+    // Linux has returned buffers to the TX ring (notify id 0)
+    evring_put(&kick_events, TXVRING_IRQ, kick_time());
 }
 
 void rxvring_irq(void *data)
 {
 	// Linux kick's us since it has put data to the RX ring
-	rxvring_kicks++;
+    evring_put(&kick_events, RXVRING_IRQ, kick_time());
 }
 
-static int rxvring_task()
+// process kicks from linux, all queued events are consumed at once
+// The kernel maps the notify ids of all vrings onto two interrupts (TXVRING_IRQ for notify id 0, RXVRING_IRQ for
+// all others), so with several vdevs a kick can't be assigned to a vring. All rx vrings are checked after any
+// kick, tx vrings are checked by txq_task anyway. Events dropped because the ring was full need no handling, the
+// ring held other events in that case.
+// returns 1 if there was a kick
+static int kick_task(void)
 {
-	static unsigned int processed_kicks = 0;
+    struct evring_event e;
+    unsigned int n = 0;
 
-    if (rxvring_kicks != processed_kicks) {
-        processed_kicks++;
-        Xil_L1DCacheFlush();    // make sure there is no stale data in our cache
-        // process all messages
-        while (vring_available(&rx_vring))
-        {
-            #ifdef DBG_MSG
-            fprintf(stderr, "reading data from rx vring, rxvring_kicks: %u\n", rxvring_kicks);
-            #endif
-            read_message();
-        }
-        return 1;   // prob. more data
+    if (evring_count(&kick_events) == 0)
+        return 0;
+    while (evring_get(&kick_events, &e))
+    {
+        uint32_t now = kick_time();
+        if (e.id == TXVRING_IRQ)
+            txvring_kicks++;
+        else
+            rxvring_kicks++;
+        // the timer's low word wraps around, the difference is still correct
+        time_hist(kick_stats.lat_hist, &(kick_stats.lat_max), now - e.time);
+        n++;
     }
+    kick_stats.events += n;
+    kick_stats.dropped = kick_events.dropped;
 
-    return 0;   // done
+    // the kernel has sent us something, invalidate our L1 cache to get new data
+    Xil_L1DCacheFlush();
+#ifdef DBG_MSG
+    BLOG("received %u kicks, tx: %u rx: %u", n, txvring_kicks, rxvring_kicks);
+#endif
+    for (int i=0; i<RPMSG_N_VDEV; i++)
+        vdevs[i].rx_pending = 1;
+    return 1;
 }
 
+// read messages from the rx vring of vd, at most budget messages (0: no limit)
+// returns 1 if at least one message was read
+static int rx_task(struct rpmsg_vdev* vd, unsigned int budget)
+{
+    unsigned int n = 0;
 
- int __send_message(u32 src, u32 dst, const void *data, u32 len)
+    if (!vd->rx_pending)
+        return 0;
+
+    // process all messages
+    while (vring_available(&(vd->rx_vring)))
+    {
+        if ((budget != 0) && (n >= budget))
+            return 1;   // continue on the next poll, rx_pending stays set
+        #ifdef DBG_MSG
+        BLOG("reading data from rx vring of vdev %d", (int)(vd - vdevs));
+        #endif
+        read_message(vd);
+        n++;
+    }
+    vd->rx_pending = 0;
+    return (n > 0);
+}
+
+// rx and tx processing of a vdev, returns 1 if there was something to do
+static int vdev_task(struct rpmsg_vdev* vd, unsigned int budget)
+{
+    int ret = rx_task(vd, budget);
+    ret |= txq_task(vd);    // after rx processing, callbacks might have queued replies
+    return ret;
+}
+
+
+ // try to put a message into the tx vring, linux is kicked if kick is not 0
+ // prefix (prefix_len bytes, may be NULL) is sent in front of data, eg a fragment header
+ // returns 0 on success, 1 if no buffer is available right now
+ int __send_message(struct rpmsg_vdev* vd, u32 src, u32 dst, const void *prefix, u32 prefix_len,
+        const void *data, u32 len, int kick)
  {
     int32_t idx;
 
     // try to get a buffer for the message
-    idx = vring_get_buf(&tx_vring);
+    idx = vring_get_buf(&(vd->tx_vring));
 
     if (idx < 0)
         return 1;   // no buffer available right now
 
     // ok, we have a descriptor, lets look at its content
 #ifdef DBG_MSG
-    fprintf(stderr, "TX: using buffer at x%08x with flagsx%04x\n", (unsigned int)tx_vring.desc[idx].addr, (unsigned int)tx_vring.desc[idx].flags);
+    BLOG("TX: using buffer at x%08x", (unsigned int)vring_buf(&(vd->tx_vring), idx));
 #endif
     // create the rpmsg header and add payload data
-    struct rpmsg_hdr *hdr = (struct rpmsg_hdr *)(tx_vring.desc[idx].addr);
+    struct rpmsg_hdr *hdr = (struct rpmsg_hdr *)vring_buf(&(vd->tx_vring), idx);
     hdr->src = src;
 	hdr->dst = dst;
 	hdr->reserved = 0;
 	hdr->flags = 0;
-	if (len > DATA_LEN_MAX)
+	if ((prefix_len + len) > DATA_LEN_MAX)
 	{
         fprintf(stderr, "rpmsg __send_message: len=%d is too long, truncating, ie data loss\n", (unsigned int)len);
-        len = DATA_LEN_MAX;
+        len = DATA_LEN_MAX - prefix_len;
+	}
+	if (vring_buf_len(&(vd->tx_vring), idx) < PACKET_LEN_MAX)
+	{
+        // the kernel uses smaller buffers than we were built for, don't write past the end
+        uint32_t max = vring_buf_len(&(vd->tx_vring), idx);
+        max = (max > (sizeof(*hdr) + prefix_len)) ? (max - sizeof(*hdr) - prefix_len) : 0;
+        if (len > max)
+        {
+            fprintf(stderr, "rpmsg __send_message: buffer has only %u bytes, PACKET_LEN_MAX is %u, truncating\n",
+                (unsigned int)vring_buf_len(&(vd->tx_vring), idx), (unsigned int)PACKET_LEN_MAX);
+            len = max;
+            prefix_len = (prefix_len < max) ? prefix_len : max;
+        }
 	}
-	hdr->len = (unsigned short)len; // data len
-	memcpy(&(hdr->data), data, hdr->len);
+	hdr->len = (unsigned short)(prefix_len + len); // data len
+	if (prefix_len > 0)
+        memcpy(&(hdr->data), prefix, prefix_len);
+	memcpy(&(hdr->data[prefix_len]), data, len);
+	vring_flush_buf((uint32_t)hdr, sizeof(*hdr) + hdr->len);
 	//int clr_len = DATA_LEN_MAX - len;
 	// clear space not used by message
 	//memset(&(hdr->data)+len, 0, clr_len);
 
     // tell linux that we have a message for it
     // Note: necessary memory barriers are done in this function
-    vring_publish_buf(&tx_vring, (uint16_t)idx, PACKET_LEN_MAX, 1);
+    vring_publish_buf(&(vd->tx_vring), (uint16_t)idx, PACKET_LEN_MAX, kick);
 
     return 0;
 }
 
 
 /*
- * Function to send messages to Linux through txvring.
+ * Function to send messages to Linux through the txvring of vdev vd.
  * It will not return until it sends successfully.
  * @para:
  *  src: source address of the remote processor message
@@ -226,28 +370,27 @@ static int rxvring_task()
  *  data: data of the message
  *  len: length of the data
  */
-void block_send_message(u32 src, u32 dst, const void *data, u32 len)
+void block_send_message(struct rpmsg_vdev* vd, u32 src, u32 dst, const void *data, u32 len)
 {
     #ifdef DBG_MSG
-    fprintf(stderr, "TX: src=x%x, dst=x%x, len=%d\n", (unsigned int)src, (unsigned int)dst, (unsigned int)len);
-    int i;
-    for (i=0; (i<len) && (i<32); i++)
-        fprintf(stderr, " %02x",((u8*)data)[i]);
-    fprintf(stderr, "\n");
+    BLOG("TX: src=x%x, dst=x%x, len=%d", (unsigned int)src, (unsigned int)dst, (unsigned int)len);
+    uint32_t w[4] = {0};
+    memcpy(w, data, (len < sizeof(w)) ? len : sizeof(w));
+    BLOG("TX: data %08x %08x %08x %08x", w[0], w[1], w[2], w[3]);
     #endif
-	while(__send_message(src, dst, data , len))
+	while(__send_message(vd, src, dst, NULL, 0, data , len, 1))
 	{
         // wait until a buffer becomes available
         // send cpu to sleep, we wake when automatically on an interrupt
-        __asm__ __volatile__ ("wfe" ::: "memory");
-        txvring_task(); // this checks for kicks from the kernel
+        wfe();
+        kick_task(); // this checks for kicks from the kernel
 	}
 }
 
 
-void read_message(void)
+void read_message(struct rpmsg_vdev* vd)
 {
-    int32_t index = vring_get_buf(&rx_vring);
+    int32_t index = vring_get_buf(&(vd->rx_vring));
 
     if (index < 0)
     {
@@ -256,44 +399,242 @@ void read_message(void)
     }
 
     // load address of the buffer associated with this descriptor
-    struct rpmsg_hdr *hdr = (struct rpmsg_hdr *)(rx_vring.desc[index].addr);
+    struct rpmsg_hdr *hdr = (struct rpmsg_hdr *)vring_buf(&(vd->rx_vring), index);
 
- #ifdef DBG_MSG
-    fprintf(stderr, "RX: mem=x%08x, src=x%x, dst=x%x, flags=x%08x, len=%d\n", (unsigned int)hdr,
+    if ((sizeof(*hdr) + hdr->len) > vring_buf_len(&(vd->rx_vring), index))
+    {
+        fprintf(stderr, "read_message: len=%u does not fit into buffer of %u bytes, dropping message\n",
+            (unsigned int)hdr->len, (unsigned int)vring_buf_len(&(vd->rx_vring), index));
+        vring_publish_buf(&(vd->rx_vring), index, PACKET_LEN_MAX, 0);
+        return;
+    }
+
+    #ifdef DBG_MSG
+    BLOG("RX: mem=x%08x, src=x%x, dst=x%x, flags=x%08x, len=%d", (unsigned int)hdr,
         (unsigned int)hdr->src, (unsigned int)hdr->dst, (unsigned int)hdr->flags, (unsigned int)hdr->len);
-    int i;
-    for (i=0; (i<hdr->len) && (i<32); i++)
-        fprintf(stderr, " %02x",hdr->data[i]);
-    fprintf(stderr, "\n");
-#endif
+    uint32_t w[4] = {0};
+    memcpy(w, hdr->data, (hdr->len < sizeof(w)) ? hdr->len : sizeof(w));
+    BLOG("RX: data %08x %08x %08x %08x", w[0], w[1], w[2], w[3]);
+    #endif
 
 	// search which channel this message belongs to
+    struct rpmsg_channel* ch = NULL;
     for (int i=0; i<MAX_RPMSG_CH; i++)
     {
-        if ((channels[i].state == CH_ANNOUNCED) || (channels[i].state == CH_UP))
+        if (((channels[i].state == CH_ANNOUNCED) || (channels[i].state == CH_UP)) &&
+            (channels[i].vdev == (vd - vdevs)) && (hdr->dst == channels[i].local_addr))
+        {
+            ch = channels+i;
+            break;
+        }
+    }
+
+    rx_cur.held = 0;
+    if (ch != NULL)
+    {
+        // this channel is addressed, deliver message
+        ch->remote_addr = hdr->src;    // remember link partner's address
+        ch->state = CH_UP;
+        if (ch->flags & RPMSG_CH_F_FRAG)
+            rx_fragment(ch, index, hdr->data, hdr->len);
+        else
+            rx_deliver(ch, index, hdr->data, hdr->len);
+    }
+
+    // the callback has taken ownership of the buffer, it will be returned by rpmsg_rx_release
+    if (rx_cur.held)
+        return;
+
+    // return the buffer to linux (recycling) (don't know what we should put at len)
+    // don't kick linux? or should we?
+    vring_publish_buf(&(vd->rx_vring), index, PACKET_LEN_MAX, 0);
+}
+
+
+// add a duration (in global timer ticks) to a log2 histogram of RPMSG_CB_HIST_BINS bins in us, max is in us
+static void time_hist(uint32_t* hist, uint32_t* max, uint32_t ticks)
+{
+    // we don't measure seconds here, so a 32 bit division is good enough
+    uint32_t us = ticks / TICKS_PER_US;
+    int bin = (us > 0) ? (32 - __builtin_clz(us)) : 0;
+    if (bin >= RPMSG_CB_HIST_BINS)
+        bin = RPMSG_CB_HIST_BINS - 1;
+    hist[bin]++;
+    if (us > *max)
+        *max = us;
+}
+
+// account the execution time of a channel callback (in global timer ticks)
+static void cb_time(struct rpmsg_ch_stats* s, XTime ticks)
+{
+    time_hist(s->cb_hist, &(s->cb_max), (uint32_t)ticks);
+}
+
+// pass a received message to the channel's callback, desc is the rx descriptor holding the data
+// or -1 if the data is not located in a vring buffer (reassembled)
+static void rx_deliver(struct rpmsg_channel* ch, int32_t desc, uint8_t* data, uint32_t len)
+{
+    rpmsg_rx_callback* cb = ch->cb;
+    if (cb == NULL)
+        return;
+
+    rx_cur.data = data;
+    rx_cur.len = len;
+    rx_cur.desc = desc;
+    XTime t0, t1;
+    XTime_GetTime(&t0);
+    cb(ch, data, len);
+    XTime_GetTime(&t1);
+    rx_cur.desc = -1;
+
+    ch->stats.rx_msgs++;
+    ch->stats.rx_bytes += len;
+    cb_time(&(ch->stats), t1 - t0);
+}
+
+
+static struct rpmsg_frag_rx* frag_rx_alloc(void)
+{
+    for (int i=0; i<RPMSG_FRAG_RX_SLOTS; i++)
+    {
+        if (!frag_rx_slots[i].in_use)
         {
-            // ok, this channel structure is valid
-            if (hdr->dst == channels[i].local_addr)
-            {
-                struct rpmsg_channel* ch = channels+i;
-                // this channel is addressed, deliver message
-                ch->remote_addr = hdr->src;    // remember link partner's address
-                ch->state = CH_UP;
-                // check if we have a valid callback and call it
-                rpmsg_rx_callback* cb = channels[i].cb;
-                if (cb != NULL)
-                {
-                    cb((void*)ch, hdr->data, hdr->len);
-                    break;
-                }
-            }
+            frag_rx_slots[i].in_use = 1;
+            return &frag_rx_slots[i];
         }
     }
+    return NULL;
+}
 
-   	// return the buffer to linux (recycling) (don't know what we should put at len)
-   	// don't kick linux? or should we?
-   	vring_publish_buf(&rx_vring, index, PACKET_LEN_MAX, 0);
-	return;
+// drop the message currently reassembled on channel ch
+static void frag_rx_drop(struct rpmsg_channel* ch)
+{
+    if (ch->frag_rx != NULL)
+        ch->frag_rx->in_use = 0;
+    ch->frag_rx = NULL;
+}
+
+
+// process a message received on a RPMSG_CH_F_FRAG channel (strip header, reassemble)
+static void rx_fragment(struct rpmsg_channel* ch, int32_t desc, uint8_t* data, uint32_t len)
+{
+    struct rpmsg_frag_hdr* fh = (struct rpmsg_frag_hdr*)data;
+
+    if (len < sizeof(*fh))
+    {
+        ch->rx_frag_err++;
+        return;
+    }
+    data += sizeof(*fh);
+    len -= sizeof(*fh);
+
+    // single fragment message, no need to copy. The kernel may send these in between the fragments of
+    // a longer message, so don't touch the reassembly state.
+    if ((fh->offset == 0) && (fh->total_len == len))
+    {
+        rx_deliver(ch, desc, data, len);
+        return;
+    }
+
+    if (fh->offset == 0)
+    {
+        // first fragment of a new message
+        if (ch->frag_rx != NULL)
+        {
+            ch->rx_frag_err++;
+            frag_rx_drop(ch);
+        }
+        if (fh->total_len > RPMSG_FRAG_MSG_MAX)
+        {
+            ch->rx_frag_err++;
+            return;
+        }
+        ch->frag_rx = frag_rx_alloc();
+        if (ch->frag_rx == NULL)
+        {
+            ch->rx_frag_err++;
+            return;
+        }
+        ch->frag_rx->msg_id = fh->msg_id;
+        ch->frag_rx->total = fh->total_len;
+        ch->frag_rx->received = 0;
+    }
+
+    struct rpmsg_frag_rx* r = ch->frag_rx;
+    if ((r == NULL) || (fh->msg_id != r->msg_id) || (fh->offset != r->received) ||
+        ((fh->offset + len) > r->total))
+    {
+        // fragment does not belong to the message we are reassembling (lost fragment?)
+        ch->rx_frag_err++;
+        frag_rx_drop(ch);
+        return;
+    }
+
+    memcpy(r->buf + r->received, data, len);
+    r->received += len;
+    if (r->received == r->total)
+    {
+        rx_deliver(ch, -1, r->buf, r->total);
+        frag_rx_drop(ch);
+    }
+}
+
+
+// keep the rx buffer currently passed to the callback of ch, see header for details
+struct rpmsg_rx_buf* rpmsg_rx_hold(struct rpmsg_channel* ch)
+{
+    if ((ch == NULL) || (rx_cur.desc < 0) || rx_cur.held)
+        return NULL;
+
+    // find an unused handle
+    struct rpmsg_rx_buf* buf = NULL;
+    for (int i=0; i<RPMSG_RX_HOLD_MAX; i++)
+    {
+        if (rx_hold_bufs[i].ch == NULL)
+        {
+            buf = &rx_hold_bufs[i];
+            break;
+        }
+    }
+    if (buf == NULL)
+    {
+        ch->rx_hold_fail++;
+        return NULL;
+    }
+
+    buf->ch = ch;
+    buf->data = rx_cur.data;
+    buf->len = rx_cur.len;
+    buf->desc = (uint16_t)rx_cur.desc;
+    rx_cur.held = 1;
+
+    rx_held++;
+    ch->rx_held++;
+    if (ch->rx_held > ch->rx_held_max)
+        ch->rx_held_max = ch->rx_held;
+    return buf;
+}
+
+
+// return a held rx buffer to linux
+void rpmsg_rx_release(struct rpmsg_rx_buf* buf)
+{
+    if ((buf == NULL) || (buf->ch == NULL))
+        return;
+
+    struct rpmsg_vdev* vd = &vdevs[buf->ch->vdev];
+    buf->ch->rx_held--;
+    rx_held--;
+    buf->ch = NULL;
+    buf->data = NULL;
+    // kick linux, it might be waiting for a buffer if we have held many of them
+    vring_publish_buf(&(vd->rx_vring), buf->desc, PACKET_LEN_MAX, 1);
+}
+
+
+unsigned int rpmsg_rx_held(void)
+{
+    return rx_held;
 }
 
 
@@ -306,6 +647,13 @@ void read_message(void)
 // don't mess with it. Returns NULL if no resources are available
 struct rpmsg_channel* rpmsg_create_ch (const char* name,
         rpmsg_rx_callback* cb)
+{
+    return rpmsg_create_ch_ex(name, cb, 0);
+}
+
+// same as rpmsg_create_ch, flags is a combination of RPMSG_CH_F_* (see header)
+struct rpmsg_channel* rpmsg_create_ch_ex (const char* name,
+        rpmsg_rx_callback* cb, uint32_t flags)
 {
     struct rpmsg_channel* ch = NULL;
 
@@ -333,70 +681,493 @@ struct rpmsg_channel* rpmsg_create_ch (const char* name,
     strncpy(ch->name, name, RPMSG_NAME_SIZE);
     ch->state = CH_ANNOUNCED;
     ch->cb = cb;
+    ch->flags = flags;
+    ch->vdev = (flags & RPMSG_CH_F_BULK) ? RPMSG_VDEV_BULK : RPMSG_VDEV_CTRL;
 
-    fprintf(stderr, "announcing channel '%s' with addr x%x\n", name, (unsigned int)ch->local_addr);
+    fprintf(stderr, "announcing channel '%s' with addr x%x on vdev %u\n", name, (unsigned int)ch->local_addr,
+        (unsigned int)ch->vdev);
 
     // send announcement message to linux
     struct rpmsg_ns_msg ns_msg;
     memset(&ns_msg, 0, sizeof(ns_msg));
     ns_msg.addr = ch->local_addr;
     ns_msg.flags = RPMSG_NS_CREATE;
-    strncpy(ns_msg.name, name, RPMSG_NAME_SIZE);
+    strncpy(ns_msg.name, name, RPMSG_NAME_SIZE - 1);     // keep the \0 from the memset
 
-    block_send_message(ch->local_addr,
+    // this waits for a tx buffer (which takes the most time) if linux has not set up the vrings yet
+    XTime t0, t1;
+    XTime_GetTime(&t0);
+    // each vdev is a separate rpmsg bus in linux with its own name service
+    block_send_message(&vdevs[ch->vdev], ch->local_addr,
             LINUX_SERVICE_ANNOUNCEMENT_ADDR, &ns_msg, sizeof(ns_msg));
+    XTime_GetTime(&t1);
+    ch->stats.block_time += t1 - t0;
 
     return ch;
 }
 
 
+// get an unused tx queue entry from the pool, returns NULL if the pool is exhausted
+static struct rpmsg_txq_entry* txq_alloc(void)
+{
+    struct rpmsg_txq_entry* e = txq_free_list;
+    if (e != NULL)
+    {
+        txq_free_list = e->next;
+        txq_free_cnt--;
+    }
+    return e;
+}
+
+static void txq_release(struct rpmsg_txq_entry* e)
+{
+    e->next = txq_free_list;
+    txq_free_list = e;
+    txq_free_cnt++;
+}
+
+// append a message (prefix followed by data) to the channel's queue
+// the caller has to make sure that there is a free entry
+static void txq_push(struct rpmsg_channel* ch, const void* prefix, uint32_t prefix_len,
+        const void* data, uint32_t len, rpmsg_tx_callback* cb, void* priv)
+{
+    struct rpmsg_txq_entry* e = txq_alloc();
+
+    if (prefix_len > 0)
+        memcpy(e->data, prefix, prefix_len);
+    memcpy(e->data + prefix_len, data, len);
+    e->len = prefix_len + len;
+    e->cb = cb;
+    e->priv = priv;
+    e->next = NULL;
+
+    if (ch->txq_tail != NULL)
+        ch->txq_tail->next = e;
+    else
+        ch->txq_head = e;
+    ch->txq_tail = e;
+    ch->txq_len++;
+    if (ch->txq_len > ch->txq_max)
+        ch->txq_max = ch->txq_len;
+}
+
+
+// move queued messages of the channels using vdev vd to its tx vring as long as there are free buffers
+// linux is kicked once for all messages sent in one call
+// returns 1 if at least one message was sent
+static int txq_task(struct rpmsg_vdev* vd)
+{
+    int sent = 0;
+
+    for (int i=0; i<MAX_RPMSG_CH; i++)
+    {
+        struct rpmsg_channel* ch = channels+i;
+        if (ch->vdev != (vd - vdevs))
+            continue;
+        while (ch->txq_head != NULL)
+        {
+            struct rpmsg_txq_entry* e = ch->txq_head;
+            if (__send_message(vd, ch->local_addr, ch->remote_addr, NULL, 0, e->data, e->len, 0))
+                goto done;  // tx vring is full, retry on next poll
+
+            // dequeue before calling the callback, it might queue the next message
+            ch->txq_head = e->next;
+            if (ch->txq_head == NULL)
+                ch->txq_tail = NULL;
+            ch->txq_len--;
+            rpmsg_tx_callback* cb = e->cb;
+            void* priv = e->priv;
+            txq_release(e);
+            sent = 1;
+            if (cb != NULL)
+                cb(ch, priv, RPMSG_OK);
+        }
+    }
+done:
+    if (sent)
+        vring_kick(&(vd->tx_vring));
+    return sent;
+}
+
+
+// number of vring buffers (fragments) needed to send len bytes on channel ch
+static int rpmsg_n_frags(struct rpmsg_channel* ch, int len)
+{
+    if (!(ch->flags & RPMSG_CH_F_FRAG) || (len <= FRAG_DATA_LEN_MAX))
+        return 1;
+    return (len + FRAG_DATA_LEN_MAX - 1) / FRAG_DATA_LEN_MAX;
+}
+
+
+// transmit a message to Linux without blocking, see header for details
+int rpmsg_send_async(struct rpmsg_channel* ch, const void* data, int len,
+        rpmsg_tx_callback* cb, void* priv)
+{
+    if (ch == NULL)
+        return RPMSG_ERR_INVAL;
+
+    if ((ch->state != CH_ANNOUNCED) && (ch->state != CH_UP))
+        return RPMSG_ERR_INVAL;
+
+    struct rpmsg_vdev* vd = &vdevs[ch->vdev];
+
+    int frag = (ch->flags & RPMSG_CH_F_FRAG) != 0;
+    if (frag && (len > RPMSG_FRAG_MSG_MAX))
+        return RPMSG_ERR_INVAL;
+    if (!frag && (len > DATA_LEN_MAX))
+    {
+        fprintf(stderr, "rpmsg_send_async: len=%d is too long, truncating, ie data loss\n", len);
+        len = DATA_LEN_MAX;
+    }
+
+    // make sure the whole message can be queued before sending anything
+    // (the fragments might be sent directly, but we can't know in advance)
+    int n = rpmsg_n_frags(ch, len);
+    if (n > RPMSG_TXQ_DEPTH)
+        return RPMSG_ERR_INVAL;     // would never fit into the queue
+    if (((RPMSG_TXQ_DEPTH - ch->txq_len) < n) || (txq_free_cnt < n))
+    {
+        ch->txq_full++;
+        return RPMSG_ERR_QFULL;
+    }
+
+    struct rpmsg_frag_hdr fh;
+    fh.msg_id = ch->frag_tx_id++;
+    fh.flags = 0;
+    fh.total_len = len;
+    fh.offset = 0;
+
+    int kick = 0;
+    int done = 0;   // last fragment was put into the vring directly
+    for (int i=0; i<n; i++)
+    {
+        uint32_t l = len - fh.offset;
+        if (frag && (l > FRAG_DATA_LEN_MAX))
+            l = FRAG_DATA_LEN_MAX;
+        const uint8_t* p = ((const uint8_t*)data) + fh.offset;
+        int last = (i == (n-1));
+
+        // fast path: nothing is queued on this channel (ordering), try to put it directly into the vring
+        if ((ch->txq_head == NULL) &&
+            (__send_message(vd, ch->local_addr, ch->remote_addr, frag ? &fh : NULL, frag ? sizeof(fh) : 0, p, l, 0) == 0))
+        {
+            kick = 1;
+            done = last;
+        }
+        else
+        {
+            txq_push(ch, frag ? &fh : NULL, frag ? sizeof(fh) : 0, p, l, last ? cb : NULL, priv);
+            ch->stats.tx_stalls++;
+        }
+        fh.offset += l;
+    }
+    ch->stats.tx_msgs++;
+    ch->stats.tx_bytes += len;
+
+    if (kick)
+        vring_kick(&(vd->tx_vring));
+    if (done && (cb != NULL))
+        cb(ch, priv, RPMSG_OK);
+
+    return RPMSG_OK;
+}
+
+
+// completion callback used by rpmsg_send(), priv points to a flag
+static void tx_done_flag(struct rpmsg_channel* ch, void* priv, int status)
+{
+    *((volatile int*)priv) = 1;
+}
+
+// serve all vdevs with a higher priority than vdev v (while a blocking send on v waits for a buffer)
+// returns 1 if there was something to do
+static int serve_higher_prio(uint32_t v)
+{
+    if (v == 0)
+        return 0;
+
+    // callbacks of the other vdevs may run now, keep the state of the message which is currently passed to a
+    // callback of our vdev (if any)
+    struct rx_cur_msg cur = rx_cur;
+    int ret = kick_task();
+    for (uint32_t i=0; i<v; i++)
+        ret |= vdev_task(&vdevs[i], 0);
+    rx_cur = cur;
+    return ret;
+}
+
+// wait until linux has returned buffers to the tx vring of ch, the time is accounted to channel ch
+// vdevs with a higher priority are served in the meantime
+static void wait_tx(struct rpmsg_channel* ch)
+{
+    if (txq_task(&vdevs[ch->vdev]))
+        return; // made some progress
+    if (serve_higher_prio(ch->vdev))
+        return;
+    XTime t0, t1;
+    XTime_GetTime(&t0);
+    // send cpu to sleep, we wake when automatically on an interrupt
+    wfe();
+    kick_task(); // this checks for kicks from the kernel
+    XTime_GetTime(&t1);
+    ch->stats.block_time += t1 - t0;
+}
+
+// send a message which has too many fragments for the tx queue, the fragments are written to the vring
+// directly as fast as linux returns buffers to us
+static void send_frags_blocking(struct rpmsg_channel* ch, const void* data, int len)
+{
+    struct rpmsg_vdev* vd = &vdevs[ch->vdev];
+
+    // keep the order of messages
+    while (ch->txq_head != NULL)
+        wait_tx(ch);
+
+    struct rpmsg_frag_hdr fh;
+    fh.msg_id = ch->frag_tx_id++;
+    fh.flags = 0;
+    fh.total_len = len;
+    fh.offset = 0;
+
+    while (fh.offset < len)
+    {
+        uint32_t l = len - fh.offset;
+        if (l > FRAG_DATA_LEN_MAX)
+            l = FRAG_DATA_LEN_MAX;
+        // publish without kick as long as there are buffers, kick once the vring is full
+        while (__send_message(vd, ch->local_addr, ch->remote_addr, &fh, sizeof(fh),
+                ((const uint8_t*)data) + fh.offset, l, 0))
+        {
+            vring_kick(&(vd->tx_vring));
+            ch->stats.tx_stalls++;
+            wait_tx(ch);
+        }
+        fh.offset += l;
+    }
+    vring_kick(&(vd->tx_vring));
+    ch->stats.tx_msgs++;
+    ch->stats.tx_bytes += len;
+}
+
 // transmit a message to Linux using the given channel
 // this blocks until the message is sent.
 void rpmsg_send(struct rpmsg_channel* ch, const void* data, int len)
 {
+    volatile int done = 0;
+    int ret;
+
     if (ch == NULL)
         return;
 
-    if ((ch->state != CH_ANNOUNCED) && (ch->state != CH_UP))
+    if ((ch->flags & RPMSG_CH_F_FRAG) && (len <= RPMSG_FRAG_MSG_MAX) &&
+        (rpmsg_n_frags(ch, len) > RPMSG_TXQ_DEPTH))
+    {
+        if ((ch->state == CH_ANNOUNCED) || (ch->state == CH_UP))
+            send_frags_blocking(ch, data, len);
         return;
+    }
+
+    while ((ret = rpmsg_send_async(ch, data, len, &tx_done_flag, (void*)&done)) == RPMSG_ERR_QFULL)
+        wait_tx(ch);
+
+    if (ret != RPMSG_OK)
+        return;
+
+    while (!done)
+        wait_tx(ch);
+}
+
+
+// check a vring entry of the resource table after the kernel has set it up
+// returns RPMSG_OK or RPMSG_ERR_RSC
+static int check_vring_rsc(const char* name, struct fw_rsc_vdev_vring* rsc)
+{
+    if (rsc->num != VRING_SIZE)
+    {
+        fprintf(stderr, "%s: %s has %u buffers, firmware is built for VRING_SIZE=%u\n", __func__, name,
+            (unsigned int)rsc->num, (unsigned int)VRING_SIZE);
+        return RPMSG_ERR_RSC;
+    }
+    if (rsc->da == 0)
+    {
+        fprintf(stderr, "%s: %s has no address, the kernel has not set up the vdev\n", __func__, name);
+        return RPMSG_ERR_RSC;
+    }
+    if ((rsc->align == 0) || ((rsc->da % rsc->align) != 0))
+    {
+        fprintf(stderr, "%s: %s at x%08x is not aligned to x%x\n", __func__, name,
+            (unsigned int)rsc->da, (unsigned int)rsc->align);
+        return RPMSG_ERR_RSC;
+    }
+    return RPMSG_OK;
+}
+
+
+// check whether linux has added its first rx buffer to vring0 (our tx vring) of a vdev. The vrings are not
+// initialized yet, so this reads the ring memory directly (vring_init would already write to it)
+static int rx_buf_added(struct rpmsg_vdev_rsc* rsc)
+{
+    uint32_t addr = rsc->vring[0].da;
+
+    if (rsc->vdev.gfeatures & (1<<VIRTIO_RPMSG_F_PACKED))
+    {
+        // both wrap counters start at 1: the first descriptor is available once linux has set AVAIL (but not USED)
+        volatile struct vring_packed_desc* d = (void*)addr;
+        Xil_L1DCacheFlushRange((unsigned int)d, sizeof(*d));
+        return (d->flags & (VRING_PACKED_DESC_F_AVAIL | VRING_PACKED_DESC_F_USED)) == VRING_PACKED_DESC_F_AVAIL;
+    }
+
+    // the available ring follows the descriptors, its free-running index starts at 0
+    volatile struct vring_avail* avail = (void*)(addr + VRING_SIZE * sizeof(struct vring_desc));
+    Xil_L1DCacheFlushRange((unsigned int)&(avail->avail_idx), sizeof(avail->avail_idx));
+    return avail->avail_idx != 0;
+}
+
+
+int remoteproc_ready(int fallback)
+{
+    int ret = RPROC_READY_DRIVER_OK;
 
-    block_send_message(ch->local_addr, ch->remote_addr, data, len);
+    // the resource table is written by linux (cpu0), make sure we don't read stale cache lines
+    Xil_L1DCacheFlushRange((unsigned int)&resources, sizeof(resources));
+
+    for (int v=0; v<RPMSG_N_VDEV; v++)
+    {
+        uint8_t status = *(volatile char*)&(resources.rpmsg[v].vdev.status);
+        if (status & VIRTIO_CONFIG_S_FAILED)
+            return RPMSG_ERR_RSC;
+        if ((resources.rpmsg[v].vring[0].da == 0) || (resources.rpmsg[v].vring[1].da == 0))
+            return 0;
+        if (!(status & VIRTIO_CONFIG_S_DRIVER_OK))
+        {
+            if (!fallback || !rx_buf_added(&resources.rpmsg[v]))
+                return 0;
+            ret = RPROC_READY_RX_BUF;
+        }
+    }
+    return ret;
 }
 
 
-void remoteproc_init()
+int remoteproc_init()
 {
+    char name[16];
+
+    // make sure the kernel has set up the vrings the way we were built for before touching them
+    for (int v=0; v<RPMSG_N_VDEV; v++)
+    {
+        for (int i=0; i<2; i++)
+        {
+            snprintf(name, sizeof(name), "vdev%d vring%d", v, i);
+            if (check_vring_rsc(name, &resources.rpmsg[v].vring[i]) != RPMSG_OK)
+                return RPMSG_ERR_RSC;
+        }
+    }
+
     memset(channels, 0, sizeof(channels));
+    memset(rx_hold_bufs, 0, sizeof(rx_hold_bufs));
+    rx_held = 0;
+
+    memset(frag_rx_slots, 0, sizeof(frag_rx_slots));
+
+    // chain all tx queue entries into the free list
+    txq_free_list = NULL;
+    txq_free_cnt = 0;
+    for (int i=0; i<RPMSG_TXQ_POOL_SIZE; i++)
+        txq_release(&txq_pool[i]);
 
-    // disable L1 data cache on vrings (this silently assumes that the actual data buffers are covered by the same 1MB region)
-	// However, this is pretty save as the kernel assigns the buffer in a continuous block outside our memory region
-	// This seemed to cause some problems, so use a cache flush in virtio_ring.c instead
-	//Xil_SetTlbAttributes(resources.rpmsg_vring0.da & 0xFFF00000, 0x04de2);  // S=b0 TEX=b100 AP=b11, Domain=b1111, C=b0, B=b0
-	Xil_SetTlbAttributes(resources.rpmsg_vring0.da & 0xFFF00000, 0x15dea); // write through L1, write back L2
-
-    // load pointers to vring elements allocated by the kernel
-    // this is the element defined by the vring protocol
-    uint32_t addr = resources.rpmsg_vring0.da;
-    //fprintf(stderr, "tx vring is at 0x%08x\n", addr);
-    vring_init(&tx_vring, addr, &kick_linux);
-    addr = resources.rpmsg_vring1.da;
-    //fprintf(stderr, "rx vring is at 0x%08x\n", addr);
-    vring_init(&rx_vring, addr, &kick_linux);
+    for (int v=0; v<RPMSG_N_VDEV; v++)
+    {
+        struct rpmsg_vdev* vd = &vdevs[v];
+        struct rpmsg_vdev_rsc* rsc = &resources.rpmsg[v];
+
+        // disable L1 data cache on vrings (this silently assumes that the actual data buffers are covered by the same 1MB region)
+        // However, this is pretty save as the kernel assigns the buffer in a continuous block outside our memory region
+        // This seemed to cause some problems, so use a cache flush in virtio_ring.c instead
+        //Xil_SetTlbAttributes(rsc->vring[0].da & 0xFFF00000, 0x04de2);  // S=b0 TEX=b100 AP=b11, Domain=b1111, C=b0, B=b0
+        Xil_SetTlbAttributes(rsc->vring[0].da & 0xFFF00000, 0x15dea); // write through L1, write back L2
+
+        // the kernel has written the features it accepted to the resource table, use the packed layout if it
+        // understood our (non standard) feature bit. Unmodified kernels don't, so we fall back to split vrings
+        int packed = (rsc->vdev.gfeatures & (1<<VIRTIO_RPMSG_F_PACKED)) != 0;
+
+        // load pointers to vring elements allocated by the kernel
+        // this is the element defined by the vring protocol
+        vring_init(&(vd->tx_vring), rsc->vring[0].da, &kick_linux, packed);
+        vring_init(&(vd->rx_vring), rsc->vring[1].da, &kick_linux, packed);
+        vd->rx_pending = 1;     // linux might have sent something before we were ready
 #ifdef DBG_MSG
-    tx_vring.dbg_print = 1; // enable debug print messages
-    rx_vring.dbg_print = 1; // enable debug print messages
+        vd->tx_vring.dbg_print = 1; // enable debug print messages
+        vd->rx_vring.dbg_print = 1; // enable debug print messages
 #endif
-/*
-    fprintf(stderr, "%s: resoucre table:\n", __func__);
-    fprintf(stderr, "tx vring: desc=%08x avail=%08x used=x%08x len=x%04x\n",
-        (unsigned int)tx_vring.desc, (unsigned int)tx_vring.avail, (unsigned int)tx_vring.used, (unsigned int)tx_vring.vring_len);
-	fprintf(stderr, "rx vring: desc=%08x avail=%08x used=x%08x\n",
-        (unsigned int)rx_vring.desc, (unsigned int)rx_vring.avail, (unsigned int)rx_vring.used);*/
+        fprintf(stderr, "%s: vdev %d notify ids %u %u\n", __func__, v, (unsigned int)rsc->vring[0].notifyid,
+            (unsigned int)rsc->vring[1].notifyid);
+    }
 
+    evring_init(&kick_events);
 	XScuGic_Connect(&IntcInst, TXVRING_IRQ, &txvring_irq, NULL);
 	XScuGic_Enable(&IntcInst, TXVRING_IRQ);
 	XScuGic_Connect(&IntcInst, RXVRING_IRQ, &rxvring_irq, NULL);
 	XScuGic_Enable(&IntcInst, RXVRING_IRQ);
+
+    // the kernel fills the tx vrings with empty buffers (which we use to send), check their size if there
+    // are some already. Otherwise this is checked by __send_message for every buffer.
+    for (int v=0; v<RPMSG_N_VDEV; v++)
+    {
+        uint32_t buf_len = vring_peek_len(&(vdevs[v].tx_vring));
+        if ((buf_len != 0) && (buf_len < PACKET_LEN_MAX))
+        {
+            fprintf(stderr, "%s: kernel buffers of vdev %d are %u bytes, firmware is built for PACKET_LEN_MAX=%u\n",
+                __func__, v, (unsigned int)buf_len, (unsigned int)PACKET_LEN_MAX);
+            return RPMSG_ERR_RSC;
+        }
+    }
+
+    return RPMSG_OK;
+}
+
+// access the vdev entry of the resource table (eg to check what the kernel has written to it)
+struct fw_rsc_vdev* rpmsg_get_vdev_rsc(int v)
+{
+    if ((v < 0) || (v >= RPMSG_N_VDEV))
+        return NULL;
+    return &resources.rpmsg[v].vdev;
+}
+
+// access vring entry i (0 or 1) of vdev v in the resource table, returns NULL if v or i is invalid
+struct fw_rsc_vdev_vring* rpmsg_get_vring_rsc(int v, int i)
+{
+    if ((v < 0) || (v >= RPMSG_N_VDEV) || (i < 0) || (i > 1))
+        return NULL;
+    return &resources.rpmsg[v].vring[i];
+}
+
+struct rpmsg_channel* rpmsg_get_ch(int i)
+{
+    if ((i < 0) || (i >= MAX_RPMSG_CH))
+        return NULL;
+    return &channels[i];
+}
+
+// the kick counters are those of the interrupt (TXVRING_IRQ for even i, RXVRING_IRQ for odd i), with several vdevs
+// a kick can't be assigned to a vring
+int rpmsg_get_vring_stats(int i, struct rpmsg_vring_stats* s)
+{
+    if ((i < 0) || (i >= (2*RPMSG_N_VDEV)) || (s == NULL))
+        return RPMSG_ERR_INVAL;
+
+    struct vring* vr = (i & 1) ? &(vdevs[i/2].rx_vring) : &(vdevs[i/2].tx_vring);
+    s->bufs = vr->bufs;
+    s->kicks_sent = vr->kicks;
+    s->kicks_rcvd = (i & 1) ? rxvring_kicks : txvring_kicks;
+    s->empty = vr->empty;
+    return RPMSG_OK;
+}
+
+void rpmsg_get_kick_stats(struct rpmsg_kick_stats* s)
+{
+    if (s != NULL)
+        memcpy(s, &kick_stats, sizeof(*s));
 }
 
 void rpmsg_get_trace_buf_settings (struct fw_rsc_trace* d)
@@ -407,3 +1178,11 @@ void rpmsg_get_trace_buf_settings (struct fw_rsc_trace* d)
     memcpy((void*)d, (void*)(&resources.trace), sizeof(*d));
 }
 
+void rpmsg_get_blog_buf_settings (struct fw_rsc_trace* d)
+{
+    if (!d)
+        return;
+
+    memcpy((void*)d, (void*)(&resources.blog), sizeof(*d));
+}
+
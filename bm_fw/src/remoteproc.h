@@ -14,6 +14,51 @@
 // define the number of max. available rpmsg channels
 #define MAX_RPMSG_CH      5
 
+// number of rpmsg vdevs (vring pairs) announced in the resource table, each one is a separate rpmsg bus in linux.
+// vdev 0 carries control traffic and is always served first (strict priority), vdev 1 carries bulk traffic (eg
+// stdio) so a full bulk tx vring can't delay control replies. Set to 1 to use a single vring pair for everything.
+#ifndef RPMSG_N_VDEV
+#define RPMSG_N_VDEV          2
+#endif
+#if (RPMSG_N_VDEV < 1) || (RPMSG_N_VDEV > 2)
+#error RPMSG_N_VDEV must be 1 or 2
+#endif
+#define RPMSG_VDEV_CTRL       0
+#define RPMSG_VDEV_BULK       (RPMSG_N_VDEV - 1)
+
+// max. number of messages read from a lower priority (bulk) vdev per call of rpmsg_poll, the control vdev is
+// checked again afterwards
+#define RPMSG_BULK_BUDGET     8
+
+// number of message buffers for the asynchronous send queue (shared by all channels)
+#define RPMSG_TXQ_POOL_SIZE   32
+// max. number of messages which may be queued on a single channel
+#define RPMSG_TXQ_DEPTH       16
+
+// number of reassembly buffers (RPMSG_FRAG_MSG_MAX bytes each) for fragmented messages (all channels)
+#define RPMSG_FRAG_RX_SLOTS   2
+
+// channel flags (rpmsg_create_ch_ex)
+#define RPMSG_CH_F_FRAG       (1<<0)  // messages carry a struct rpmsg_frag_hdr, allows messages > DATA_LEN_MAX
+#define RPMSG_CH_F_BULK       (1<<1)  // use the bulk vdev (RPMSG_VDEV_BULK) instead of the control vdev
+
+// max. number of rx buffers which may be held by channel callbacks at the same time (all channels)
+#define RPMSG_RX_HOLD_MAX     8
+
+// number of bins of the callback execution time histogram (struct rpmsg_ch_stats): bin 0 counts callbacks which
+// took less than 1us, bin i (i>0) those which took 2^(i-1) to 2^i-1 us, the last bin includes all longer ones
+#define RPMSG_CB_HIST_BINS    16
+
+// return codes of rpmsg_send_async() and remoteproc_init()
+#define RPMSG_OK            0
+#define RPMSG_ERR_QFULL     -1  // tx queue of this channel is full (back pressure), try again later
+#define RPMSG_ERR_INVAL     -2  // invalid channel (NULL or not announced)
+#define RPMSG_ERR_RSC       -3  // the kernel's vring setup does not match VRING_SIZE / PACKET_LEN_MAX
+
+// return codes of remoteproc_ready() if the vdevs are ready
+#define RPROC_READY_DRIVER_OK   1   // all vdevs have DRIVER_OK set
+#define RPROC_READY_RX_BUF      2   // at least one vdev was accepted by the fallback (rx buffer added, no DRIVER_OK)
+
 /* Resource table setup */
 //void mmu_resource_table_setup(void);
 
@@ -32,19 +77,91 @@ enum rpmsg_ch_state {
 
 struct rpmsg_channel;
 
+struct rpmsg_txq_entry;
+struct rpmsg_frag_rx;
+
+// transport statistics of a channel, these are always on
+struct rpmsg_ch_stats {
+   uint32_t tx_msgs;        // messages sent (accepted by rpmsg_send / rpmsg_send_async)
+   uint32_t tx_bytes;       // payload bytes sent
+   uint32_t rx_msgs;        // messages passed to the callback (after reassembly)
+   uint32_t rx_bytes;
+   uint32_t tx_stalls;      // fragments which found no free tx vring buffer (queued or waited for)
+   uint64_t block_time;     // global timer ticks spent waiting in blocking sends
+   uint32_t cb_max;         // longest callback execution time in us
+   uint32_t cb_hist[RPMSG_CB_HIST_BINS];    // log2 histogram of callback execution times
+};
+
+// statistics of a vring (see rpmsg_get_vring_stats)
+struct rpmsg_vring_stats {
+   uint32_t bufs;           // buffers returned to linux (sent messages on vring0, recycled ones on vring1)
+   uint32_t kicks_sent;     // interrupts sent to linux
+   uint32_t kicks_rcvd;     // interrupts received from linux
+   uint32_t empty;          // number of times we found no buffer in the ring
+};
+
+// statistics of the kicks received from linux (see rpmsg_get_kick_stats)
+struct rpmsg_kick_stats {
+   uint32_t events;         // kicks processed (both interrupts)
+   uint32_t dropped;        // kicks lost because the event ring was full (harmless, see kick_task)
+   uint32_t lat_max;        // longest time from the interrupt to its processing in rpmsg_poll in us
+   uint32_t lat_hist[RPMSG_CB_HIST_BINS];   // log2 histogram of these latencies
+};
+
 typedef void (rpmsg_rx_callback)(struct rpmsg_channel* ch, uint8_t* data, uint32_t len);
 
+// completion callback for asynchronous sends, called once the message was passed to linux (status is RPMSG_OK)
+typedef void (rpmsg_tx_callback)(struct rpmsg_channel* ch, void* priv, int status);
+
 struct rpmsg_channel {
    uint32_t local_addr;   // address used by this end of the channel (bm)
    uint32_t remote_addr;  // address used by remote end of channel (linux)
    enum rpmsg_ch_state state;
    char name[RPMSG_NAME_SIZE];
    rpmsg_rx_callback* cb;   // callback for received data
+   uint32_t flags;          // RPMSG_CH_F_* flags
+   uint32_t vdev;           // index of the vdev (vring pair) used by this channel
+
+   // messages waiting for a free tx vring buffer (async send queue)
+   struct rpmsg_txq_entry* txq_head;
+   struct rpmsg_txq_entry* txq_tail;
+   uint16_t txq_len;        // number of queued messages
+   uint16_t txq_max;        // high-water mark of txq_len
+   uint32_t txq_full;       // number of send attempts rejected because the queue was full
+
+   // rx buffers kept by the callback (see rpmsg_rx_hold)
+   uint16_t rx_held;        // number of rx buffers currently held
+   uint16_t rx_held_max;    // high-water mark of rx_held
+   uint32_t rx_hold_fail;   // number of hold requests denied (no free handle)
+
+   // fragmentation (RPMSG_CH_F_FRAG only)
+   uint16_t frag_tx_id;             // msg_id of the next message sent
+   struct rpmsg_frag_rx* frag_rx;   // reassembly buffer of the message currently received (or NULL)
+   uint32_t rx_frag_err;            // number of dropped fragments (out of order, too long, no buffer)
+
+   struct rpmsg_ch_stats stats;
 };
 
+// handle of a received message whose buffer was kept by the channel callback
+struct rpmsg_rx_buf {
+   struct rpmsg_channel* ch;  // channel which received the message, NULL if the handle is unused
+   uint8_t* data;             // payload, stays valid until the buffer is released
+   uint32_t len;              // payload length
+   uint16_t desc;             // rx vring descriptor index (private)
+};
+
+
+// check whether linux is done with setting up the vdevs: it has written the vring addresses to the resource table
+// and the rpmsg driver has set DRIVER_OK in the status of all vdevs (this happens after its rx buffers were added)
+// fallback: also accept vdevs without DRIVER_OK once linux has added its first rx buffer to vring0, for kernels
+// which set the status late or not at all. Only use this after waiting for DRIVER_OK for a while
+// returns RPROC_READY_DRIVER_OK or RPROC_READY_RX_BUF (fallback was needed for at least one vdev) if remoteproc_init
+// may be called, 0 if not yet or RPMSG_ERR_RSC if the driver has given up (FAILED)
+int remoteproc_ready(int fallback);
 
 // Init function, has to be call before anything else.
-void remoteproc_init();
+// returns RPMSG_OK or RPMSG_ERR_RSC if the vrings set up by the kernel can't be used (rpmsg must not be used then)
+int remoteproc_init();
 
 // poll function processes data, has to be called periodically
 int rpmsg_poll();
@@ -53,10 +170,59 @@ int rpmsg_poll();
 struct rpmsg_channel* rpmsg_create_ch (const char* name,
         rpmsg_rx_callback* cb);
 
+// announce a new channel to linux, flags is a combination of RPMSG_CH_F_*
+// With RPMSG_CH_F_FRAG messages up to RPMSG_FRAG_MSG_MAX bytes can be sent and received, the kernel driver
+// has to use the same framing (see kernel_mod/rpmsg_frag.c).
+// With RPMSG_CH_F_BULK the channel uses the bulk vdev. While a blocking send on a bulk channel waits for a
+// buffer the control vdev is still served, ie callbacks of control channels may run within rpmsg_send.
+struct rpmsg_channel* rpmsg_create_ch_ex (const char* name,
+        rpmsg_rx_callback* cb, uint32_t flags);
+
 // send data to remote side (linux) using channel ch (has to be created in advance)
+// blocks until the message was passed to linux
+// Messages longer than DATA_LEN_MAX are truncated unless the channel uses RPMSG_CH_F_FRAG.
 void rpmsg_send(struct rpmsg_channel* ch, const void* data, int len);
 
+// send data without blocking: the message is copied to the channel's tx queue if no vring buffer is free
+// right now and sent from rpmsg_poll() later on. cb (may be NULL) is called with priv once the message was
+// passed to linux, this might happen before this function returns.
+// On RPMSG_CH_F_FRAG channels a message uses one queue entry per fragment, it is queued completely or not at all.
+// Must not be called from interrupt context.
+// returns RPMSG_OK, RPMSG_ERR_QFULL if the queue is full (nothing was sent) or RPMSG_ERR_INVAL (also if the
+// message needs more than RPMSG_TXQ_DEPTH fragments, use the blocking rpmsg_send in this case)
+int rpmsg_send_async(struct rpmsg_channel* ch, const void* data, int len,
+        rpmsg_tx_callback* cb, void* priv);
+
+// take ownership of the rx buffer which is currently passed to the callback of channel ch (zero copy).
+// Only valid within the rx callback and not for messages which were reassembled from several fragments. The buffer is not returned to linux until rpmsg_rx_release() is called,
+// so don't keep it longer than necessary, linux can't send while we hold all its buffers.
+// returns NULL if no handle is available, the buffer is recycled when the callback returns in this case
+struct rpmsg_rx_buf* rpmsg_rx_hold(struct rpmsg_channel* ch);
+
+// return a buffer obtained by rpmsg_rx_hold() to linux, buf->data must not be used afterwards
+void rpmsg_rx_release(struct rpmsg_rx_buf* buf);
+
+// returns the number of rx buffers currently held (all channels)
+unsigned int rpmsg_rx_held(void);
+
+// returns channel i (0..MAX_RPMSG_CH-1, including unused ones) or NULL if i is invalid, for statistics
+struct rpmsg_channel* rpmsg_get_ch(int i);
+
+// copy the statistics of vring i to s (2*v: tx and 2*v+1: rx vring of vdev v), returns RPMSG_OK or RPMSG_ERR_INVAL
+int rpmsg_get_vring_stats(int i, struct rpmsg_vring_stats* s);
+
+// copy the statistics of the kicks received from linux to s
+void rpmsg_get_kick_stats(struct rpmsg_kick_stats* s);
+
 // copy the trace buffer settings to d
 void rpmsg_get_trace_buf_settings (struct fw_rsc_trace* d);
 
+// copy the settings of the binary log's trace buffer to d (see blog.h)
+void rpmsg_get_blog_buf_settings (struct fw_rsc_trace* d);
+
+// access the vdev entry of vdev v (0..RPMSG_N_VDEV-1) and its vring entries i (0: tx, 1: rx) in the resource
+// table (these are written by the kernel), NULL is returned for invalid indices
+struct fw_rsc_vdev* rpmsg_get_vdev_rsc(int v);
+struct fw_rsc_vdev_vring* rpmsg_get_vring_rsc(int v, int i);
+
 #endif /* REMOTEPROC_H */
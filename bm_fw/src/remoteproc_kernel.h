@@ -34,6 +34,7 @@ typedef uint32_t    u32;
 #define RXVRING_IRQ					9
 
 
+#ifndef VRING_SIM
 /* Just load all symbols from Linker script */
 
 extern char *_vector_table;
@@ -50,12 +51,29 @@ extern char *__trace_buffer_start;
 extern char *__trace_buffer_end;
 #define TRACE_BUFFER_END		(unsigned int)&__trace_buffer_end
 
+extern char *__blog_buffer_start;
+#define BLOG_BUFFER_START		(unsigned int)&__blog_buffer_start
+#else
+/* host simulator (tools/vring_sim): there is no linker script and no carveout for the image or the trace buffer */
+#define ELF_START               0
+#define ELF_END                 0
+#define ELF_LEN                 0
+#define TRACE_BUFFER_START		0
+#define TRACE_BUFFER_END		0
+#define BLOG_BUFFER_START		0
+#endif
+
 /* This value should be shared with Linker script */
 #ifndef TRACE_BUFFER_SIZE
     #warning Assuming default trace buffer size
     #define TRACE_BUFFER_SIZE		0x8000
 #endif
 
+/* size of the binary log (blog.c), second trace buffer. This should be shared with Linker script */
+#ifndef BLOG_BUFFER_SIZE
+    #define BLOG_BUFFER_SIZE		0x4000
+#endif
+
 /* section helpers */
 #define __to_section(S)			__attribute__((__section__(#S)))
 #define __resource				__to_section(.resource_table)
@@ -64,12 +82,21 @@ extern char *__trace_buffer_end;
 #define VIRTIO_ID_CONSOLE		3 /* virtio console */
 #define VIRTIO_ID_RPMSG			7 /* virtio remote processor messaging */
 
+/* virtio device status bits: keep in sync with the linux "include/uapi/linux/virtio_config.h" */
+#define VIRTIO_CONFIG_S_ACKNOWLEDGE	1
+#define VIRTIO_CONFIG_S_DRIVER		2
+#define VIRTIO_CONFIG_S_DRIVER_OK	4
+#define VIRTIO_CONFIG_S_FAILED		0x80
+
 /* Indices of rpmsg virtio features we support */
 #define VIRTIO_RPMSG_F_NS		0 /* RP supports name service notifications */
+/* RP supports packed vrings (see virtio_ring.h). This is not an upstream feature, the bit is taken from the end of
+ * the device specific range. Kernels which don't know it won't ack it and the split layout is used. */
+#define VIRTIO_RPMSG_F_PACKED	23
 
 
 /* flip up bits whose indices represent features we support */
-#define RPMSG_IPU_C0_FEATURES	(1<<VIRTIO_RPMSG_F_NS)
+#define RPMSG_IPU_C0_FEATURES	((1<<VIRTIO_RPMSG_F_NS) | (1<<VIRTIO_RPMSG_F_PACKED))
 
 /* Resource info: Must match include/linux/remoteproc.h: */
 #define TYPE_CARVEOUT			0
@@ -207,9 +234,41 @@ enum rpmsg_ns_flags {
 
 
 
-/* vring data buffer max length including the header */
+/* vring data buffer max length including the header. The kernel's virtio_rpmsg_bus allocates 512 byte buffers,
+ * smaller values work but larger ones don't (checked when the first buffer arrives). Set by the Makefile. */
+#ifndef PACKET_LEN_MAX
 #define PACKET_LEN_MAX				512
+#endif
+
+#if (PACKET_LEN_MAX < 64) || ((PACKET_LEN_MAX % 4) != 0)
+#error PACKET_LEN_MAX must be a multiple of 4 and at least 64
+#endif
 #define DATA_LEN_MAX				(PACKET_LEN_MAX - sizeof(struct rpmsg_hdr))
 
+
+/**
+ * struct rpmsg_frag_hdr - header for messages which are split into several vring buffers
+ * @msg_id: identifies all fragments of one message, incremented for each message
+ * @flags: reserved, must be zero
+ * @total_len: total payload length of the message (excluding fragment headers)
+ * @offset: position of this fragment's payload within the message
+ *
+ * Channels which are created with RPMSG_CH_F_FRAG prefix every message with this header,
+ * this is not understood by the rpmsg bus. The kernel side (kernel_mod/rpmsg_frag.h) uses
+ * the same layout. Messages which fit into a single buffer are sent as one fragment with
+ * offset 0 and total_len equal to the payload length.
+ */
+struct rpmsg_frag_hdr {
+	u16 msg_id;
+	u16 flags;
+	u32 total_len;
+	u32 offset;
+} __attribute__((packed));
+
+/* max. total length of a fragmented message, this must match the kernel side */
+#define RPMSG_FRAG_MSG_MAX			4096
+/* max. payload per fragment */
+#define FRAG_DATA_LEN_MAX			(DATA_LEN_MAX - sizeof(struct rpmsg_frag_hdr))
+
 #endif /* REMOTEPROC_KERNEL_H */
 
@@ -0,0 +1,342 @@
+/******************************************************************************************************************************
+*
+*   AMP Configuration Variable Management
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   sched.c
+*
+*   Cooperative scheduler with a hierarchical timer wheel, see sched.h
+*
+*   The wheel has WHEEL_LEVELS levels of WHEEL_SIZE slots. Level 0 has one slot per tick, a slot of level n covers
+*   WHEEL_SIZE^n ticks. Whenever level 0 wraps around the next slot of level 1 is cascaded (its tasks are inserted
+*   again, now with a finer resolution) and so on. Inserting and expiring a task are O(1), the interrupt handler
+*   only counts ticks, the wheel is advanced by sched_run.
+*
+******************************************************************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <xtime_l.h>
+
+#include "sched.h"
+
+
+/******************************************************************************************************************************
+*   C O N F I G
+*/
+
+#define WHEEL_BITS          6
+#define WHEEL_SIZE          (1 << WHEEL_BITS)
+#define WHEEL_MASK          (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS        3
+
+// longest delay which can be put into the wheel directly (about 262s at 1kHz), longer ones are cascaded again
+#define WHEEL_RANGE         ((1u << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+// global timer counts per tick and per us
+#define COUNTS_PER_TICK     (COUNTS_PER_SECOND / SCHED_TICK_HZ)
+#define COUNTS_PER_US       (COUNTS_PER_SECOND / 1000000)
+
+
+
+/******************************************************************************************************************************
+*   S T R U C T S
+*/
+
+struct sched_task {
+    struct sched_task* next;    // wheel slot list (doubly linked so tasks can be cancelled)
+    struct sched_task* prev;
+    struct sched_task** slot;   // list head the task is in, NULL if it is not in the wheel
+    sched_fn* fn;
+    void* arg;
+    uint32_t expires;           // tick at which the task is due next
+    uint32_t due;               // tick at which the pending run became due
+    int ready;                  // the task is due and waits to be run
+    uint8_t prio;
+    struct sched_stats stats;   // stats.name is NULL for unused slots
+};
+
+
+
+/******************************************************************************************************************************
+*   G L O B A L S
+*/
+
+static struct sched_task tasks[SCHED_MAX_TASKS];
+
+static struct sched_task* wheel[WHEEL_LEVELS][WHEEL_SIZE];
+
+// ticks counted by the interrupt handler and ticks the wheel has been advanced to
+static volatile uint32_t ticks = 0;
+static uint32_t wheel_tick = 0;
+
+// global timer value at tick 0
+static XTime t_start;
+
+// set while tasks are run, sched_run is not reentrant
+static int running = 0;
+
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+static void unlink_task(struct sched_task* t)
+{
+    if (t->slot == NULL)
+        return;
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        *(t->slot) = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+    t->slot = NULL;
+}
+
+// put t into the wheel slot for t->expires, which must be after wheel_tick
+static void insert_task(struct sched_task* t)
+{
+    uint32_t delta = t->expires - wheel_tick;
+    uint32_t e = t->expires;
+    int level;
+
+    if (delta > WHEEL_RANGE)
+    {
+        // too far away, park it in the last slot we can reach, it is inserted again when that slot is cascaded
+        e = wheel_tick + WHEEL_RANGE;
+        delta = WHEEL_RANGE;
+    }
+    for (level=0; level<(WHEEL_LEVELS-1); level++)
+    {
+        if (delta < (1u << (WHEEL_BITS * (level+1))))
+            break;
+    }
+
+    struct sched_task** slot = &wheel[level][(e >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    t->prev = NULL;
+    t->next = *slot;
+    if (t->next)
+        t->next->prev = t;
+    *slot = t;
+    t->slot = slot;
+}
+
+// the task has expired: mark it ready and put periodic tasks back into the wheel
+static void expire_task(struct sched_task* t)
+{
+    if (t->ready)
+        t->stats.overruns++;    // still waiting for the previous run, skip this one
+    else
+    {
+        t->ready = 1;
+        t->due = t->expires;
+    }
+
+    if (t->stats.period == 0)
+        return;
+    // keep the phase, count the periods we have missed entirely (main loop was blocked)
+    t->expires += t->stats.period;
+    while ((int32_t)(t->expires - wheel_tick) <= 0)
+    {
+        t->stats.overruns++;
+        t->expires += t->stats.period;
+    }
+    insert_task(t);
+}
+
+// re-insert all tasks of a slot of a higher level
+static void cascade(int level, int index)
+{
+    struct sched_task* t = wheel[level][index];
+    wheel[level][index] = NULL;
+    while (t)
+    {
+        struct sched_task* next = t->next;
+        t->slot = NULL;
+        if (t->expires == wheel_tick)
+            expire_task(t);
+        else
+            insert_task(t);
+        t = next;
+    }
+}
+
+// advance the wheel by one tick and expire the tasks of the new tick
+static void advance(void)
+{
+    wheel_tick++;
+
+    // cascade the higher levels whenever the level below wraps around
+    for (int level=1; level<WHEEL_LEVELS; level++)
+    {
+        if ((wheel_tick & ((1u << (WHEEL_BITS * level)) - 1)) != 0)
+            break;
+        cascade(level, (wheel_tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    }
+
+    struct sched_task** slot = &wheel[0][wheel_tick & WHEEL_MASK];
+    while (*slot)
+    {
+        struct sched_task* t = *slot;
+        unlink_task(t);
+        if (t->expires == wheel_tick)
+            expire_task(t);
+        else
+            insert_task(t);     // parked task (delay > WHEEL_RANGE)
+    }
+}
+
+// ready task with the highest priority or NULL
+static struct sched_task* next_ready(void)
+{
+    struct sched_task* best = NULL;
+    for (int i=0; i<SCHED_MAX_TASKS; i++)
+    {
+        if (tasks[i].ready && ((best == NULL) || (tasks[i].prio < best->prio)))
+            best = &tasks[i];
+    }
+    return best;
+}
+
+
+void sched_init(void)
+{
+    memset(tasks, 0, sizeof(tasks));
+    memset(wheel, 0, sizeof(wheel));
+    ticks = 0;
+    wheel_tick = 0;
+    XTime_GetTime(&t_start);
+}
+
+
+void sched_tick(void)
+{
+    ticks++;
+}
+
+
+uint32_t sched_ticks(void)
+{
+    return ticks;
+}
+
+
+int sched_add(const char* name, sched_fn* fn, void* arg, uint32_t delay, uint32_t period, uint8_t prio)
+{
+    if ((fn == NULL) || (name == NULL))
+        return -1;
+
+    for (int i=0; i<SCHED_MAX_TASKS; i++)
+    {
+        struct sched_task* t = &tasks[i];
+        if (t->stats.name != NULL)
+            continue;
+
+        memset(t, 0, sizeof(*t));
+        t->fn = fn;
+        t->arg = arg;
+        t->prio = prio;
+        t->stats.name = name;
+        t->stats.period = period;
+        t->expires = wheel_tick + delay;
+        if (delay == 0)
+            expire_task(t);
+        else
+            insert_task(t);
+        return i;
+    }
+    return -1;
+}
+
+
+int sched_cancel(int id)
+{
+    if ((id < 0) || (id >= SCHED_MAX_TASKS) || (tasks[id].stats.name == NULL))
+        return -1;
+    unlink_task(&tasks[id]);
+    tasks[id].ready = 0;
+    tasks[id].stats.name = NULL;
+    return 0;
+}
+
+
+int sched_run(void)
+{
+    struct sched_task* t;
+    int ret = 0;
+
+    if (running)
+        return 0;
+    running = 1;
+
+    while (1)
+    {
+        // catch up with the interrupt, a task which became due meanwhile might have a higher priority
+        uint32_t now = ticks;
+        while (wheel_tick != now)
+            advance();
+
+        t = next_ready();
+        if (t == NULL)
+            break;
+
+        XTime t0, t1;
+        XTime_GetTime(&t0);
+        XTime due = t_start + (XTime)t->due * COUNTS_PER_TICK;
+        uint32_t jitter = (t0 > due) ? (uint32_t)((t0 - due) / COUNTS_PER_US) : 0;
+        t->stats.jitter_last = jitter;
+        if (jitter > t->stats.jitter_max)
+            t->stats.jitter_max = jitter;
+
+        t->ready = 0;
+        t->stats.runs++;
+        if (t->stats.period == 0)
+            t->stats.name = NULL;   // one-shot, the slot may be reused by fn
+
+        t->fn(t->arg);
+
+        XTime_GetTime(&t1);
+        uint32_t run = (uint32_t)((t1 - t0) / COUNTS_PER_US);
+        if (run > t->stats.run_max)
+            t->stats.run_max = run;
+        ret = 1;
+    }
+
+    running = 0;
+    return ret;
+}
+
+
+int sched_get_stats(int id, struct sched_stats* s)
+{
+    if ((id < 0) || (id >= SCHED_MAX_TASKS) || (s == NULL))
+        return -1;
+    memcpy(s, &(tasks[id].stats), sizeof(*s));
+    return 0;
+}
@@ -0,0 +1,109 @@
+/******************************************************************************************************************************
+*
+*   AMP Configuration Variable Management
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   sched.h
+*
+*   Cooperative scheduler: periodic and one-shot tasks are kept in a hierarchical timer wheel which is advanced by
+*   the system tick (SCU private timer). Due tasks are run to completion from the main loop (sched_run) in order of
+*   priority, overruns (a task became due again before it ran) and start jitter are recorded per task.
+*
+******************************************************************************************************************************/
+
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include <stdint.h>
+
+
+/******************************************************************************************************************************
+*   C O N F I G
+*/
+
+// system tick frequency, sys_timer_init (main.c) has to program the timer accordingly
+#define SCHED_TICK_HZ           1000
+
+// max. number of tasks
+#define SCHED_MAX_TASKS         16
+
+// convert milliseconds to ticks
+#define SCHED_MS(ms)            (((ms) * SCHED_TICK_HZ) / 1000)
+
+// task priorities, lower values run first (any value 0..255 may be used)
+#define SCHED_PRIO_HIGH         0
+#define SCHED_PRIO_NORMAL       128
+#define SCHED_PRIO_LOW          255
+
+
+
+/******************************************************************************************************************************
+*   S T R U C T S
+*/
+
+typedef void (sched_fn)(void* arg);
+
+// statistics of a task (see sched_get_stats)
+struct sched_stats {
+    const char* name;       // NULL for unused task slots
+    uint32_t period;        // in ticks, 0 for one-shot tasks
+    uint32_t runs;
+    uint32_t overruns;      // number of times the task became due again before it ran (the run is skipped)
+    uint32_t jitter_max;    // max. delay from the due tick to the start of the task in us
+    uint32_t jitter_last;
+    uint32_t run_max;       // max. execution time in us
+};
+
+
+
+/******************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+// call before the tick interrupt is started
+void sched_init(void);
+
+// advance the system tick, called by the timer interrupt handler (SCHED_TICK_HZ)
+void sched_tick(void);
+
+// number of ticks since sched_init
+uint32_t sched_ticks(void);
+
+// add a task which runs after delay ticks (0: in the next sched_run) and then every period ticks (0: only once)
+// returns the task id (>= 0) or -1 if there is no free task slot
+// One-shot tasks free their slot before fn is called. Periodic tasks keep their phase: late runs don't shift
+// later ones.
+int sched_add(const char* name, sched_fn* fn, void* arg, uint32_t delay, uint32_t period, uint8_t prio);
+
+// remove a task, returns 0 on success or -1 if id is not a valid task
+int sched_cancel(int id);
+
+// run all due tasks (highest priority first) and return 1 if at least one ran, 0 if there was nothing to do
+// This has to be called from the main loop, it must not be called from a task.
+int sched_run(void);
+
+// copy the statistics of task slot id (0..SCHED_MAX_TASKS-1) to s, returns 0 or -1 if id is invalid
+int sched_get_stats(int id, struct sched_stats* s);
+
+#endif
@@ -0,0 +1,163 @@
+/******************************************************************************************************************************
+*
+*   AMP Configuration Variable Management
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   stdout_buf.c
+*
+*   Non-blocking buffer for stdout, see stdout_buf.h
+*
+******************************************************************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "stdout_buf.h"
+
+
+/******************************************************************************************************************************
+*   G L O B A L S
+*/
+
+// head and tail are free running byte counters, head-tail bytes are in the buffer
+static char buf[STDOUT_BUF_SIZE];
+static uint32_t head = 0;
+static uint32_t tail = 0;
+
+static int policy = STDOUT_BUF_POLICY;
+
+static struct stdout_buf_stats stats;
+
+// value of stats.dropped when the last drop notice was sent
+static uint32_t dropped_reported = 0;
+
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+void stdout_buf_set_policy(int p)
+{
+    if ((p == STDOUT_DROP_NEWEST) || (p == STDOUT_DROP_OLDEST))
+        policy = p;
+}
+
+
+size_t stdout_buf_write(const void* data, size_t len)
+{
+    const char* d = data;
+    uint32_t n = len;
+
+    stats.written += len;
+
+    uint32_t space = STDOUT_BUF_SIZE - (head - tail);
+    if (n > space)
+    {
+        if (policy == STDOUT_DROP_NEWEST)
+        {
+            stats.dropped += n - space;
+            n = space;
+        }
+        else
+        {
+            // only the last STDOUT_BUF_SIZE bytes can be kept, make room for the rest by discarding the oldest data
+            if (n > STDOUT_BUF_SIZE)
+            {
+                stats.dropped += n - STDOUT_BUF_SIZE;
+                d += n - STDOUT_BUF_SIZE;
+                n = STDOUT_BUF_SIZE;
+            }
+            uint32_t discard = n - space;
+            stats.dropped += discard;
+            tail += discard;
+        }
+    }
+
+    // copy in up to two pieces (wrap around)
+    uint32_t ofs = head & (STDOUT_BUF_SIZE-1);
+    uint32_t n1 = STDOUT_BUF_SIZE - ofs;
+    if (n1 > n)
+        n1 = n;
+    memcpy(buf+ofs, d, n1);
+    memcpy(buf, d+n1, n-n1);
+    head += n;
+    return len;
+}
+
+
+int stdout_buf_drain(struct rpmsg_channel* ch)
+{
+    char msg[DATA_LEN_MAX];
+    uint32_t n = 0;
+
+    if ((ch == NULL) || (ch->state != CH_UP) || (ch->txq_len > 0))
+        return 0;
+
+    // tell the reader where output is missing
+    if (stats.dropped != dropped_reported)
+    {
+        n = snprintf(msg, sizeof(msg), "\n[stdout: %u bytes dropped]\n", (unsigned int)(stats.dropped - dropped_reported));
+        if (rpmsg_send_async(ch, msg, n, NULL, NULL) != RPMSG_OK)
+            return 0;
+        dropped_reported = stats.dropped;
+        stats.msgs++;
+        return 1;
+    }
+
+    n = head - tail;
+    if (n == 0)
+        return 0;
+    if (n > (DATA_LEN_MAX-1))
+        n = DATA_LEN_MAX-1;
+
+    // copy the chunk to a linear buffer, it might wrap around the end of the ring
+    uint32_t ofs = tail & (STDOUT_BUF_SIZE-1);
+    uint32_t n1 = STDOUT_BUF_SIZE - ofs;
+    if (n1 > n)
+        n1 = n;
+    memcpy(msg, buf+ofs, n1);
+    memcpy(msg+n1, buf, n-n1);
+
+    if (rpmsg_send_async(ch, msg, n, NULL, NULL) != RPMSG_OK)
+        return 0;
+    tail += n;
+    stats.sent += n;
+    stats.msgs++;
+    return 1;
+}
+
+
+uint32_t stdout_buf_pending(void)
+{
+    return head - tail;
+}
+
+
+void stdout_buf_get_stats(struct stdout_buf_stats* s)
+{
+    if (s != NULL)
+        memcpy(s, &stats, sizeof(*s));
+}
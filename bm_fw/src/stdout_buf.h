@@ -0,0 +1,104 @@
+/******************************************************************************************************************************
+*
+*   AMP Configuration Variable Management
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   stdout_buf.h
+*
+*   Non-blocking buffer for stdout: printf and friends write into a ring buffer which is sent to linux (bm_stdio
+*   channel) from the main loop. Writers never wait for a vring buffer, if the ring is full data is dropped according
+*   to the overflow policy and counted.
+*
+******************************************************************************************************************************/
+
+#ifndef __STDOUT_BUF_H__
+#define __STDOUT_BUF_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "remoteproc.h"
+
+
+/******************************************************************************************************************************
+*   C O N F I G
+*/
+
+// size of the ring buffer in bytes, must be a power of 2
+#ifndef STDOUT_BUF_SIZE
+#define STDOUT_BUF_SIZE         4096
+#endif
+
+#if (STDOUT_BUF_SIZE < 2) || ((STDOUT_BUF_SIZE & (STDOUT_BUF_SIZE-1)) != 0)
+#error STDOUT_BUF_SIZE must be a power of 2
+#endif
+
+// overflow policies: drop the new data which doesn't fit or overwrite the oldest data in the buffer
+#define STDOUT_DROP_NEWEST      0
+#define STDOUT_DROP_OLDEST      1
+
+// policy used after startup, see stdout_buf_set_policy()
+#ifndef STDOUT_BUF_POLICY
+#define STDOUT_BUF_POLICY       STDOUT_DROP_NEWEST
+#endif
+
+
+
+/******************************************************************************************************************************
+*   S T R U C T S
+*/
+
+struct stdout_buf_stats {
+    uint32_t written;       // bytes passed to stdout_buf_write
+    uint32_t sent;          // bytes sent to linux
+    uint32_t dropped;       // bytes lost because the buffer was full
+    uint32_t msgs;          // number of rpmsg messages used to send them
+};
+
+
+
+/******************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+// select the overflow policy (STDOUT_DROP_*)
+void stdout_buf_set_policy(int policy);
+
+// append len bytes to the buffer, never blocks. Returns len, data which doesn't fit is dropped (and counted).
+// This is not interrupt safe, it must be called from the same context as stdout_buf_drain (main loop, callbacks).
+size_t stdout_buf_write(const void* data, size_t len);
+
+// send buffered data on ch, has to be called periodically from the main loop. At most one message of up to
+// DATA_LEN_MAX-1 bytes is sent per call and only if ch has no messages waiting for a vring buffer, so stdout never
+// blocks the caller and takes at most one entry of the async send queue. Nothing is sent before the kernel driver
+// has connected to ch (CH_UP), we would not know its address.
+// returns 1 if data was sent (more might be pending), 0 otherwise
+int stdout_buf_drain(struct rpmsg_channel* ch);
+
+// number of bytes waiting to be sent
+uint32_t stdout_buf_pending(void);
+
+void stdout_buf_get_stats(struct stdout_buf_stats* s);
+
+#endif
@@ -0,0 +1,111 @@
+/******************************************************************************************************************************
+*
+*   AMP Configuration Variable Management
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   trace_buf.c
+*
+*   Circular log in a remoteproc trace buffer, see trace_buf.h
+*
+******************************************************************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xil_cache.h>
+#include <xpseudo_asm_gcc.h>
+
+#include "trace_buf.h"
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+static inline void flush_hdr(struct trace_buf* tb)
+{
+    Xil_DCacheFlushRange((unsigned int)tb->hdr, sizeof(*tb->hdr));
+}
+
+
+int trace_buf_init(struct trace_buf* tb, void* mem, uint32_t len)
+{
+    if ((mem == NULL) || (len <= (2*sizeof(struct trace_buf_hdr))))
+        return -1;
+
+    tb->data = mem;
+    tb->size = len - sizeof(struct trace_buf_hdr);
+    tb->hdr = (struct trace_buf_hdr*)(tb->data + tb->size);
+
+    memset(tb->data, 0, len);
+    tb->hdr->size = tb->size;
+    tb->hdr->magic = TRACE_BUF_MAGIC;
+    Xil_DCacheFlushRange((unsigned int)mem, len);
+    return 0;
+}
+
+
+size_t trace_buf_write(struct trace_buf* tb, const void* data, size_t len)
+{
+    struct trace_buf_hdr* hdr = tb->hdr;
+    const char* d = data;
+    uint32_t n = len;
+
+    if (hdr == NULL)
+        return 0;
+    uint32_t head = hdr->head + len;    // new head
+
+    // only the newest size bytes survive
+    if (n > tb->size)
+    {
+        d += n - tb->size;
+        n = tb->size;
+    }
+
+    // readers must see the odd sequence number before any data is overwritten
+    hdr->seq++;
+    flush_hdr(tb);
+    dsb();
+
+    // copy and flush in up to two pieces (wrap around)
+    uint32_t ofs = (head - n) % tb->size;
+    uint32_t n1 = tb->size - ofs;
+    if (n1 > n)
+        n1 = n;
+    memcpy(tb->data + ofs, d, n1);
+    Xil_DCacheFlushRange((unsigned int)(tb->data + ofs), n1);
+    if (n > n1)
+    {
+        memcpy(tb->data, d + n1, n - n1);
+        Xil_DCacheFlushRange((unsigned int)tb->data, n - n1);
+    }
+
+    hdr->head = head;
+    if ((head - hdr->tail) > tb->size)
+        hdr->tail = head - tb->size;
+    dsb();
+    hdr->seq++;
+    flush_hdr(tb);
+    return len;
+}
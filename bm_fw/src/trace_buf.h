@@ -0,0 +1,86 @@
+/******************************************************************************************************************************
+*
+*   AMP Configuration Variable Management
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   trace_buf.h
+*
+*   Circular log in a remoteproc trace buffer. The text area comes first, so linux' trace file (which shows the
+*   buffer up to the first \0) still shows the text, in order until the buffer wraps around. A header at the end
+*   tells the kernel module where the newest data is (see fw_trace in kernel_mod/cfg_mgmt_main.c).
+*
+******************************************************************************************************************************/
+
+#ifndef __TRACE_BUF_H__
+#define __TRACE_BUF_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/******************************************************************************************************************************
+*   C O N F I G
+*/
+
+// marks a valid header, in memory this is "\0TRC" so the header also terminates the text for linux' trace file
+#define TRACE_BUF_MAGIC         0x43525400
+
+
+
+/******************************************************************************************************************************
+*   S T R U C T S
+*/
+
+// header at the end of the trace buffer, this is read by the kernel module (struct fw_trace_hdr), keep it in sync
+// head and tail are free running byte counts, byte n is stored at offset n % size of the text area. A reader takes
+// seq, head and tail, copies the data and checks that seq is still the same (seq is odd while an update is running).
+struct trace_buf_hdr {
+    uint32_t magic;
+    uint32_t size;              // size of the text area in bytes
+    volatile uint32_t seq;
+    volatile uint32_t head;     // number of bytes written so far
+    volatile uint32_t tail;     // oldest byte which is still in the buffer
+    uint32_t reserved[3];       // pad to one cache line
+};
+
+struct trace_buf {
+    char* data;
+    struct trace_buf_hdr* hdr;
+    uint32_t size;
+};
+
+
+
+/******************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+// set up a trace buffer of len bytes at mem (the header is placed at the end), returns 0 on success
+int trace_buf_init(struct trace_buf* tb, void* mem, uint32_t len);
+
+// append len bytes, the oldest data is overwritten when the buffer is full
+// Only the written cache lines and the header are flushed. Returns len.
+size_t trace_buf_write(struct trace_buf* tb, const void* data, size_t len);
+
+#endif
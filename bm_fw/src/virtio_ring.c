@@ -18,6 +18,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include "virtio_ring.h"
 //#include "xil_printf.h"
 #include "xpseudo_asm_gcc.h"
@@ -43,18 +44,60 @@
  * optimization.  */
 #define VRING_AVAIL_F_NO_INTERRUPT	1
 
+/* L1 data cache line size of the Cortex-A9 */
+#define CACHE_LINE_LEN		32
+
 
 
 /******************************************************************************************************************************
 *   I M P L E M E N T A T I O N                                                                                              */
 
 
+// number of cache lines covered by len bytes at addr
+static inline uint32_t cache_lines(uint32_t addr, uint32_t len)
+{
+    return ((addr + len - 1) / CACHE_LINE_LEN) - (addr / CACHE_LINE_LEN) + 1;
+}
+
+// make data written to a ring visible to the other side and count the cache lines
+static inline void vring_flush(struct vring* vr, volatile void* p, uint32_t len)
+{
+    vr->cache_lines += cache_lines((uint32_t)p, len);
+    Xil_L1DCacheFlushRange((unsigned int)p, len);
+}
+
+
 // initialize a vring, all data structures have to be configured by the other side and are expected at physical address addr
 // vr: the vring to be intialized
 // notify: callback function wich gets called when we want to kick linux
-void vring_init(struct vring* vr, uint32_t addr, void (*notify)())
+// packed: use the packed layout (VIRTIO_RPMSG_F_PACKED has been negotiated), split layout otherwise
+void vring_init(struct vring* vr, uint32_t addr, void (*notify)(), int packed)
 {
-    fprintf(stderr, "vring_init: addr 0x%08x\n", (unsigned int)addr);
+    fprintf(stderr, "vring_init: addr 0x%08x%s\n", (unsigned int)addr, packed ? " (packed)" : "");
+    memset(vr, 0, sizeof(*vr));
+    vr->notify = notify;
+    vr->avail_tail = 0; // by convention head (kernel) and tail indices start at 0
+    vr->dbg_print = 0;
+
+    if (packed)
+    {
+        vr->packed = 1;
+        vr->pdesc = (void*)(addr);
+        addr += VRING_SIZE * sizeof(struct vring_packed_desc);
+        vr->driver_event = (void*)(addr);
+        addr += sizeof(struct vring_packed_desc_event);
+        vr->device_event = (void*)(addr);
+        vr->vring_len = VRING_SIZE * sizeof(struct vring_packed_desc) + 2*sizeof(struct vring_packed_desc_event);
+        // both wrap counters start at 1
+        vr->avail_wrap = 1;
+        vr->used_wrap = 1;
+        vr->used_head = 0;
+        vr->device_event->off_wrap = 0;
+        vr->device_event->flags = VRING_PACKED_EVENT_FLAG_ENABLE;  // we want to be kicked
+        vring_flush(vr, vr->device_event, sizeof(struct vring_packed_desc_event));
+        return;
+    }
+
     vr->desc = (void*)(addr);  // buffer descriptor heads are at the address assigned to us by the kernel
     addr += VRING_SIZE * sizeof(struct vring_desc);
     vr->avail = (void*)(addr); // available ring follows immediatly after descriptor heads
@@ -69,27 +112,113 @@ void vring_init(struct vring* vr, uint32_t addr, void (*notify)())
     vr->vring_len = addr+sizeof(struct vring_used) - (uint32_t)(vr->desc);
     // used section follows after padding (padding is inserted to prevent cache invalidations between the two cpus)
     vr->used = (void*)addr;
-    vr->notify = notify;
-    vr->avail_tail = 0; // by convention head (kernel) and tail indices start at 0
-    vr->dbg_print = 0;
     if (vr->dbg_print)
         fprintf(stderr, "%s: used flags before init: x%08x\n", __func__, (unsigned int)vr->used->flags);
     vr->used->flags = 0;    // make sure there no flags are set
+    vring_flush(vr, &(vr->used->flags), sizeof(vr->used->flags));
+}
+
+
+// get the address of the buffer with index idx (as returned by vring_get_buf)
+uint32_t vring_buf(struct vring* vr, uint16_t idx)
+{
+    if (vr->packed)
+        return vr->buf_addr[idx];
+    return vr->desc[idx].addr;
+}
+
+
+// get the length of the buffer with index idx as set up by linux
+uint32_t vring_buf_len(struct vring* vr, uint16_t idx)
+{
+    if (vr->packed)
+        return vr->buf_len[idx];
+    return vr->desc[idx].len;
+}
+
+
+// get the length of the next available buffer without consuming it, returns 0 if no buffer is available
+uint32_t vring_peek_len(struct vring* vr)
+{
+    if (!vring_available(vr))
+        return 0;
+    if (vr->packed)
+        return vr->pdesc[vr->avail_tail].len;
+    return vr->desc[vr->avail->ring[vr->avail_tail % VRING_SIZE] % VRING_SIZE].len;
+}
+
+
+// flush a data buffer after writing to it (the ring itself is flushed by vring_publish_buf)
+void vring_flush_buf(uint32_t addr, uint32_t len)
+{
+    Xil_L1DCacheFlushRange((unsigned int)addr, len);
+}
+
+
+// check if the descriptor at avail_tail has been made available by linux (packed layout)
+static inline int packed_desc_avail(struct vring* vr, uint16_t flags)
+{
+    int avail = (flags & VRING_PACKED_DESC_F_AVAIL) ? 1 : 0;
+    int used = (flags & VRING_PACKED_DESC_F_USED) ? 1 : 0;
+    return (avail == vr->avail_wrap) && (used != vr->avail_wrap);
+}
+
+static int32_t packed_get_buf(struct vring* vr)
+{
+    volatile struct vring_packed_desc* d = &(vr->pdesc[vr->avail_tail]);
+
+    vr->cache_lines += cache_lines((uint32_t)d, sizeof(*d));
+    if (!packed_desc_avail(vr, d->flags))
+    {
+        vr->empty++;
+        return -1;  // no buffer available
+    }
+
+    dsb();  // read flags before the rest of the descriptor
+    uint16_t id = d->id;
+    uint32_t addr = d->addr;
+    uint32_t len = d->len;
+
+    if (vr->dbg_print)
+        fprintf(stderr, "vring_get_buf: packed desc %d holds id %d\n", (int)vr->avail_tail, (int)id);
+
+    // consume the descriptor, toggle the wrap counter at the end of the ring
+    vr->avail_tail++;
+    if (vr->avail_tail >= VRING_SIZE)
+    {
+        vr->avail_tail = 0;
+        vr->avail_wrap ^= 1;
+    }
+
+    if (id >= VRING_SIZE)
+    {
+        fprintf(stderr, "vring_get_buf: id=%d is invalid (too big)\n", (int)id);
+        return -1;
+    }
+    vr->buf_addr[id] = addr;
+    vr->buf_len[id] = len;
+    return id;
 }
 
 
 // get the next buffer which was sent to us from the kernel.
 // returns the index of the available buffer descriptor (not the buffer itself) or -1 if none is available
+// use vring_buf() to get the buffer's address
 int32_t vring_get_buf(struct vring* vr)
 {
+    if (vr->packed)
+        return packed_get_buf(vr);
+
     // the available index in the vring struct is moved by the linux kernel
     // if it has advanced in front of us there is a buffer which we can use
     uint16_t krnl_avail_idx = vr->avail->avail_idx;
+    vr->cache_lines += cache_lines((uint32_t)&(vr->avail->avail_idx), sizeof(uint16_t));
 
     if (krnl_avail_idx == vr->avail_tail)
     {
         //if (vr->dbg_print)
         //    fprintf(stderr, "vring_get_buf: no buffer available\n");
+        vr->empty++;
         return -1;    // no buffer available
     }
 
@@ -102,6 +231,9 @@ int32_t vring_get_buf(struct vring* vr)
 
     // ok, lets see which buffer is indexed by the available ring at the given available ring's index
     uint16_t available_desc_ind = vr->avail->ring[a_index];
+    vr->cache_lines += cache_lines((uint32_t)&(vr->avail->ring[a_index]), sizeof(uint16_t));
+    // the descriptor is read by the caller (vring_buf)
+    vr->cache_lines += cache_lines((uint32_t)&(vr->desc[available_desc_ind % VRING_SIZE]), sizeof(struct vring_desc));
     if (vr->dbg_print)
         fprintf(stderr, "   desc nr %d is available.\n", (int)available_desc_ind);
 
@@ -112,6 +244,31 @@ int32_t vring_get_buf(struct vring* vr)
 }
 
 
+// return a buffer to linux (packed layout): the next descriptor in ring order is overwritten with the buffer's id
+static void packed_publish_buf(struct vring* vr, uint16_t idx, uint32_t len)
+{
+    volatile struct vring_packed_desc* d = &(vr->pdesc[vr->used_head]);
+
+    if (vr->dbg_print)
+        fprintf(stderr, "vring: publishing id %d in packed desc %d\n", (int)idx, (int)vr->used_head);
+
+    d->id = idx;
+    d->len = len;
+    // ensure id and len are visible before the descriptor is marked used
+    dsb();
+    d->flags = vr->used_wrap ? (VRING_PACKED_DESC_F_AVAIL | VRING_PACKED_DESC_F_USED) : 0;
+    dsb();
+    vring_flush(vr, d, sizeof(*d));
+
+    vr->used_head++;
+    if (vr->used_head >= VRING_SIZE)
+    {
+        vr->used_head = 0;
+        vr->used_wrap ^= 1;
+    }
+}
+
+
 // publish (pass to other side) the buffer described by vr->desc[idx]
 // this will render the buffer visible to the other side (linux kernel)
 // Note: The required index has to be obtained by rpmsg_get_buf()
@@ -119,21 +276,31 @@ int32_t vring_get_buf(struct vring* vr)
 // Linux will be kicked if kick is not 0
 void vring_publish_buf(struct vring* vr, uint16_t idx, uint32_t len, int kick)
 {
+    if (idx >= VRING_SIZE)
+    {
+        fprintf(stderr, "vring_publish_buf: idx=%d is invalid (too big)\n", (int)idx);
+        return;
+    }
+    vr->bufs++;
+
+    if (vr->packed)
+    {
+        packed_publish_buf(vr, idx, len);
+        if (kick != 0)
+            vring_kick(vr);
+        return;
+    }
+
     // load the index at which we will write to the used-ring
     uint16_t used_idx = vr->used->idx;
 
     // the indices are free running, limit it to array length
     used_idx = used_idx % VRING_SIZE;
 
-    if (idx > VRING_SIZE)
-    {
-        fprintf(stderr, "vring_publish_buf: idx=%d is invalid (too big)\n", (int)idx);
-        return;
-    }
-
     // make sure the kernel has not set any bogus flags
     vr->desc[idx].flags &= ~VRING_DESC_F_NEXT;
     vr->desc[idx].next = 0;
+    vring_flush(vr, &(vr->desc[idx]), sizeof(struct vring_desc));
 
     if (vr->dbg_print)
         fprintf(stderr, "vring: publishing desc %d within used ring entry %d\n", (int)idx, (int)used_idx);
@@ -144,13 +311,14 @@ void vring_publish_buf(struct vring* vr, uint16_t idx, uint32_t len, int kick)
     // ensure memory writes are ordered.
     dsb();
     //__asm__ __volatile__ ("dsb" ::: "memory");
+    vring_flush(vr, &(vr->used->ring[used_idx]), sizeof(struct vring_used_elem));
 
     // tell linux that we have placed something in the used ring
     vr->used->idx++;
 
     dsb();  // wait until the CPU has updated the memory
     // caches are disabled by MMU
-    Xil_L1DCacheFlush();    // make sure data arrives at the other end
+    vring_flush(vr, &(vr->used->idx), sizeof(vr->used->idx));    // make sure data arrives at the other end
 
     if (vr->dbg_print)
     {
@@ -158,15 +326,29 @@ void vring_publish_buf(struct vring* vr, uint16_t idx, uint32_t len, int kick)
     }
 
     // kick the kernel (linux) to make it aware of the new data
-    if ((kick != 0) && (vr->notify != 0))
+    if (kick != 0)
+        vring_kick(vr);
+}
+
+
+// kick the other side (linux) to make it aware of buffers published without kick
+void vring_kick(struct vring* vr)
+{
+    if (vr->notify == 0)
+        return;
+
+    if (vr->packed)
     {
-        if (vr->avail->flags & (1<<VRING_AVAIL_F_NO_INTERRUPT))
-        {
-            fprintf(stderr, "%s: no interrupt flag set\n", __func__);
+        if (vr->driver_event->flags == VRING_PACKED_EVENT_FLAG_DISABLE)
             return;
-        }
-        vr->notify();
     }
+    else if (vr->avail->flags & (1<<VRING_AVAIL_F_NO_INTERRUPT))
+    {
+        fprintf(stderr, "%s: no interrupt flag set\n", __func__);
+        return;
+    }
+    vr->kicks++;
+    vr->notify();
 }
 
 
@@ -174,6 +356,9 @@ void vring_publish_buf(struct vring* vr, uint16_t idx, uint32_t len, int kick)
 // returns 1 of there is at least one buffer, 0 otherwise
 int vring_available(struct vring* vr)
 {
+    if (vr->packed)
+        return packed_desc_avail(vr, vr->pdesc[vr->avail_tail].flags);
+
     if (vr->avail->avail_idx == vr->avail_tail)
         return 0;    // no buffer available
     return 1;
@@ -18,8 +18,15 @@
 /******************************************************************************************************************************
 *   C O N F I G                                                                                                              */
 
-// number of buffers in the vring, must match kernal and must be a power of 2 (this should probably not be define...)
+// number of buffers in the vring, must be a power of 2. This is announced to the kernel in the resource table
+// and checked against the kernel's setup by remoteproc_init(). Set by the Makefile (VRING_SIZE=...).
+#ifndef VRING_SIZE
 #define VRING_SIZE					256
+#endif
+
+#if (VRING_SIZE < 2) || ((VRING_SIZE & (VRING_SIZE-1)) != 0)
+#error VRING_SIZE must be a power of 2
+#endif
 
 
 
@@ -58,6 +65,30 @@ struct vring_avail {
     uint16_t used_event_idx;
 } __attribute__((packed));
 
+// packed ring (virtio 1.1) descriptor: 16 bytes. There are no separate avail and used rings, the state of a
+// descriptor is encoded in its flags (VRING_PACKED_DESC_F_AVAIL/USED) and both sides walk the same ring.
+struct vring_packed_desc {
+	uint32_t addr;      // Address (physical), written by linux
+	uint32_t addr_hi;   // unused (32 bit only)
+	uint32_t len;       // buffer length (avail) or number of bytes written (used)
+	uint16_t id;        // buffer id, returned by us when the buffer is used
+	uint16_t flags;
+} __attribute__((packed));
+
+// packed layout: descriptor state flags. A descriptor is available if AVAIL matches the wrap counter of the
+// reader and USED does not, it is used if both match the wrap counter.
+#define VRING_PACKED_DESC_F_AVAIL	(1<<7)
+#define VRING_PACKED_DESC_F_USED	(1<<15)
+// packed layout: event suppression flags
+#define VRING_PACKED_EVENT_FLAG_ENABLE	0
+#define VRING_PACKED_EVENT_FLAG_DISABLE	1
+
+// event suppression structure of the packed layout (one for each direction)
+struct vring_packed_desc_event {
+	uint16_t off_wrap;
+	uint16_t flags;
+} __attribute__((packed));
+
 
 // this struct is a complete description of a vring's resources.
 // It does _NOT_ reflect the memory layout which is required for correct operation
@@ -71,8 +102,20 @@ struct vring {
     // ring buffer baremetal->kernel
     volatile struct vring_used* used;
 
+    // packed layout (only used if packed is not 0, desc, avail and used are NULL in this case)
+    int packed;
+    volatile struct vring_packed_desc* pdesc;
+    volatile struct vring_packed_desc_event* driver_event;  // written by linux
+    volatile struct vring_packed_desc_event* device_event;  // written by us
+    uint16_t avail_wrap;    // wrap counter belonging to avail_tail
+    uint16_t used_head;     // position of the next used descriptor we write
+    uint16_t used_wrap;     // wrap counter belonging to used_head
+    // buffer address and length of each id, used descriptors are overwritten in place so we have to keep a copy
+    uint32_t buf_addr[VRING_SIZE];
+    uint32_t buf_len[VRING_SIZE];
+
     // private stuff which is used only by this code
-    uint16_t avail_tail;    // tail index of available ring buffer
+    uint16_t avail_tail;    // tail index of available ring buffer (packed: position in pdesc)
 
     uint16_t dbg_print;     // debug messages will be printed if this is not 0
 
@@ -81,6 +124,13 @@ struct vring {
 
     uint32_t vring_len;     // number of bytes occupied by memory shared with kernel (incl padding)
                             // this is needed for cache invalidation and is set in init functions
+
+    uint32_t cache_lines;   // number of ring cache lines read or written (statistics, payload is not counted)
+
+    // statistics (always on)
+    uint32_t bufs;          // number of buffers returned to linux
+    uint32_t kicks;         // number of interrupts sent to linux
+    uint32_t empty;         // number of vring_get_buf calls which found no buffer
 };
 
 
@@ -109,6 +159,14 @@ struct vring {
  *      __u16 avail_event_idx;
  * }; */
 
+/* The packed layout (negotiated by VIRTIO_RPMSG_F_PACKED) is a single ring of descriptors followed by the two event
+ * suppression structures:
+ *
+ *      struct vring_packed_desc desc[num];
+ *      struct vring_packed_desc_event driver;  // linux -> us
+ *      struct vring_packed_desc_event device;  // us -> linux
+ */
+
 
 
 
@@ -117,12 +175,22 @@ struct vring {
 
 // see C file for descriptions
 
-void vring_init(struct vring* vr, uint32_t addr, void (*notify)());
+void vring_init(struct vring* vr, uint32_t addr, void (*notify)(), int packed);
+
+uint32_t vring_buf(struct vring* vr, uint16_t idx);
+
+uint32_t vring_buf_len(struct vring* vr, uint16_t idx);
+
+uint32_t vring_peek_len(struct vring* vr);
+
+void vring_flush_buf(uint32_t addr, uint32_t len);
 
 int32_t vring_get_buf(struct vring* vr);
 
 void vring_publish_buf(struct vring* vr, uint16_t idx, uint32_t len, int kick);
 
+void vring_kick(struct vring* vr);
+
 int vring_available(struct vring* vr);
 
 
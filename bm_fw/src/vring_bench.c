@@ -0,0 +1,272 @@
+/******************************************************************************************************************************
+*
+*   RPMSG Implementation for Bare Metal Applications
+*
+*   (c) 2015
+*   Lukas Schrittwieser
+*
+*******************************************************************************************************************************
+*
+*   Loopback benchmark of the split and packed vring layouts
+*
+*   The kernel side (which posts buffers and collects used ones) is simulated by this file in local memory, the firmware
+*   side is the regular code in virtio_ring.c. For each layout the number of messages per second and the number of ring
+*   cache lines which the firmware side had to read or flush per message are printed. Payload is not counted as it is
+*   the same for both layouts.
+*
+*   The second part (sweep) sends typical workloads through a ring of the configured geometry (VRING_SIZE and
+*   PACKET_LEN_MAX), vring_sweep.sh builds one firmware per geometry to compare them.
+*
+*   This is only compiled if VRING_BENCH is defined (see Makefile), main() runs it before remoteproc is initialized.
+*
+******************************************************************************************************************************/
+
+#ifdef VRING_BENCH
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "xpseudo_asm_gcc.h"
+#include "xtime_l.h"
+#include "remoteproc_kernel.h"
+#include "virtio_ring.h"
+#include "vring_bench.h"
+
+
+/******************************************************************************************************************************
+*   G L O B A L S                                                                                                            */
+
+// ring memory, large enough for the split layout (which is the larger one due to the page alignment of the used ring)
+static uint8_t bench_ring[3*4096 + VRING_SIZE*sizeof(struct vring_used_elem)] __attribute__((aligned(4096)));
+
+// message buffers
+static uint8_t bench_bufs[VRING_SIZE][PACKET_LEN_MAX] __attribute__((aligned(32)));
+
+// payload source for the sweep
+static uint8_t bench_payload[RPMSG_FRAG_MSG_MAX];
+
+// workloads of the sweep
+static const struct bench_load {
+    const char* name;
+    uint32_t msg_len;   // payload bytes per message (fragmented if necessary)
+    uint32_t burst;     // messages sent before the kernel side catches up
+    uint32_t msgs;      // number of messages per run
+} bench_loads[] = {
+    { "rpc",  24,                   1,  VRING_BENCH_MSGS },      // config request/reply, header only
+    { "bulk", RPMSG_FRAG_MSG_MAX,   16, VRING_BENCH_MSGS / 16 }, // stdio/telemetry bursts
+};
+
+// state of the simulated kernel side
+static struct {
+    uint16_t avail_idx;     // split: free running avail index, packed: position of the next descriptor we post
+    uint16_t avail_wrap;
+    uint16_t used_idx;      // split: last used index seen, packed: position of the next used descriptor
+    uint16_t used_wrap;
+} drv;
+
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N                                                                                              */
+
+
+// kernel side: make buffer id available
+static void drv_post(struct vring* vr, uint16_t id)
+{
+    if (vr->packed)
+    {
+        volatile struct vring_packed_desc* d = &(vr->pdesc[drv.avail_idx]);
+        d->addr = (uint32_t)bench_bufs[id];
+        d->len = PACKET_LEN_MAX;
+        d->id = id;
+        dsb();
+        d->flags = drv.avail_wrap ? VRING_PACKED_DESC_F_AVAIL : VRING_PACKED_DESC_F_USED;
+        if (++drv.avail_idx >= VRING_SIZE)
+        {
+            drv.avail_idx = 0;
+            drv.avail_wrap ^= 1;
+        }
+        return;
+    }
+
+    vr->desc[id].addr = (uint32_t)bench_bufs[id];
+    vr->desc[id].len = PACKET_LEN_MAX;
+    vr->avail->ring[drv.avail_idx % VRING_SIZE] = id;
+    dsb();
+    drv.avail_idx++;
+    vr->avail->avail_idx = drv.avail_idx;
+}
+
+// kernel side: collect a used buffer, returns its id or -1
+static int32_t drv_collect(struct vring* vr)
+{
+    if (vr->packed)
+    {
+        volatile struct vring_packed_desc* d = &(vr->pdesc[drv.used_idx]);
+        uint16_t f = d->flags;
+        int avail = (f & VRING_PACKED_DESC_F_AVAIL) ? 1 : 0;
+        int used = (f & VRING_PACKED_DESC_F_USED) ? 1 : 0;
+        if ((avail != drv.used_wrap) || (used != drv.used_wrap))
+            return -1;
+        dsb();
+        if (++drv.used_idx >= VRING_SIZE)
+        {
+            drv.used_idx = 0;
+            drv.used_wrap ^= 1;
+        }
+        return d->id;
+    }
+
+    if (drv.used_idx == vr->used->idx)
+        return -1;
+    dsb();
+    return vr->used->ring[(drv.used_idx++) % VRING_SIZE].id;
+}
+
+
+// kernel side: collect all used buffers and make them available again, returns the number of buffers
+static int drv_recycle(struct vring* vr)
+{
+    int32_t id;
+    int n = 0;
+    while ((id = drv_collect(vr)) >= 0)
+    {
+        drv_post(vr, id);
+        n++;
+    }
+    return n;
+}
+
+
+// pass VRING_BENCH_MSGS messages through the ring, batch buffers are posted at once
+static void bench_run(int packed, int batch)
+{
+    struct vring vr;
+    XTime t0, t1;
+    uint32_t n = 0;
+
+    memset(bench_ring, 0, sizeof(bench_ring));
+    memset(&drv, 0, sizeof(drv));
+    drv.avail_wrap = 1;
+    drv.used_wrap = 1;
+    vring_init(&vr, (uint32_t)bench_ring, NULL, packed);
+    vr.cache_lines = 0;
+
+    XTime_GetTime(&t0);
+    while (n < VRING_BENCH_MSGS)
+    {
+        for (int i=0; i<batch; i++)
+            drv_post(&vr, i);
+
+        // this is what read_message() does with every buffer
+        int32_t id;
+        while ((id = vring_get_buf(&vr)) >= 0)
+        {
+            volatile struct rpmsg_hdr* hdr = (struct rpmsg_hdr*)vring_buf(&vr, id);
+            (void)hdr->len;
+            vring_publish_buf(&vr, id, PACKET_LEN_MAX, 0);
+            n++;
+        }
+
+        while (drv_collect(&vr) >= 0)
+            ;
+    }
+    XTime_GetTime(&t1);
+
+    uint32_t us = (uint32_t)((t1 - t0) / (COUNTS_PER_SECOND / 1000000));
+    if (us == 0)
+        us = 1;
+    uint32_t lines = (vr.cache_lines * 100) / n;
+    printf("vring bench %s batch %2d: %u msgs in %u us, %u msgs/s, %u.%02u cache lines/msg\n",
+        packed ? "packed" : "split ", batch, (unsigned int)n, (unsigned int)us,
+        (unsigned int)(((uint64_t)n * 1000000) / us), (unsigned int)(lines / 100), (unsigned int)(lines % 100));
+}
+
+
+// send a workload the way rpmsg_send does (fragments on a RPMSG_CH_F_FRAG channel)
+// the kernel side recycles buffers after each burst or when we run out of buffers (stall)
+static void bench_sweep(int packed, const struct bench_load* load)
+{
+    struct vring vr;
+    XTime t0, t1;
+    uint32_t n = 0;
+    uint32_t frags = 0;
+    uint32_t stalls = 0;
+
+    memset(bench_ring, 0, sizeof(bench_ring));
+    memset(&drv, 0, sizeof(drv));
+    drv.avail_wrap = 1;
+    drv.used_wrap = 1;
+    vring_init(&vr, (uint32_t)bench_ring, NULL, packed);
+    for (int i=0; i<VRING_SIZE; i++)
+        drv_post(&vr, i);
+
+    XTime_GetTime(&t0);
+    while (n < load->msgs)
+    {
+        for (int b=0; b<load->burst; b++, n++)
+        {
+            struct rpmsg_frag_hdr fh = { 0, 0, load->msg_len, 0 };
+            while (fh.offset < load->msg_len)
+            {
+                int32_t id;
+                while ((id = vring_get_buf(&vr)) < 0)
+                {
+                    stalls++;
+                    drv_recycle(&vr);
+                }
+                uint32_t l = load->msg_len - fh.offset;
+                if (l > FRAG_DATA_LEN_MAX)
+                    l = FRAG_DATA_LEN_MAX;
+                struct rpmsg_hdr* hdr = (struct rpmsg_hdr*)vring_buf(&vr, id);
+                hdr->len = sizeof(fh) + l;
+                memcpy(hdr->data, &fh, sizeof(fh));
+                memcpy(hdr->data + sizeof(fh), bench_payload + fh.offset, l);
+                vring_flush_buf((uint32_t)hdr, sizeof(*hdr) + hdr->len);
+                vring_publish_buf(&vr, id, PACKET_LEN_MAX, 0);
+                fh.offset += l;
+                frags++;
+            }
+        }
+        drv_recycle(&vr);
+    }
+    XTime_GetTime(&t1);
+
+    uint32_t us = (uint32_t)((t1 - t0) / (COUNTS_PER_SECOND / 1000000));
+    if (us == 0)
+        us = 1;
+    uint32_t fpm = (frags * 100) / n;
+    // payload bytes per byte of buffer memory passed through the ring
+    uint32_t eff = (uint32_t)(((uint64_t)n * load->msg_len * 100) / ((uint64_t)frags * PACKET_LEN_MAX));
+    printf("vring sweep ring %d buf %d %s %-4s: %u msgs/s, %u kB/s, %u.%02u frags/msg, %u stalls, %u%% buffer use\n",
+        VRING_SIZE, PACKET_LEN_MAX, packed ? "packed" : "split ", load->name,
+        (unsigned int)(((uint64_t)n * 1000000) / us),
+        (unsigned int)(((uint64_t)n * load->msg_len * 1000) / us / 1024),
+        (unsigned int)(fpm / 100), (unsigned int)(fpm % 100), (unsigned int)stalls, (unsigned int)eff);
+}
+
+
+// run the split and packed vring layouts side by side in a local loopback and print the results
+void vring_bench(void)
+{
+    const int batches[] = { 1, 8, VRING_BENCH_BATCH_MAX };
+
+    for (int i=0; i<(sizeof(batches)/sizeof(batches[0])); i++)
+    {
+        if (batches[i] > VRING_SIZE)
+            continue;
+        bench_run(0, batches[i]);
+        bench_run(1, batches[i]);
+    }
+
+    // shared memory used by the kernel for both vrings and their buffers
+    printf("vring sweep ring %d buf %d: %u kB shared memory\n", VRING_SIZE, PACKET_LEN_MAX,
+        (unsigned int)((2 * VRING_SIZE * (PACKET_LEN_MAX + sizeof(struct vring_desc) + sizeof(struct vring_used_elem) + 2)) / 1024));
+    for (int i=0; i<(sizeof(bench_loads)/sizeof(bench_loads[0])); i++)
+    {
+        bench_sweep(0, &bench_loads[i]);
+        bench_sweep(1, &bench_loads[i]);
+    }
+}
+
+#endif // VRING_BENCH
@@ -0,0 +1,38 @@
+/******************************************************************************************************************************
+*
+*   RPMSG Implementation for Bare Metal Applications
+*
+*   (c) 2015
+*   Lukas Schrittwieser
+*
+*******************************************************************************************************************************
+*
+*  Header for vring_bench.c
+*
+******************************************************************************************************************************/
+
+#ifndef __VRING_BENCH__
+#define __VRING_BENCH__
+
+
+/******************************************************************************************************************************
+*   C O N F I G                                                                                                              */
+
+// number of messages passed through the ring per run
+#ifndef VRING_BENCH_MSGS
+#define VRING_BENCH_MSGS            100000
+#endif
+
+// number of buffers the simulated kernel side posts before we process them
+#define VRING_BENCH_BATCH_MAX       32
+
+
+
+/******************************************************************************************************************************
+*   P R O T O T Y P E S                                                                                                      */
+
+// run the split and packed vring layouts side by side in a local loopback and print the results
+void vring_bench(void);
+
+
+#endif // __VRING_BENCH__
@@ -0,0 +1,21 @@
+#!/bin/sh
+#
+# Build one benchmark firmware per vring geometry (VRING_SIZE x PACKET_LEN_MAX).
+# Load them one after the other, the results of vring_bench.c are printed to the trace buffer:
+#   cat /sys/kernel/debug/remoteproc/remoteproc0/trace0 | grep vring
+#
+# Note: the stock kernel uses 512 byte buffers, firmwares with larger PACKET_LEN_MAX only run the benchmark.
+
+RING_SIZES="16 64 256"
+BUF_SIZES="128 256 512"
+OUT=sweep
+
+mkdir -p $OUT
+for r in $RING_SIZES; do
+    for b in $BUF_SIZES; do
+        make clean > /dev/null
+        make VRING_BENCH=1 VRING_SIZE=$r PACKET_LEN_MAX=$b FW_DEST=$OUT/bm_cfg_mgmt_r${r}_b${b} > /dev/null || exit 1
+        echo "built $OUT/bm_cfg_mgmt_r${r}_b${b}"
+    done
+done
+make clean > /dev/null
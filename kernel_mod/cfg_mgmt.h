@@ -0,0 +1,85 @@
+/***********************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*
+* (c) 2015 Lukas Schrittwieser (LS)
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 2 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program; if not, write to the Free Software
+*    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*    Or see <http://www.gnu.org/licenses/>
+*
+************************************************************************************************************************
+*
+* cfg_mgmt.h
+*
+* Kernel API of the cfg_mgmt module for other drivers: config variables of the firmware are accessed by index (see
+* cfg_mgmt_lookup) without going through debugfs. Values are transferred as numbers, there is no string conversion.
+*
+************************************************************************************************************************/
+
+#ifndef __CFG_MGMT__
+#define __CFG_MGMT__
+
+
+#include <linux/types.h>
+#include <linux/gfp.h>
+
+
+// completion callback of the asynchronous functions
+// It is called from interrupt context (rpmsg callback, timeout timer) and must not sleep, it may submit the next
+// request (with GFP_ATOMIC). err is 0 or a neg. error code: -EINVAL (unknown index), -ETIMEDOUT (no reply from the
+// firmware), -ENODEV (firmware gone) or -EIO. val is the value read (0 for writes).
+typedef void (*cfg_mgmt_cb_t)(void* priv, int err, s32 val);
+
+// one access of a batch
+struct cfg_mgmt_op {
+    int     index;      // variable index (cfg_mgmt_lookup)
+    bool    write;      // set val, otherwise read it
+    s32     val;        // value to be written or value read
+    int     err;        // result of this access, set on completion
+};
+
+
+// returns the index of the variable called name or -ENOENT. Loads the variable list from the firmware if that
+// hasn't been done yet (like reading the load_list file), so it may sleep. The index stays valid until the firmware
+// is restarted.
+int cfg_mgmt_lookup(const char* name);
+
+// returns the number of variables (valid indices are 0..n-1) or a neg. error code, may sleep like cfg_mgmt_lookup
+int cfg_mgmt_n_vars(void);
+
+// read or write the value of variable index, cb(priv, err, val) is called once the access is complete.
+// With GFP_ATOMIC these may be called from atomic context, the request is sent from a work item then.
+// returns 0 (cb will be called) or a neg. error code (cb is not called)
+int cfg_mgmt_get_async(int index, cfg_mgmt_cb_t cb, void* priv, gfp_t gfp);
+int cfg_mgmt_set_async(int index, s32 val, cfg_mgmt_cb_t cb, void* priv, gfp_t gfp);
+
+// read or write the value of variable index and wait for the result (sleeps, process context only)
+// returns 0 or a neg. error code
+int cfg_mgmt_get(int index, s32* val);
+int cfg_mgmt_set(int index, s32 val);
+
+// send the n accesses of ops in order, cb(priv, err, 0) is called when all are complete. n is not limited, up to
+// BATCH_DEPTH (cfg_mgmt_api.c) accesses are in flight at once and the next one is sent when one completes (also with
+// GFP_ATOMIC). err is 0 if all accesses succeeded, otherwise the error of the first failed one, the result of each
+// access is in its err field. ops must stay valid until cb is called.
+// returns 0 (cb will be called) or a neg. error code (cb is not called, no access could be sent)
+int cfg_mgmt_batch_async(struct cfg_mgmt_op* ops, int n, cfg_mgmt_cb_t cb, void* priv, gfp_t gfp);
+
+// like cfg_mgmt_batch_async, waits until all accesses are complete (sleeps). The err field of all ops is set, also if
+// the batch could not be sent. A fatal signal ends the wait, accesses which are not complete have -EINTR then.
+// returns 0 if all accesses succeeded, -EINTR or the error of the first failed one
+int cfg_mgmt_batch(struct cfg_mgmt_op* ops, int n);
+
+#endif
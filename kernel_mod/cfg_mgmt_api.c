@@ -0,0 +1,395 @@
+/***********************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*
+* (c) 2015 Lukas Schrittwieser (LS)
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 2 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program; if not, write to the Free Software
+*    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*    Or see <http://www.gnu.org/licenses/>
+*
+************************************************************************************************************************
+*
+* cfg_mgmt_api.c
+*
+* Kernel API for other drivers (cfg_mgmt.h), on top of rpmsg_link_submit. The synchronous and batch functions are
+* built from the asynchronous ones.
+*
+************************************************************************************************************************/
+
+//#define DEBUG
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/spinlock.h>
+#include <linux/err.h>
+#include <linux/rpmsg.h>
+
+#include "cfg_mgmt.h"
+#include "rpmsg_link.h"
+#include "var_cache.h"
+
+
+// number of accesses of a batch which are sent to the firmware at once, the next one is sent when one completes. This
+// keeps large batches from using up the pending slots of the link (shared with all other users).
+#define BATCH_DEPTH         16
+
+
+
+/************************************************************************************************************************
+*   T Y P E S
+*/
+
+// state of a batch, freed when the last access is complete and cfg_mgmt_batch doesn't use it any more
+struct batch {
+    struct cfg_mgmt_op* ops;
+    int         n;
+    atomic_t    remaining;      // accesses not complete yet (+1 while the first ones are submitted)
+    atomic_t    refs;           // the accesses (1 for all) and cfg_mgmt_batch while it waits
+    spinlock_t  lock;           // protects next, in_flight, err, detached and the results in ops
+    int         next;           // index of the next access to send
+    int         in_flight;      // accesses sent and not complete yet, at most BATCH_DEPTH
+    bool        filling;        // a context is sending accesses (batch_fill)
+    int         err;            // first error
+    bool        detached;       // the owner gave up (signal), ops and priv must not be used any more
+    cfg_mgmt_cb_t cb;
+    void*       priv;
+};
+
+// a pending access of a batch
+struct batch_op {
+    struct batch*   b;
+    struct cfg_mgmt_op* op;
+};
+
+// result of a synchronous access
+struct sync_wait {
+    struct completion done;
+    int     err;
+    s32     val;
+};
+
+
+
+/************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+// load the variable list, cfg_mgmt_main.c
+int cfg_mgmt_load_vars(void);
+
+static struct batch* batch_submit(struct cfg_mgmt_op* ops, int n, cfg_mgmt_cb_t cb, void* priv, gfp_t gfp, bool hold);
+
+static int batch_fill(struct batch* b, gfp_t gfp);
+
+
+
+/************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+int cfg_mgmt_lookup(const char* name)
+{
+    int ret;
+
+    ret = var_cache_lookup(name);
+    if (ret != -ENOENT)
+        return ret;
+    // the names are kept in the cache once the list is loaded
+    ret = cfg_mgmt_load_vars();
+    if (ret)
+        return ret;
+    return var_cache_lookup(name);
+}
+EXPORT_SYMBOL_GPL(cfg_mgmt_lookup);
+
+
+int cfg_mgmt_n_vars(void)
+{
+    int ret;
+
+    ret = cfg_mgmt_load_vars();
+    if (ret)
+        return ret;
+    return var_cache_size();
+}
+EXPORT_SYMBOL_GPL(cfg_mgmt_n_vars);
+
+
+int cfg_mgmt_get_async(int index, cfg_mgmt_cb_t cb, void* priv, gfp_t gfp)
+{
+    return rpmsg_link_submit(index, ACC_VAL, false, 0, cb, priv, gfp);
+}
+EXPORT_SYMBOL_GPL(cfg_mgmt_get_async);
+
+
+int cfg_mgmt_set_async(int index, s32 val, cfg_mgmt_cb_t cb, void* priv, gfp_t gfp)
+{
+    return rpmsg_link_submit(index, ACC_VAL, true, val, cb, priv, gfp);
+}
+EXPORT_SYMBOL_GPL(cfg_mgmt_set_async);
+
+
+// completion callback of the synchronous functions, called with the batch lock held for cfg_mgmt_batch
+static void sync_done(void* priv, int err, s32 val)
+{
+    struct sync_wait* w = priv;
+
+    w->err = err;
+    w->val = val;
+    complete(&w->done);
+}
+
+
+// every access completes (reply, timeout or -ENODEV), so the wait is not interruptible and w can live on the stack
+int cfg_mgmt_get(int index, s32* val)
+{
+    struct sync_wait w;
+    int ret;
+
+    init_completion(&w.done);
+    ret = cfg_mgmt_get_async(index, sync_done, &w, GFP_KERNEL);
+    if (ret)
+        return ret;
+    wait_for_completion(&w.done);
+    if (!w.err)
+        *val = w.val;
+    return w.err;
+}
+EXPORT_SYMBOL_GPL(cfg_mgmt_get);
+
+
+int cfg_mgmt_set(int index, s32 val)
+{
+    struct sync_wait w;
+    int ret;
+
+    init_completion(&w.done);
+    ret = cfg_mgmt_set_async(index, val, sync_done, &w, GFP_KERNEL);
+    if (ret)
+        return ret;
+    wait_for_completion(&w.done);
+    return w.err;
+}
+EXPORT_SYMBOL_GPL(cfg_mgmt_set);
+
+
+static void batch_unref(struct batch* b)
+{
+    if (atomic_dec_and_test(&b->refs))
+        kfree(b);
+}
+
+
+// one access of b is complete, the last one completes the batch
+static void batch_put(struct batch* b)
+{
+    unsigned long flags;
+
+    if (!atomic_dec_and_test(&b->remaining))
+        return;
+    spin_lock_irqsave(&b->lock, flags);
+    if (!b->detached)
+        b->cb(b->priv, b->err, 0);
+    spin_unlock_irqrestore(&b->lock, flags);
+    batch_unref(b);
+}
+
+
+// record the error of an access, the first one is the result of the batch
+static void batch_set_err(struct batch* b, struct cfg_mgmt_op* op, int err, s32 val)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&b->lock, flags);
+    if (!b->detached) {
+        op->err = err;
+        if (!err && !op->write)
+            op->val = val;
+    }
+    if (err && !b->err)
+        b->err = err;
+    spin_unlock_irqrestore(&b->lock, flags);
+}
+
+
+// completion of an access (atomic context): send the next one, the completed access keeps b alive until batch_put
+static void batch_op_done(void* priv, int err, s32 val)
+{
+    struct batch_op* bo = priv;
+    struct batch* b = bo->b;
+    unsigned long flags;
+
+    batch_set_err(b, bo->op, err, val);
+    kfree(bo);
+    spin_lock_irqsave(&b->lock, flags);
+    b->in_flight--;
+    spin_unlock_irqrestore(&b->lock, flags);
+    batch_fill(b, GFP_ATOMIC);
+    batch_put(b);
+}
+
+
+// send accesses of b in order until BATCH_DEPTH are in flight or all were sent. An access which can't be sent is
+// complete with an error, the batch continues. If the owner has detached the accesses which were not sent yet are
+// dropped. Only one context sends at a time (filling), so the accesses go out in order, the others leave the free
+// slots to it. The caller has to keep b alive (an access which is not complete).
+// returns the number of accesses sent
+static int batch_fill(struct batch* b, gfp_t gfp)
+{
+    struct batch_op* bo;
+    struct cfg_mgmt_op op;
+    unsigned long flags;
+    int i, ret, sent = 0;
+
+    spin_lock_irqsave(&b->lock, flags);
+    if (b->filling) {
+        spin_unlock_irqrestore(&b->lock, flags);
+        return 0;
+    }
+    b->filling = true;
+    while (1) {
+        if (b->detached && (b->next < b->n)) {
+            // ops must not be read any more, complete the remaining accesses without sending them
+            i = b->n - b->next;
+            b->next = b->n;
+            b->filling = false;
+            spin_unlock_irqrestore(&b->lock, flags);
+            while (i--)
+                batch_put(b);
+            return sent;
+        }
+        if ((b->in_flight >= BATCH_DEPTH) || (b->next >= b->n))
+            break;
+        i = b->next++;
+        b->in_flight++;
+        op = b->ops[i];
+        spin_unlock_irqrestore(&b->lock, flags);
+
+        bo = kmalloc(sizeof(*bo), gfp);
+        ret = -ENOMEM;
+        if (bo) {
+            bo->b = b;
+            bo->op = &b->ops[i];
+            ret = rpmsg_link_submit(op.index, ACC_VAL, op.write, op.val, batch_op_done, bo, gfp);
+        }
+        if (ret) {
+            kfree(bo);
+            batch_set_err(b, &b->ops[i], ret, 0);
+            spin_lock_irqsave(&b->lock, flags);
+            b->in_flight--;
+            spin_unlock_irqrestore(&b->lock, flags);
+            batch_put(b);   // the +1 of batch_submit or the access of the caller is still there
+        } else {
+            sent++;
+        }
+        spin_lock_irqsave(&b->lock, flags);
+    }
+    b->filling = false;
+    spin_unlock_irqrestore(&b->lock, flags);
+    return sent;
+}
+
+
+int cfg_mgmt_batch_async(struct cfg_mgmt_op* ops, int n, cfg_mgmt_cb_t cb, void* priv, gfp_t gfp)
+{
+    struct batch* b = batch_submit(ops, n, cb, priv, gfp, false);
+
+    return IS_ERR(b) ? PTR_ERR(b) : 0;
+}
+EXPORT_SYMBOL_GPL(cfg_mgmt_batch_async);
+
+
+// start a batch: the first BATCH_DEPTH accesses are sent, the others as earlier ones complete. The err field of each
+// op is -EINPROGRESS until it is complete.
+// hold: the caller keeps a reference to the batch (batch_unref), it may detach from it
+// returns the batch or an ERR_PTR if nothing was sent
+static struct batch* batch_submit(struct cfg_mgmt_op* ops, int n, cfg_mgmt_cb_t cb, void* priv, gfp_t gfp, bool hold)
+{
+    struct batch* b;
+    int i;
+
+    if ((n <= 0) || !cb)
+        return ERR_PTR(-EINVAL);
+    b = kmalloc(sizeof(*b), gfp);
+    if (!b)
+        return ERR_PTR(-ENOMEM);
+    b->ops = ops;
+    b->n = n;
+    b->next = 0;
+    b->in_flight = 0;
+    b->filling = false;
+    b->err = 0;
+    b->detached = false;
+    b->cb = cb;
+    b->priv = priv;
+    spin_lock_init(&b->lock);
+    // the extra reference keeps the batch from completing while we still submit
+    atomic_set(&b->remaining, n+1);
+    atomic_set(&b->refs, hold ? 2 : 1);
+    for (i=0; i<n; i++)
+        ops[i].err = -EINPROGRESS;
+
+    if (!batch_fill(b, gfp)) {
+        // no access could be sent (e.g. the link is down), so all of them failed and nothing refers to b: report the
+        // first error to the caller instead of calling cb
+        i = b->err;
+        kfree(b);
+        return ERR_PTR(i);
+    }
+    batch_put(b);
+    return b;
+}
+
+
+// the wait can be interrupted by a fatal signal (a dead firmware takes timeout_ms * (retries+1) per access): the
+// batch is detached then, the accesses which were sent complete in the background without touching ops or w
+int cfg_mgmt_batch(struct cfg_mgmt_op* ops, int n)
+{
+    struct sync_wait w;
+    struct batch* b;
+    unsigned long flags;
+    int i, ret;
+
+    init_completion(&w.done);
+    b = batch_submit(ops, n, sync_done, &w, GFP_KERNEL, true);
+    if (IS_ERR(b)) {
+        for (i=0; i<n; i++)
+            ops[i].err = PTR_ERR(b);
+        return PTR_ERR(b);
+    }
+    if (!wait_for_completion_killable(&w.done)) {
+        batch_unref(b);
+        return w.err;
+    }
+
+    spin_lock_irqsave(&b->lock, flags);
+    if (!completion_done(&w.done)) {
+        b->detached = true;
+        for (i=0; i<n; i++) {
+            if (ops[i].err == -EINPROGRESS)
+                ops[i].err = -EINTR;
+        }
+        ret = -EINTR;
+    } else {
+        ret = w.err;    // completed just now
+    }
+    spin_unlock_irqrestore(&b->lock, flags);
+    batch_unref(b);
+    return ret;
+}
+EXPORT_SYMBOL_GPL(cfg_mgmt_batch);
@@ -0,0 +1,198 @@
+/***********************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*
+* (c) 2015 Lukas Schrittwieser (LS)
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 2 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program; if not, write to the Free Software
+*    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*    Or see <http://www.gnu.org/licenses/>
+*
+************************************************************************************************************************
+*
+* cfg_mgmt_dev.c
+*
+* Character device /dev/cfg_mgmt: binary access to the config variables for user space (cfg_mgmt_ioctl.h), one ioctl
+* transfers a whole batch of values without text conversion and file operations per value. Mapping the device gives
+* a snapshot of all values (cfg_mgmt_snap.c).
+*
+************************************************************************************************************************/
+
+//#define DEBUG
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <asm/uaccess.h>
+
+#include "cfg_mgmt.h"
+#include "cfg_mgmt_ioctl.h"
+
+
+// number of accesses of a batch which are sent to the firmware at once, this leaves pending slots (PENDING_SLOTS in
+// rpmsg_link.c) for other users
+#define DEV_CHUNK       64
+
+
+
+/************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+static long dev_ioctl(struct file* filp, unsigned int cmd, unsigned long arg);
+
+static long dev_batch(struct cfg_mgmt_io_batch __user* arg);
+
+// cfg_mgmt_snap.c
+int cfg_mgmt_snap_init(void);
+int cfg_mgmt_snap_mmap(struct file* filp, struct vm_area_struct* vma);
+void cfg_mgmt_snap_exit(void);
+
+
+
+/************************************************************************************************************************
+*   G L O B A L S
+*/
+
+static struct file_operations fops_dev = {
+    .owner          = THIS_MODULE,
+    .unlocked_ioctl = &dev_ioctl,
+    .compat_ioctl   = &dev_ioctl,   // same layout for 32 and 64 bit
+    .mmap           = &cfg_mgmt_snap_mmap,
+};
+
+
+
+/************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+// register the device number, the device is usable as soon as the firmware has connected
+int cfg_mgmt_dev_init(void)
+{
+    int ret;
+
+    ret = cfg_mgmt_snap_init();
+    if (ret)
+        return ret;
+    ret = register_chrdev(CFG_MGMT_MAJOR, "cfg_mgmt", &fops_dev);
+    if (ret < 0) {
+        printk(KERN_ERR "CFG_MGMT %s: can't register major %d: %d\n", __func__, CFG_MGMT_MAJOR, ret);
+        cfg_mgmt_snap_exit();
+    }
+    return ret;
+}
+
+
+void cfg_mgmt_dev_exit(void)
+{
+    unregister_chrdev(CFG_MGMT_MAJOR, "cfg_mgmt");
+    cfg_mgmt_snap_exit();
+}
+
+
+static long dev_ioctl(struct file* filp, unsigned int cmd, unsigned long arg)
+{
+    struct cfg_mgmt_io_lookup lu;
+
+    switch (cmd) {
+    case CFG_MGMT_IOC_N_VARS:
+        return cfg_mgmt_n_vars();
+
+    case CFG_MGMT_IOC_LOOKUP:
+        if (copy_from_user(&lu, (void __user*)arg, sizeof(lu)))
+            return -EFAULT;
+        lu.name[sizeof(lu.name)-1] = '\0';
+        lu.index = cfg_mgmt_lookup(lu.name);
+        if (lu.index < 0)
+            return lu.index;
+        if (copy_to_user((void __user*)arg, &lu, sizeof(lu)))
+            return -EFAULT;
+        return 0;
+
+    case CFG_MGMT_IOC_BATCH:
+        return dev_batch((struct cfg_mgmt_io_batch __user*)arg);
+
+    default:
+        return -ENOTTY;
+    }
+}
+
+
+// execute a batch of accesses, DEV_CHUNK of them are in flight at once. If a chunk fails because the firmware
+// doesn't answer, the channel is gone or the process got a fatal signal the remaining accesses are not sent, their
+// status is the same error.
+static long dev_batch(struct cfg_mgmt_io_batch __user* arg)
+{
+    struct cfg_mgmt_io_batch b;
+    struct cfg_mgmt_io_op* io;
+    struct cfg_mgmt_op* ops;
+    long ret = 0;
+    int i, k, m, err = 0;
+
+    if (copy_from_user(&b, arg, sizeof(b)))
+        return -EFAULT;
+    if ((b.n == 0) || (b.n > CFG_MGMT_IO_MAX) || b.flags)
+        return -EINVAL;
+
+    io = kmalloc(b.n * sizeof(*io), GFP_KERNEL);
+    ops = kmalloc(DEV_CHUNK * sizeof(*ops), GFP_KERNEL);
+    if (!io || !ops) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    if (copy_from_user(io, (void __user*)(uintptr_t)b.ops, b.n * sizeof(*io))) {
+        ret = -EFAULT;
+        goto out;
+    }
+    for (i=0; i<b.n; i++) {
+        if ((io[i].op != CFG_MGMT_OP_GET) && (io[i].op != CFG_MGMT_OP_SET)) {
+            ret = -EINVAL;
+            goto out;
+        }
+    }
+
+    for (i=0; i<b.n; i+=m) {
+        m = min_t(int, DEV_CHUNK, b.n - i);
+        for (k=0; k<m; k++) {
+            ops[k].index = io[i+k].index;
+            ops[k].write = (io[i+k].op == CFG_MGMT_OP_SET);
+            ops[k].val = io[i+k].value;
+            ops[k].err = 0;
+        }
+        // the result of each access is in its err field
+        err = cfg_mgmt_batch(ops, m);
+        for (k=0; k<m; k++) {
+            io[i+k].value = ops[k].val;
+            io[i+k].status = ops[k].err;
+        }
+        if ((err == -ETIMEDOUT) || (err == -ENODEV) || (err == -EINTR)) {
+            for (k=i+m; k<b.n; k++)
+                io[k].status = err;
+            break;
+        }
+    }
+    if (err == -EINTR) {
+        ret = -EINTR;   // a fatal signal, nobody reads the results
+        goto out;
+    }
+
+    if (copy_to_user((void __user*)(uintptr_t)b.ops, io, b.n * sizeof(*io)))
+        ret = -EFAULT;
+out:
+    kfree(ops);
+    kfree(io);
+    return ret;
+}
@@ -0,0 +1,110 @@
+/***********************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*
+* (c) 2015 Lukas Schrittwieser (LS)
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 2 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program; if not, write to the Free Software
+*    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*    Or see <http://www.gnu.org/licenses/>
+*
+************************************************************************************************************************
+*
+* cfg_mgmt_ioctl.h
+*
+* Interface of the /dev/cfg_mgmt character device, shared with user space (see tools/cfg_bench). Values are accessed
+* by index in batches: one ioctl sends all accesses to the firmware at once and returns all results.
+* The device can also be mapped (read only): it contains a snapshot of all values (struct cfg_mgmt_snap) which the
+* driver refreshes periodically while it is mapped, so monitoring tools can sample all values without syscalls.
+*
+************************************************************************************************************************/
+
+#ifndef __CFG_MGMT_IOCTL__
+#define __CFG_MGMT_IOCTL__
+
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+
+// device number of /dev/cfg_mgmt (create it with mknod /dev/cfg_mgmt c 243 0, see tools/scripts/load.sh)
+#define CFG_MGMT_MAJOR      243
+
+// max. number of accesses in one CFG_MGMT_IOC_BATCH call
+#define CFG_MGMT_IO_MAX     4096
+
+// access types (cfg_mgmt_io_op.op)
+#define CFG_MGMT_OP_GET     0
+#define CFG_MGMT_OP_SET     1
+
+// one access of a batch
+struct cfg_mgmt_io_op {
+    __s32   index;      // variable index (CFG_MGMT_IOC_LOOKUP)
+    __u32   op;         // CFG_MGMT_OP_*
+    __s32   value;      // value to be written or value read
+    __s32   status;     // 0 or neg. error code of this access (set by the driver)
+};
+
+struct cfg_mgmt_io_batch {
+    __u64   ops;        // pointer to an array of n struct cfg_mgmt_io_op
+    __u32   n;
+    __u32   flags;      // reserved, 0
+};
+
+struct cfg_mgmt_io_lookup {
+    char    name[64];   // variable name (\0 terminated)
+    __s32   index;      // set by the driver
+};
+
+// one value of the snapshot
+struct cfg_mgmt_snap_val {
+    __s32   value;
+    __u32   gen;        // snapshot in which the value was read (0: never), it is older if the last read failed
+};
+
+// layout of the mapped snapshot, map sizeof(struct cfg_mgmt_snap) + n_vars*sizeof(struct cfg_mgmt_snap_val) bytes
+// (rounded up to the page size) at offset 0. The driver updates it like a seqcount: seq is odd while it writes. Readers copy what
+// they need and retry if seq was odd or changed meanwhile:
+//   do {
+//       s = load_acquire(&snap->seq);
+//       copy values
+//   } while ((s & 1) || (acquire fence, snap->seq != s));
+struct cfg_mgmt_snap {
+    __u32   seq;        // odd while the snapshot is updated
+    __u32   gen;        // number of the snapshot, incremented with each update (0: no snapshot yet)
+    __u32   n_vars;     // number of values
+    __u32   errors;     // values which could not be read for this snapshot, they keep their previous value
+    __u32   flags;      // CFG_MGMT_SNAP_*
+    __u32   reserved;
+    __u64   time_ns;    // time of the snapshot (CLOCK_MONOTONIC)
+    struct cfg_mgmt_snap_val values[];  // current values by variable index
+};
+
+// the channel was removed (firmware restart), the snapshot is not updated any more. Map the device again to get the
+// snapshot of the new session (its number of variables may differ).
+#define CFG_MGMT_SNAP_GONE  1
+
+
+#define CFG_MGMT_IOC_MAGIC  0xcf
+
+// returns the number of variables (ioctl return value), loads the variable list if necessary
+#define CFG_MGMT_IOC_N_VARS     _IO(CFG_MGMT_IOC_MAGIC, 1)
+// look up the index of a variable by name, fails with ENOENT if there is none
+#define CFG_MGMT_IOC_LOOKUP     _IOWR(CFG_MGMT_IOC_MAGIC, 2, struct cfg_mgmt_io_lookup)
+// execute n accesses, the results are in the value and status fields of the ops. The ioctl fails only if the batch
+// is invalid (EINVAL, EFAULT), failed accesses are reported by their status. After a timeout or if the firmware is
+// gone (ETIMEDOUT, ENODEV) the remaining accesses are not sent and have the same status.
+#define CFG_MGMT_IOC_BATCH      _IOWR(CFG_MGMT_IOC_MAGIC, 3, struct cfg_mgmt_io_batch)
+
+#endif
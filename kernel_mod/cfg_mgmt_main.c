@@ -43,13 +43,33 @@
 #include <linux/rpmsg.h>
 #include <linux/string.h>
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/mutex.h>
 #include <linux/poll.h>
+#include <linux/delay.h>
+#include <linux/vmalloc.h>
+#include <linux/virtio.h>
+#include <linux/remoteproc.h>
 
 #include "rpmsg_link.h"
+#include "var_cache.h"
 
 #define DRIVER_AUTHOR "Lukas Schrittwieser"
 #define DRIVER_DESC   "Driver for config variable management over an rpmsg link"
 
+// size of the text buffer of the fw_stats file (vrings and all channels of the firmware)
+#define STATS_BUF_SIZE      (8*IO_BUF_SIZE)
+
+// marks the header of the firmware's circular trace buffer, see bm_fw/src/trace_buf.h
+#define FW_TRACE_MAGIC      0x43525400
+// number of attempts to get a consistent copy of the trace buffer while the firmware writes to it
+#define FW_TRACE_RETRIES    100
+
+// number of requests of the table file which are sent to the firmware at once
+#define TABLE_DEPTH         16
+// names in the table file are truncated to this length (incl. \0)
+#define TABLE_NAME_LEN      64
+
 
 
 
@@ -64,6 +84,45 @@ struct var_access_info {
     access_t type;
 };
 
+// text read from the firmware when the fw_stats file is opened
+struct stats_buf {
+    size_t len;
+    char buf[STATS_BUF_SIZE];
+};
+
+// header at the end of the firmware's trace buffer (struct trace_buf_hdr in bm_fw/src/trace_buf.h)
+// head and tail are free running byte counts, seq is odd while the firmware updates the buffer
+struct fw_trace_hdr {
+    u32 magic;
+    u32 size;       // size of the text area in front of the header
+    u32 seq;
+    u32 head;
+    u32 tail;
+    u32 reserved[3];
+};
+
+// text copied from the trace buffer when the fw_trace file is opened
+struct trace_copy {
+    size_t len;
+    char buf[0];
+};
+
+// one line of the table file
+struct table_row {
+    char name[TABLE_NAME_LEN];  // empty if the name is unknown (the variable has no files either)
+    s32 val;
+    s32 min;
+    s32 max;
+    char* desc;
+    u8 valid;               // bit (1 << access_t) is set for each field which was read
+};
+
+// all variables, read when the table file is opened
+struct var_table {
+    int n;
+    struct table_row rows[0];
+};
+
 
 
 /******************************************************************************************************************
@@ -74,8 +133,16 @@ static int cfg_mgmt_probe(struct rpmsg_channel *rpdev);
 static void cfg_mgmt_remove(struct rpmsg_channel *rpdev);
 
 
+// character device, cfg_mgmt_dev.c
+int cfg_mgmt_dev_init(void);
+void cfg_mgmt_dev_exit(void);
+
+// mapped snapshot, cfg_mgmt_snap.c
+void cfg_mgmt_snap_reset(void);
+
 static int alloc_mem(int n_vars);
 static void free_mem(void);
+static void unload_vars(void);
 
 static int debugfs_open_var(struct inode *inod, struct file *filp);
 static ssize_t debugfs_read_var(struct file *filp, char *buff, size_t len, loff_t *off);
@@ -84,6 +151,26 @@ static int debugfs_release_var(struct inode *inod, struct file *filp);
 static unsigned int debugfs_poll(struct file *filp, struct poll_table_struct *poll_tbl);
 
 static int debugfs_open_ll(struct inode *inod, struct file *filp);
+static int load_vars(struct rpmsg_link_transaction* trans_p);
+
+static int debugfs_open_stats(struct inode *inod, struct file *filp);
+static ssize_t debugfs_read_stats(struct file *filp, char *buff, size_t len, loff_t *off);
+static int debugfs_release_stats(struct inode *inod, struct file *filp);
+
+static int debugfs_open_link_stats(struct inode *inod, struct file *filp);
+
+static int debugfs_open_trace(struct inode *inod, struct file *filp);
+static ssize_t debugfs_read_trace(struct file *filp, char *buff, size_t len, loff_t *off);
+static int debugfs_release_trace(struct inode *inod, struct file *filp);
+
+static int debugfs_open_table(struct inode *inod, struct file *filp);
+static int debugfs_release_table(struct inode *inod, struct file *filp);
+static int fetch_table(struct var_table* tbl, unsigned int max_age_ms);
+static void table_store(struct var_table* tbl, int index, access_t acc, struct rpmsg_link_transaction* t);
+static void* table_start(struct seq_file* s, loff_t* pos);
+static void* table_next(struct seq_file* s, void* v, loff_t* pos);
+static void table_stop(struct seq_file* s, void* v);
+static int table_show(struct seq_file* s, void* v);
 
 
 
@@ -110,9 +197,6 @@ static struct rpmsg_driver cfg_mgmt_rpmsg_drv = {
 
 struct rpmsg_channel* rpmsg_chnl;
 
-// wait queue used to block the user process
-wait_queue_head_t usr_wait_q;
-
 // DEBUGFS elements for exporting the variables
 // directories
 static struct dentry* cfg_mgmt_dir_p;
@@ -129,6 +213,18 @@ static struct var_access_info* min_access;
 static struct var_access_info* max_access;
 static struct var_access_info* desc_access;
 
+// set once the variable list is loaded completely (protected by load_lock)
+static bool vars_loaded;
+
+// serializes loading the variable list (load_list file and kernel API)
+static DEFINE_MUTEX(load_lock);
+
+// values read within this time are served from the cache, 0 disables caching of values (min, max and description
+// are always cached). A file opened with O_SYNC always reads the current value.
+static unsigned int cache_max_age_ms = 1000;
+module_param(cache_max_age_ms, uint, 0644);
+MODULE_PARM_DESC(cache_max_age_ms, "max. age of cached values (ms), 0: don't cache values");
+
 static struct file_operations fops_var = {
     .owner      = THIS_MODULE,
     .open       = &debugfs_open_var,
@@ -146,6 +242,50 @@ static struct file_operations fops_ll = {
 	.release    = &debugfs_release_var,
 };
 
+// file operations for the fw_stats file
+static struct file_operations fops_stats = {
+    .owner      = THIS_MODULE,
+    .open       = &debugfs_open_stats,
+    .read       = &debugfs_read_stats,
+	.release    = &debugfs_release_stats,
+};
+
+// file operations for the stats file, the text is generated by open
+static struct file_operations fops_link_stats = {
+    .owner      = THIS_MODULE,
+    .open       = &debugfs_open_link_stats,
+    .read       = &debugfs_read_stats,
+	.release    = &debugfs_release_stats,
+};
+
+// file operations for the fw_trace file
+static struct file_operations fops_trace = {
+    .owner      = THIS_MODULE,
+    .open       = &debugfs_open_trace,
+    .read       = &debugfs_read_trace,
+	.release    = &debugfs_release_trace,
+};
+
+// file operations for the table file, all values are read by open
+static struct file_operations fops_table = {
+    .owner      = THIS_MODULE,
+    .open       = &debugfs_open_table,
+    .read       = &seq_read,
+    .llseek     = &seq_lseek,
+	.release    = &debugfs_release_table,
+};
+
+static const struct seq_operations table_seq_ops = {
+    .start      = &table_start,
+    .next       = &table_next,
+    .stop       = &table_stop,
+    .show       = &table_show,
+};
+
+// the fields of a variable in the table file, in the order they are requested
+static const access_t table_acc[] = {ACC_VAL, ACC_MIN, ACC_MAX, ACC_DESC};
+#define TABLE_N_ACC     ARRAY_SIZE(table_acc)
+
 
 
 /******************************************************************************************************************
@@ -155,6 +295,8 @@ static struct file_operations fops_ll = {
 // init function, called upon module start
 static int __init cm_init(void)
 {
+    int ret;
+
 	printk(KERN_INFO "CFG_MGMT: Loading configuration variable managment module\n");
 
     cfg_mgmt_dir_p = NULL;
@@ -167,10 +309,16 @@ static int __init cm_init(void)
     max_access = NULL;
     desc_access = NULL;
 
-    init_waitqueue_head(&usr_wait_q);
+    // the character device is there before the firmware connects, it returns errors until then
+    ret = cfg_mgmt_dev_init();
+    if (ret < 0)
+        return ret;
 
     // register as rpmsg driver module, we will get probed once the other side establishes a connection
-	return register_rpmsg_driver(&cfg_mgmt_rpmsg_drv);
+	ret = register_rpmsg_driver(&cfg_mgmt_rpmsg_drv);
+    if (ret)
+        cfg_mgmt_dev_exit();
+    return ret;
 }
 
 // when a file is opened query the current value and print it into a string buffer
@@ -190,17 +338,39 @@ static int debugfs_open_var(struct inode *inod, struct file *filp)
 
     dev_dbg(&rpmsg_chnl->dev, "%s: using transaction struct at 0x%08x\n", __func__, (u32)trans_p);
 
-    // store a pointer to this buffer in the file structure where read/write functions can use it
+    // store a pointer to this buffer in the file structure where read/write functions can use it. The file may stay
+    // open after the channel was removed and acc_p freed, so release takes index and type from the transaction.
     filp->private_data = (void*)trans_p;
+    trans_p->file_index = acc_p->index;
+    trans_p->file_acc = acc_p->type;
 
     // if the file is opened for reading query the according variable
     if (filp->f_mode & FMODE_READ) {
         trans_p->rnw = true;
+        // try the cache first, descriptions need a full size buffer
+        if (acc_p->type == ACC_DESC) {
+            ret = rpmsg_link_trans_buf(trans_p);
+            if (ret) {
+                rpmsg_link_return_trans(trans_p);
+                filp->private_data = NULL;
+                return ret;
+            }
+        }
+        if (var_cache_get(acc_p->index, acc_p->type, trans_p, (filp->f_flags & O_SYNC) ? 0 : cache_max_age_ms)) {
+            trans_p->no_cache = true;   // don't store it again on release
+            return 0;
+        }
+        trans_p->cache_gen = var_cache_gen(acc_p->index);
         // query the value and print it to a local (kernel space) buffer
-        trans_p->wq = &usr_wait_q;
         ret = access_var(acc_p->index, acc_p->type, trans_p);
         if (!ret)
             return ret;
+        // no request was sent (all slots busy, channel going away or no memory), so no reply will come and read
+        // would wait forever. Fail the open instead.
+        dev_dbg(&rpmsg_chnl->dev, "%s: can't request index %d: %d\n", __func__, acc_p->index, ret);
+        rpmsg_link_return_trans(trans_p);
+        filp->private_data = NULL;
+        return ret;
     }
     if (filp->f_mode & FMODE_WRITE) {
         trans_p->rnw = false;
@@ -216,7 +386,8 @@ static ssize_t debugfs_read_var(struct file *filp, char *buff, size_t len, loff_
     // this contains the buffer and meta data for this variable access
     struct rpmsg_link_transaction* trans_p = filp->private_data;
 
-    dev_dbg(&rpmsg_chnl->dev, "%s: len %d, pos %lld\n", __func__, len, *ppos);
+    // the channel may be gone already (open files outlive it), so don't log with its device
+    pr_debug("CFG_MGMT %s: len %d, pos %lld\n", __func__, len, *ppos);
 
     if (!trans_p)
         return -EINVAL; // should never happen
@@ -229,20 +400,20 @@ static ssize_t debugfs_read_var(struct file *filp, char *buff, size_t len, loff_
             return -EAGAIN;
         }
         // blocking IO, wait until we have the data
-        ret = wait_event_interruptible(usr_wait_q, trans_p->valid);
-        if (ret) {	// abort in case we got interrupted
-            dev_err(&rpmsg_chnl->dev, "%s: interrupted\n", __func__);
+        ret = rpmsg_link_wait(trans_p);
+        if (ret) {	// abort in case we got interrupted or there is no reply
+            pr_debug("CFG_MGMT %s: no data: %d\n", __func__, ret);
             return ret;
         }
     }
 
     if (!trans_p->valid) {
-        dev_err(&rpmsg_chnl->dev, "%s: buffer invalid even after wait\n", __func__);
+        pr_err("CFG_MGMT %s: buffer invalid even after wait\n", __func__);
         return -EINVAL;
     }
 
     if (trans_p->err) {
-        dev_err(&rpmsg_chnl->dev, "%s: config var query failed: %d\n", __func__, trans_p->err);
+        pr_debug("CFG_MGMT %s: config var query failed: %d\n", __func__, trans_p->err);
         if (trans_p->err > 0)
             trans_p->err *= -1; // just to be sure it really is negative
         return trans_p->err;
@@ -254,15 +425,22 @@ static ssize_t debugfs_read_var(struct file *filp, char *buff, size_t len, loff_
 
 static ssize_t debugfs_write_var(struct file *filp, const char *buff, size_t len, loff_t *ppos)
 {
+    ssize_t ret;
     // this contains the buffer and meta data for this variable access
     struct rpmsg_link_transaction* trans_p = filp->private_data;
 
     if (!trans_p)
         return -EINVAL; // should never happen
 
-    dev_dbg(&rpmsg_chnl->dev, "%s: len %d, ppos %lld\n", __func__, len, *ppos);
+    pr_debug("CFG_MGMT %s: len %d, ppos %lld\n", __func__, len, *ppos);
     trans_p->dirty = true;    // buffer is now modified
-    return simple_write_to_buffer(trans_p->buf, IO_BUF_SIZE, ppos, (void*)buff, len);
+    // values are parsed as a string (access_var), keep space for the \0
+    ret = simple_write_to_buffer(trans_p->buf, trans_p->buf_size-1, ppos, (void*)buff, len);
+    if ((ret > 0) && (*ppos > trans_p->len)) {
+        trans_p->len = *ppos;
+        trans_p->buf[trans_p->len] = '\0';
+    }
+    return ret;
 }
 
 
@@ -271,38 +449,45 @@ static int debugfs_release_var(struct inode *inod, struct file *filp)
     int ret;
     // this contains the buffer and meta data for this variable access
     struct rpmsg_link_transaction* trans_p = filp->private_data;
-    struct var_access_info* acc_p = inod->i_private;
 
 	if (!trans_p)
         return -EINVAL; // should never happen
 
+    // index and type were copied at open (load_list has none), the inode data may be freed already
     // write the value back if the file was opened for writing
     if ((filp->f_mode&FMODE_WRITE) && (trans_p->dirty)) {
-        if (acc_p->type != ACC_VAL) {
-            dev_err(&rpmsg_chnl->dev, "%s: attempting to write anything other then variable value\n", __func__);
+        if ((trans_p->file_index < 0) || (trans_p->file_acc != ACC_VAL)) {
+            pr_err("CFG_MGMT %s: attempting to write anything other then variable value\n", __func__);
             rpmsg_link_return_trans(trans_p);
             return -EINVAL;
         }
 
-        // write the new value to the BM application
-        trans_p->wq = &usr_wait_q;
+        // write the new value to the BM application, fails with -ENODEV if the channel was removed
         trans_p->valid = false; // will be set once transfer is complete
-        ret = access_var(acc_p->index, acc_p->type, trans_p);
+        ret = access_var(trans_p->file_index, trans_p->file_acc, trans_p);
         if (ret) {
-            dev_err(&rpmsg_chnl->dev, "%s: can't set new value: %d\n", __func__, ret);
+            pr_err("CFG_MGMT %s: can't set new value: %d\n", __func__, ret);
             rpmsg_link_return_trans(trans_p);
             return ret;
         }
         // wait until data was written
-        ret = wait_event_interruptible(usr_wait_q, trans_p->valid);
-        if (ret) {	// abort in case we got interrupted
-            dev_err(&rpmsg_chnl->dev, "%s: interrupted\n", __func__);
+        ret = rpmsg_link_wait(trans_p);
+        if (ret) {	// abort in case we got interrupted or there is no reply
+            pr_err("CFG_MGMT %s: no reply: %d\n", __func__, ret);
+            rpmsg_link_return_trans(trans_p);
             return ret;
         }
+        // the firmware limits the value to min/max, read it again next time
+        var_cache_invalidate(trans_p->file_index);
         if (trans_p->err) {
-            dev_err(&rpmsg_chnl->dev, "%s: transaction error: %d\n", __func__, trans_p->err);
+            pr_err("CFG_MGMT %s: transaction error: %d\n", __func__, trans_p->err);
+            rpmsg_link_return_trans(trans_p);
             return -EFAULT;
         }
+    } else if ((filp->f_mode & FMODE_READ) && !(filp->f_mode & FMODE_WRITE) && (trans_p->file_index >= 0) &&
+        !rpmsg_link_trans_stale(trans_p)) {
+        // keep the reply (if it has arrived) for the next open, unless it came from a firmware which is gone
+        var_cache_put(trans_p->file_index, trans_p->file_acc, trans_p);
     }
     // return the transaction struct, it will be recycled to save memory allocs
     rpmsg_link_return_trans(trans_p);
@@ -315,9 +500,7 @@ static unsigned int debugfs_poll(struct file *filp, struct poll_table_struct *po
     struct rpmsg_link_transaction* trans_p = filp->private_data;
     unsigned int mask = 0;
 
-    dev_info(&rpmsg_chnl->dev, "%s: poll called, registering waitqueue\n", __func__);
-
-    poll_wait(filp, &usr_wait_q, poll_tbl);
+    poll_wait(filp, &trans_p->wq, poll_tbl);
     // if the buffer is already valid report back to the kernel that the access may happen immediately
     if (trans_p->valid) {
         if (trans_p->rnw)
@@ -333,12 +516,10 @@ static unsigned int debugfs_poll(struct file *filp, struct poll_table_struct *po
 // directories and files
 static int debugfs_open_ll(struct inode *inod, struct file *filp)
 {
-    int ret,i;
-    int n_vars;
-    struct device* dev = &rpmsg_chnl->dev;  // abbrevation
+    int ret;
     struct rpmsg_link_transaction* trans_p;  // this contains the buffer and meta data for this variable access
 
-    dev_dbg(dev, "%s: starting\n", __func__);
+    dev_dbg(&rpmsg_chnl->dev, "%s: starting\n", __func__);
 
     // get a transaction struct (either a recycled one or a new allocated one)
     trans_p = rpmsg_link_alloc_trans();
@@ -347,68 +528,111 @@ static int debugfs_open_ll(struct inode *inod, struct file *filp)
         return -ENOMEM;
     }
 
+    // variable names and error messages are read into this buffer
+    ret = rpmsg_link_trans_buf(trans_p);
+    if (ret) {
+        rpmsg_link_return_trans(trans_p);
+        return ret;
+    }
+
     // keep a pointer to the message buffer in the file pointer where the read function can access it
     // memory will be freed once the file is closed
     filp->private_data = (void*)trans_p;
 
-    if (val_access) {
+    if (vars_loaded) {
         // already initialized, we could re-init here? (not coded yet)
-        trans_p->len = scnprintf(trans_p->buf, IO_BUF_SIZE,
+        trans_p->len = scnprintf(trans_p->buf, trans_p->buf_size,
             "Variables list was already loaded, can't reload (unimplemented)\n");
-        trans_p->valid = true;
-        trans_p->rnw = true;
-        return 0;   // Note: return with success, the file is opened, user will read the error text
+    } else {
+        load_vars(trans_p);
+    }
+    trans_p->valid = true;
+    trans_p->rnw = true;
+    return 0;   // Note: return with success, the file is opened, user will read the error text
+}
+
+
+// load the variables of the firmware (if it wasn't done yet), may sleep. Used by the kernel API (cfg_mgmt_api.c).
+// returns 0 or a neg. error code
+int cfg_mgmt_load_vars(void)
+{
+    int ret;
+    struct rpmsg_link_transaction* trans_p;
+
+    if (!rpmsg_chnl)
+        return -ENODEV;
+    trans_p = rpmsg_link_alloc_trans();
+    if (!trans_p)
+        return -ENOMEM;
+    ret = rpmsg_link_trans_buf(trans_p);
+    if (!ret)
+        ret = load_vars(trans_p);
+    rpmsg_link_return_trans(trans_p);
+    return ret;
+}
+
+
+// get all variable names and create the debugfs directories and files, the names are kept in the cache for lookups
+// A status text is left in the buffer of trans_p (IO_BUF_SIZE), it is the content of the load_list file.
+// returns 0 or a neg. error code
+static int load_vars(struct rpmsg_link_transaction* trans_p)
+{
+    int ret,i;
+    int n_vars;
+    struct device* dev = &rpmsg_chnl->dev;  // abbrevation
+
+    // the list is loaded once, by the load_list file or the kernel API
+    mutex_lock(&load_lock);
+    if (vars_loaded) {
+        mutex_unlock(&load_lock);
+        trans_p->len = scnprintf(trans_p->buf, trans_p->buf_size, "ok\n");
+        return 0;
     }
 
     // query the number of variables and block until we have a result
-    n_vars = get_n_vars(&usr_wait_q);
+    n_vars = get_n_vars();
     dev_dbg(dev, "%s: n_vars is %d\n", __func__, n_vars);
 
 	if (n_vars <= 0) {
-        trans_p->len = scnprintf(trans_p->buf, IO_BUF_SIZE,
+        trans_p->len = scnprintf(trans_p->buf, trans_p->buf_size,
             "Can't query the number of configuration variables from BM firmware: %d\n", n_vars);
-        trans_p->valid = true;
-        trans_p->rnw = true;
-		return 0;	// nothing todo as there are no vars or we don't know how many there are
+        ret = (n_vars < 0) ? n_vars : -ENOENT;
+        goto out;	// nothing todo as there are no vars or we don't know how many there are
     }
 
     ret = alloc_mem(n_vars);  // get memory for global arrays
+    if (!ret)
+        ret = var_cache_init(n_vars);
     if (ret) {
-        trans_p->len = scnprintf(trans_p->buf, IO_BUF_SIZE,
+        trans_p->len = scnprintf(trans_p->buf, trans_p->buf_size,
             "Memory allocation failed: %d\n", ret);
-        trans_p->valid = true;
-        trans_p->rnw = true;
-        return 0;
+        goto out;
     }
 
 	// allocate directories
     val_dir_p = debugfs_create_dir("val", cfg_mgmt_dir_p);
     if (!val_dir_p) {
-        trans_p->len = scnprintf(trans_p->buf, IO_BUF_SIZE, "Can't create debugfs dir 'val' %d\n", ret);
-        trans_p->valid = true;
-        trans_p->rnw = true;
-        return 0;
+        trans_p->len = scnprintf(trans_p->buf, trans_p->buf_size, "Can't create debugfs dir 'val' %d\n", ret);
+        ret = -ENOMEM;
+        goto out;
     }
     min_dir_p = debugfs_create_dir("min", cfg_mgmt_dir_p);
     if (!min_dir_p) {
-        trans_p->len = scnprintf(trans_p->buf, IO_BUF_SIZE, "Can't create debugfs dir 'min' %d\n", ret);
-        trans_p->valid = true;
-        trans_p->rnw = true;
-        return 0;
+        trans_p->len = scnprintf(trans_p->buf, trans_p->buf_size, "Can't create debugfs dir 'min' %d\n", ret);
+        ret = -ENOMEM;
+        goto out;
     }
     max_dir_p = debugfs_create_dir("max", cfg_mgmt_dir_p);
     if (!max_dir_p) {
-        trans_p->len = scnprintf(trans_p->buf, IO_BUF_SIZE, "Can't create debugfs dir 'max' %d\n", ret);
-        trans_p->valid = true;
-        trans_p->rnw = true;
-        return 0;
+        trans_p->len = scnprintf(trans_p->buf, trans_p->buf_size, "Can't create debugfs dir 'max' %d\n", ret);
+        ret = -ENOMEM;
+        goto out;
     }
     desc_dir_p = debugfs_create_dir("desc", cfg_mgmt_dir_p);
     if (!desc_dir_p) {
-        trans_p->len = scnprintf(trans_p->buf, IO_BUF_SIZE, "Can't create debugfs dir 'desc' %d\n", ret);
-        trans_p->valid = true;
-        trans_p->rnw = true;
-        return 0;
+        trans_p->len = scnprintf(trans_p->buf, trans_p->buf_size, "Can't create debugfs dir 'desc' %d\n", ret);
+        ret = -ENOMEM;
+        goto out;
     }
 
     // fill the data structs
@@ -426,7 +650,6 @@ static int debugfs_open_ll(struct inode *inod, struct file *filp)
         trans_p->rnw = true;
         trans_p->valid = false;
         trans_p->len = 0;
-        trans_p->wq = &usr_wait_q;
         // get the variable name
         ret = access_var(i, ACC_NAME, trans_p);
 		if (ret < 0) {
@@ -434,14 +657,19 @@ static int debugfs_open_ll(struct inode *inod, struct file *filp)
 			continue;   // we can keep the other variables and simply create no files for this index
 		}
 		// block calling user context until we receive a reply
-        ret = wait_event_interruptible(usr_wait_q, trans_p->valid);
+        ret = rpmsg_link_wait(trans_p);
+        if (ret == -ETIMEDOUT) {
+			dev_err(dev, "%s: no reply for the name of index %d\n", __func__, i);
+            continue;
+        }
         if (ret) {	// abort in case we got interrupted
-            trans_p->len = scnprintf(trans_p->buf, IO_BUF_SIZE, "%s: interrupted\n", __func__);
-            trans_p->valid = true;
-            trans_p->rnw = true;
-            return 0;
+            rpmsg_link_cancel(trans_p);     // the buffer is reused for the error text
+            trans_p->len = scnprintf(trans_p->buf, trans_p->buf_size, "%s: interrupted\n", __func__);
+            goto out;
         }
 
+        var_cache_set_name(i, trans_p->buf);
+
 	// create all files for this variable
         debugfs_create_file(trans_p->buf, 0666, val_dir_p, (void*)(&val_access[i]),
 				       &fops_var);
@@ -454,11 +682,427 @@ static int debugfs_open_ll(struct inode *inod, struct file *filp)
 	}
 
     // alternatively we could do a 'happy programs don't talk' here.
-    trans_p->len = scnprintf(trans_p->buf, IO_BUF_SIZE, "ok\n");
-    trans_p->valid = true;
-    trans_p->rnw = true;
+    trans_p->len = scnprintf(trans_p->buf, trans_p->buf_size, "ok\n");
+    ret = 0;
+    vars_loaded = true;
 
     dev_dbg(dev, "%s: done\n", __func__);
+out:
+    // undo everything, the next attempt starts from scratch
+    if (ret)
+        unload_vars();
+    mutex_unlock(&load_lock);
+    return ret;
+}
+
+
+// called when the fw_stats file is opened: read the transport statistics of the firmware (vrings and all
+// channels) and keep the text until the file is closed
+static int debugfs_open_stats(struct inode *inod, struct file *filp)
+{
+    int i, ret;
+    struct stats_buf* s;
+    struct rpmsg_link_transaction* trans_p;
+
+    s = kzalloc(sizeof(*s), GFP_KERNEL);
+    if (!s) {
+        dev_err(&rpmsg_chnl->dev, "%s: no memory\n", __func__);
+        return -ENOMEM;
+    }
+    trans_p = rpmsg_link_alloc_trans();
+    if (!trans_p) {
+        dev_err(&rpmsg_chnl->dev, "%s: can't get a transaction struct, no memory.\n", __func__);
+        kfree(s);
+        return -ENOMEM;
+    }
+
+    // index 0 selects the vrings, 1.. the channels, then the firmware tasks and its boot timeline, the firmware
+    // replies with an error after the last one
+    for (i=0; ; i++) {
+        trans_p->rnw = true;
+        trans_p->valid = false;
+        trans_p->err = 0;
+        trans_p->len = 0;
+        ret = access_var(i, ACC_STATS, trans_p);
+        if (ret) {
+            dev_err(&rpmsg_chnl->dev, "%s: can't request statistics %d: %d\n", __func__, i, ret);
+            break;
+        }
+        ret = rpmsg_link_wait(trans_p);
+        if (ret) {	// abort in case we got interrupted or there is no reply
+            dev_err(&rpmsg_chnl->dev, "%s: no reply: %d\n", __func__, ret);
+            rpmsg_link_return_trans(trans_p);
+            kfree(s);
+            return ret;
+        }
+        if (trans_p->err)
+            break;  // no more channels
+        if ((s->len + trans_p->len) > STATS_BUF_SIZE)
+            break;
+        memcpy(s->buf + s->len, trans_p->buf, trans_p->len);
+        s->len += trans_p->len;
+    }
+    rpmsg_link_return_trans(trans_p);
+
+    filp->private_data = (void*)s;
+    return 0;
+}
+
+
+static ssize_t debugfs_read_stats(struct file *filp, char *buff, size_t len, loff_t *ppos)
+{
+    struct stats_buf* s = filp->private_data;
+
+    if (!s)
+        return -EINVAL; // should never happen
+    return simple_read_from_buffer(buff, len, ppos, s->buf, s->len);
+}
+
+
+static int debugfs_release_stats(struct inode *inod, struct file *filp)
+{
+    kfree(filp->private_data);
+    filp->private_data = NULL;
+    return 0;
+}
+
+
+// called when the stats file is opened: counters and round trip histogram of the kernel side of the link and the
+// counters of the value cache
+static int debugfs_open_link_stats(struct inode *inod, struct file *filp)
+{
+    struct stats_buf* s;
+    struct rpmsg_link_stats ls;
+    struct var_cache_stats cs;
+    int i;
+
+    s = kzalloc(sizeof(*s), GFP_KERNEL);
+    if (!s)
+        return -ENOMEM;
+    rpmsg_link_get_stats(&ls);
+    var_cache_get_stats(&cs);
+    s->len = scnprintf(s->buf, STATS_BUF_SIZE,
+        "requests: %u\nreplies: %u\nretries: %u\ntimeouts: %u\nunmatched: %u\nerrors: %u\npending: %u\n"
+        "cache hits: %u\ncache misses: %u\ncache invalidations: %u\n"
+        "rtt max: %uus\nrtt [us]:",
+        ls.requests, ls.replies, ls.retries, ls.timeouts, ls.unmatched, ls.errors, ls.pending,
+        cs.hits, cs.misses, cs.invalidations, ls.rtt_max);
+    // same format as the histograms of the firmware (fw_stats)
+    for (i=0; i<RPMSG_LINK_HIST_BINS; i++) {
+        if (i < (RPMSG_LINK_HIST_BINS-1))
+            s->len += scnprintf(s->buf + s->len, STATS_BUF_SIZE - s->len, " <%u:%u", 1u<<i, ls.rtt_hist[i]);
+        else
+            s->len += scnprintf(s->buf + s->len, STATS_BUF_SIZE - s->len, " >=%u:%u", 1u<<(i-1), ls.rtt_hist[i]);
+    }
+    s->len += scnprintf(s->buf + s->len, STATS_BUF_SIZE - s->len, "\n");
+    filp->private_data = (void*)s;
+    return 0;
+}
+
+
+// called when the fw_trace or fw_blog file is opened: copy the firmware's trace buffer (index in the inode's private
+// data) oldest data first. The firmware keeps writing while we copy, the copy is repeated until the sequence number
+// shows it wasn't modified meanwhile. Buffers without the header (old firmware) are copied as text.
+static int debugfs_open_trace(struct inode *inod, struct file *filp)
+{
+    struct rproc* rproc = vdev_to_rproc(dev_to_virtio(rpmsg_chnl->dev.parent));
+    struct rproc_mem_entry* trace;
+    struct fw_trace_hdr* hdr;
+    struct trace_copy* t;
+    int index = (int)(long)inod->i_private;
+    char* va = NULL;
+    u32 seq, head, tail, size, ofs, n, n1;
+    int i = 0;
+
+    list_for_each_entry(trace, &rproc->traces, node) {
+        if (i++ == index) {
+            va = trace->va;
+            break;
+        }
+    }
+    if (!va)
+        return -ENOENT;
+
+    t = vmalloc(sizeof(*t) + trace->len);
+    if (!t) {
+        dev_err(&rpmsg_chnl->dev, "%s: no memory\n", __func__);
+        return -ENOMEM;
+    }
+
+    hdr = (struct fw_trace_hdr*)(va + trace->len - sizeof(*hdr));
+    if ((trace->len <= sizeof(*hdr)) || (hdr->magic != FW_TRACE_MAGIC) || (hdr->size != (trace->len - sizeof(*hdr)))) {
+        t->len = strnlen(va, trace->len);
+        memcpy(t->buf, va, t->len);
+        filp->private_data = (void*)t;
+        return 0;
+    }
+
+    size = hdr->size;
+    for (i=0; i<FW_TRACE_RETRIES; i++) {
+        seq = ACCESS_ONCE(hdr->seq);
+        if (seq & 1) {
+            udelay(10);     // the firmware is writing
+            continue;
+        }
+        rmb();
+        head = ACCESS_ONCE(hdr->head);
+        tail = ACCESS_ONCE(hdr->tail);
+        n = head - tail;
+        if (n > size)
+            continue;
+        ofs = tail % size;
+        n1 = min(n, size - ofs);
+        memcpy(t->buf, va + ofs, n1);
+        memcpy(t->buf + n1, va, n - n1);
+        rmb();
+        if (ACCESS_ONCE(hdr->seq) == seq)
+            break;
+    }
+    if (i == FW_TRACE_RETRIES) {
+        dev_err(&rpmsg_chnl->dev, "%s: trace buffer keeps changing\n", __func__);
+        vfree(t);
+        return -EBUSY;
+    }
+    t->len = n;
+
+    filp->private_data = (void*)t;
+    return 0;
+}
+
+
+static ssize_t debugfs_read_trace(struct file *filp, char *buff, size_t len, loff_t *ppos)
+{
+    struct trace_copy* t = filp->private_data;
+
+    if (!t)
+        return -EINVAL; // should never happen
+    return simple_read_from_buffer(buff, len, ppos, t->buf, t->len);
+}
+
+
+static int debugfs_release_trace(struct inode *inod, struct file *filp)
+{
+    vfree(filp->private_data);
+    filp->private_data = NULL;
+    return 0;
+}
+
+
+// called when the table file is opened: read value, min, max and description of all variables (loads the variable
+// list if necessary). The file has a header line and one line per variable with tab separated fields, fields which
+// could not be read are shown as '-'. Values are taken from the cache unless the file is opened with O_SYNC.
+static int debugfs_open_table(struct inode *inod, struct file *filp)
+{
+    struct var_table* tbl;
+    int i, n, ret;
+
+    ret = cfg_mgmt_load_vars();
+    if (ret)
+        return ret;
+    n = var_cache_size();
+    tbl = vzalloc(sizeof(*tbl) + n * sizeof(tbl->rows[0]));
+    if (!tbl)
+        return -ENOMEM;
+    tbl->n = n;
+    for (i=0; i<n; i++)
+        var_cache_get_name(i, tbl->rows[i].name, TABLE_NAME_LEN);
+
+    ret = fetch_table(tbl, (filp->f_flags & O_SYNC) ? 0 : cache_max_age_ms);
+    if (!ret)
+        ret = seq_open(filp, &table_seq_ops);
+    if (ret) {
+        for (i=0; i<n; i++)
+            kfree(tbl->rows[i].desc);
+        vfree(tbl);
+        return ret;
+    }
+    ((struct seq_file*)filp->private_data)->private = tbl;
+    return 0;
+}
+
+
+static int debugfs_release_table(struct inode *inod, struct file *filp)
+{
+    struct var_table* tbl = ((struct seq_file*)filp->private_data)->private;
+    int i;
+
+    for (i=0; i<tbl->n; i++)
+        kfree(tbl->rows[i].desc);
+    vfree(tbl);
+    return seq_release(inod, filp);
+}
+
+
+// read all fields of all variables into tbl. Up to TABLE_DEPTH requests are in flight at once, they are completed in
+// the order they were sent (the firmware replies in order) and each completed slot is refilled with the next access,
+// so the firmware's round trip time is paid about once per TABLE_DEPTH fields. Fields in the cache are not requested.
+// Fields which can't be read (no reply, error of the firmware) stay invalid.
+// max_age_ms: max. age of cached values (see var_cache_get)
+// returns 0 or a neg. error code if we were interrupted or the channel is gone
+static int fetch_table(struct var_table* tbl, unsigned int max_age_ms)
+{
+    struct rpmsg_link_transaction* slot[TABLE_DEPTH] = {NULL};
+    struct rpmsg_link_transaction* t;
+    int slot_acc[TABLE_DEPTH];          // access number of the request in each slot (index*TABLE_N_ACC + field)
+    int total = tbl->n * TABLE_N_ACC;
+    int next = 0;                       // next access to request
+    int head = 0;                       // oldest slot in flight
+    int busy = 0;                       // number of slots in flight
+    int i, a, index, ret = 0;
+    access_t acc;
+
+    for (i=0; i<TABLE_DEPTH; i++) {
+        slot[i] = rpmsg_link_alloc_trans();
+        if (!slot[i]) {
+            ret = -ENOMEM;
+            goto out;
+        }
+    }
+
+    while ((next < total) || busy) {
+        // fill the free slots
+        while ((busy < TABLE_DEPTH) && (next < total)) {
+            i = (head + busy) % TABLE_DEPTH;
+            t = slot[i];
+            a = next++;
+            index = a / TABLE_N_ACC;
+            acc = table_acc[a % TABLE_N_ACC];
+            if (!tbl->rows[index].name[0])
+                continue;
+            t->rnw = true;
+            t->dirty = false;
+            t->valid = false;
+            t->err = 0;
+            t->len = 0;
+            t->no_cache = false;
+            // the cache needs a full size buffer for descriptions
+            if ((acc == ACC_DESC) && rpmsg_link_trans_buf(t))
+                continue;
+            if (var_cache_get(index, acc, t, max_age_ms)) {
+                table_store(tbl, index, acc, t);
+                continue;
+            }
+            t->cache_gen = var_cache_gen(index);
+            if (access_var(index, acc, t))
+                continue;
+            slot_acc[i] = a;
+            busy++;
+        }
+        if (!busy)
+            break;
+
+        // complete the oldest request
+        t = slot[head];
+        a = slot_acc[head];
+        ret = rpmsg_link_wait(t);
+        if (ret && (ret != -ETIMEDOUT))
+            goto out;
+        if (!ret) {
+            index = a / TABLE_N_ACC;
+            acc = table_acc[a % TABLE_N_ACC];
+            table_store(tbl, index, acc, t);
+            var_cache_put(index, acc, t);
+        }
+        ret = 0;
+        head = (head + 1) % TABLE_DEPTH;
+        busy--;
+    }
+out:
+    // this cancels the requests still in flight
+    for (i=0; i<TABLE_DEPTH; i++) {
+        if (slot[i])
+            rpmsg_link_return_trans(slot[i]);
+    }
+    return ret;
+}
+
+
+// copy the result of the completed access t to the row of variable index
+static void table_store(struct var_table* tbl, int index, access_t acc, struct rpmsg_link_transaction* t)
+{
+    struct table_row* r = &tbl->rows[index];
+    int i;
+
+    if (!t->valid || t->err)
+        return;
+    switch (acc) {
+    case ACC_VAL:
+        r->val = t->val;
+        break;
+    case ACC_MIN:
+        r->min = t->val;
+        break;
+    case ACC_MAX:
+        r->max = t->val;
+        break;
+    case ACC_DESC:
+        r->desc = kstrndup(t->buf, t->len, GFP_KERNEL);
+        if (!r->desc)
+            return;
+        // one line per variable, tabs separate the fields
+        for (i=0; r->desc[i]; i++) {
+            if ((r->desc[i] == '\n') || (r->desc[i] == '\t'))
+                r->desc[i] = ' ';
+        }
+        while ((i > 0) && (r->desc[i-1] == ' '))
+            r->desc[--i] = '\0';
+        break;
+    default:
+        return;
+    }
+    r->valid |= 1 << acc;
+}
+
+
+// position 0 is the header line, position i the variable with index i-1
+static void* table_start(struct seq_file* s, loff_t* pos)
+{
+    struct var_table* tbl = s->private;
+
+    if (*pos == 0)
+        return SEQ_START_TOKEN;
+    if (*pos > tbl->n)
+        return NULL;
+    return &tbl->rows[*pos - 1];
+}
+
+
+static void* table_next(struct seq_file* s, void* v, loff_t* pos)
+{
+    (*pos)++;
+    return table_start(s, pos);
+}
+
+
+static void table_stop(struct seq_file* s, void* v)
+{
+}
+
+
+static int table_show(struct seq_file* s, void* v)
+{
+    struct table_row* r = v;
+
+    if (v == SEQ_START_TOKEN) {
+        seq_puts(s, "name\tvalue\tmin\tmax\tdescription\n");
+        return 0;
+    }
+    if (!r->name[0])
+        return 0;
+    seq_printf(s, "%s\t", r->name);
+    if (r->valid & (1 << ACC_VAL))
+        seq_printf(s, "%d\t", r->val);
+    else
+        seq_puts(s, "-\t");
+    if (r->valid & (1 << ACC_MIN))
+        seq_printf(s, "%d\t", r->min);
+    else
+        seq_puts(s, "-\t");
+    if (r->valid & (1 << ACC_MAX))
+        seq_printf(s, "%d\t", r->max);
+    else
+        seq_puts(s, "-\t");
+    seq_printf(s, "%s\n", (r->valid & (1 << ACC_DESC)) ? r->desc : "-");
     return 0;
 }
 
@@ -466,30 +1110,53 @@ static int debugfs_open_ll(struct inode *inod, struct file *filp)
 // probe function, called when the remote side establishes a connection with us
 static int cfg_mgmt_probe (struct rpmsg_channel *rpdev)
 {
+    int ret;
+
 	dev_dbg(&rpdev->dev, "%s: starting\n",__func__);
 
 	// save the rpmsg channel pointer for use by all other functions
 	rpmsg_chnl = rpdev;
 
     // init communication logic
-    rpmsg_link_init(rpdev);
+    ret = rpmsg_link_init(rpdev);
+    if (ret) {
+        dev_err(&rpdev->dev, "%s: can't init the link: %d\n", __func__, ret);
+        rpmsg_chnl = NULL;
+        return ret;
+    }
 
     // create a new directory in debugfs for our module
     cfg_mgmt_dir_p = debugfs_create_dir("cfg_mgmt", NULL);
     if (!cfg_mgmt_dir_p || (cfg_mgmt_dir_p<0)) {
         dev_err(&rpdev->dev, "%s: can't create debugfs directory: %d\n", __func__, (int)cfg_mgmt_dir_p);
         cfg_mgmt_dir_p = NULL;
+        rpmsg_link_exit();
+        rpmsg_chnl = NULL;
         return -ENOENT;
     }
 
     // create the 'load' file, reading it will trigger a generation of the variable files
     ll_file_p = debugfs_create_file("load_list", 0444, cfg_mgmt_dir_p, NULL, &fops_ll);
 
+    // transport statistics of the firmware, queried whenever the file is opened
+    debugfs_create_file("fw_stats", 0444, cfg_mgmt_dir_p, NULL, &fops_stats);
+
+    // request counters of the link (timeouts, retransmissions) and the value cache
+    debugfs_create_file("stats", 0444, cfg_mgmt_dir_p, NULL, &fops_link_stats);
+
+    // firmware log (circular trace buffer) in chronological order and the binary log, see tools/blogdec
+    debugfs_create_file("fw_trace", 0444, cfg_mgmt_dir_p, (void*)0, &fops_trace);
+    debugfs_create_file("fw_blog", 0444, cfg_mgmt_dir_p, (void*)1, &fops_trace);
+
+    // name, value, min, max and description of all variables in one file (loads the variable list)
+    debugfs_create_file("table", 0444, cfg_mgmt_dir_p, NULL, &fops_table);
+
     dev_dbg(&rpdev->dev, "%s: done\n", __func__);
 	return 0;
 }
 
 
+// allocate the access arrays, on failure the ones already allocated are freed by unload_vars
 static int alloc_mem(int n_vars)
 {
     struct device* dev = &rpmsg_chnl->dev;  // abbrevation
@@ -524,9 +1191,34 @@ static void free_mem()
 {
     printk(KERN_DEBUG "CFG_MGMT %s: freeing mem\n", __func__);
 
+    mutex_lock(&load_lock);
+    unload_vars();
+    mutex_unlock(&load_lock);
+
     if (cfg_mgmt_dir_p)
         debugfs_remove_recursive(cfg_mgmt_dir_p);
     cfg_mgmt_dir_p = NULL;
+}
+
+
+// remove the variable directories and free the access arrays and the cache (failed load or channel removed)
+// load_lock has to be held
+static void unload_vars(void)
+{
+    vars_loaded = false;
+
+    if (val_dir_p)
+        debugfs_remove_recursive(val_dir_p);
+    if (min_dir_p)
+        debugfs_remove_recursive(min_dir_p);
+    if (max_dir_p)
+        debugfs_remove_recursive(max_dir_p);
+    if (desc_dir_p)
+        debugfs_remove_recursive(desc_dir_p);
+    val_dir_p = NULL;
+    min_dir_p = NULL;
+    max_dir_p = NULL;
+    desc_dir_p = NULL;
 
     if (val_access)
         kfree(val_access);
@@ -543,6 +1235,8 @@ static void free_mem()
     if (desc_access)
         kfree(desc_access);
     desc_access = NULL;
+
+    var_cache_free();
 }
 
 
@@ -550,8 +1244,11 @@ static void cfg_mgmt_remove(struct rpmsg_channel *rpdev)
 {
 	dev_dbg(&rpdev->dev, "%s: starting\n",__func__);
 
-    rpmsg_link_exit();
+    cfg_mgmt_snap_reset();  // stops reading values
     free_mem(); // remove all files and free memory
+    // pending requests fail with -ENODEV. Open files keep their transactions (and the pools) until they are closed.
+    rpmsg_link_exit();
+    rpmsg_chnl = NULL;
 
 	dev_dbg(&rpdev->dev, "%s: done\n",__func__);
 }
@@ -562,6 +1259,8 @@ static void __exit cm_exit(void)
     //free_mem(); // make sure we freed our memory
 	printk(KERN_INFO "CFG_MGMT: unloading module\n");
 	unregister_rpmsg_driver(&cfg_mgmt_rpmsg_drv);
+    cfg_mgmt_dev_exit();
+    rpmsg_link_cleanup();   // no transactions are left, free the pools
 }
 
 
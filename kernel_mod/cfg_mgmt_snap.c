@@ -0,0 +1,317 @@
+/***********************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*
+* (c) 2015 Lukas Schrittwieser (LS)
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 2 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program; if not, write to the Free Software
+*    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*    Or see <http://www.gnu.org/licenses/>
+*
+************************************************************************************************************************
+*
+* cfg_mgmt_snap.c
+*
+* Snapshot of all values for user space: /dev/cfg_mgmt can be mapped read only, the mapping holds a struct
+* cfg_mgmt_snap (cfg_mgmt_ioctl.h). While it is mapped a work item reads all values every snapshot_ms and publishes
+* them with a sequence counter, readers take consistent copies without any syscall.
+* A snapshot belongs to one session of the rpmsg channel (its number of variables), it is marked CFG_MGMT_SNAP_GONE
+* when the channel is removed. It is freed once the last mapping is gone.
+*
+************************************************************************************************************************/
+
+//#define DEBUG
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/kref.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+
+#include "cfg_mgmt.h"
+#include "cfg_mgmt_ioctl.h"
+
+
+// number of values read from the firmware at once (like DEV_CHUNK in cfg_mgmt_dev.c)
+#define SNAP_CHUNK      64
+
+
+
+/************************************************************************************************************************
+*   T Y P E S
+*/
+
+// snapshot of one session, referenced by snap_cur (while the channel exists), each mapping and a running refresh
+struct snap_session {
+    struct kref ref;
+    struct cfg_mgmt_snap* snap;     // shared with user space (vmalloc_user)
+    size_t  size;
+    struct cfg_mgmt_snap_val* next; // values of the next snapshot, collected before it is published
+    int     users;                  // number of mappings (protected by snap_lock)
+};
+
+
+
+/************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+void cfg_mgmt_snap_reset(void);
+
+static struct snap_session* snap_alloc(void);
+
+static void snap_free(struct kref* ref);
+
+static void snap_publish(struct snap_session* s, u32 gen, int errors);
+
+static void snap_refresh(struct work_struct* work);
+
+static void snap_vm_open(struct vm_area_struct* vma);
+
+static void snap_vm_close(struct vm_area_struct* vma);
+
+
+
+/************************************************************************************************************************
+*   G L O B A L S
+*/
+
+// refresh period of the snapshot, the values are only read while the snapshot is mapped
+static unsigned int snapshot_ms = 10;
+module_param(snapshot_ms, uint, 0644);
+MODULE_PARM_DESC(snapshot_ms, "refresh period of the mapped value snapshot (ms)");
+
+// protects snap_cur and the number of mappings of the sessions
+static DEFINE_MUTEX(snap_lock);
+static struct snap_session* snap_cur;   // snapshot of the current session, NULL until it is mapped
+
+static struct cfg_mgmt_op snap_ops[SNAP_CHUNK];     // only used by snap_refresh
+
+// the refresh waits for the firmware (seconds if it doesn't answer), so it doesn't use the system workqueue
+static struct workqueue_struct* snap_wq;
+static DECLARE_DELAYED_WORK(snap_work, snap_refresh);
+
+static const struct vm_operations_struct snap_vm_ops = {
+    .open   = snap_vm_open,
+    .close  = snap_vm_close,
+};
+
+
+
+/************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+int cfg_mgmt_snap_init(void)
+{
+    snap_wq = alloc_ordered_workqueue("cfg_mgmt_snap", 0);
+    return snap_wq ? 0 : -ENOMEM;
+}
+
+
+// the module is unloaded, there are no mappings left (they hold a reference to the module)
+void cfg_mgmt_snap_exit(void)
+{
+    cfg_mgmt_snap_reset();
+    destroy_workqueue(snap_wq);
+}
+
+
+// the channel is removed: stop refreshing the current snapshot and tell its readers, the next mmap gets a snapshot of
+// the new session. Has to be called before the link is stopped.
+void cfg_mgmt_snap_reset(void)
+{
+    struct snap_session* s;
+
+    mutex_lock(&snap_lock);
+    s = snap_cur;
+    snap_cur = NULL;
+    mutex_unlock(&snap_lock);
+    // the refresh doesn't queue itself again as the session is not current any more
+    cancel_delayed_work_sync(&snap_work);
+    if (!s)
+        return;
+    s->snap->seq++;
+    smp_wmb();
+    s->snap->flags |= CFG_MGMT_SNAP_GONE;
+    smp_wmb();
+    s->snap->seq++;
+    kref_put(&s->ref, snap_free);
+}
+
+
+// mmap handler of /dev/cfg_mgmt, maps the snapshot of the current session read only and starts refreshing it
+int cfg_mgmt_snap_mmap(struct file* filp, struct vm_area_struct* vma)
+{
+    struct snap_session* s;
+    int ret;
+
+    if (vma->vm_flags & VM_WRITE)
+        return -EACCES;
+
+    mutex_lock(&snap_lock);
+    if (!snap_cur)
+        snap_cur = snap_alloc();
+    s = snap_cur;
+    if (IS_ERR(s)) {
+        snap_cur = NULL;
+        mutex_unlock(&snap_lock);
+        return PTR_ERR(s);
+    }
+    kref_get(&s->ref);
+    mutex_unlock(&snap_lock);
+
+    // fails if the mapping is larger than the snapshot
+    ret = remap_vmalloc_range(vma, s->snap, vma->vm_pgoff);
+    if (!ret) {
+        vma->vm_flags &= ~VM_MAYWRITE;      // no mprotect(PROT_WRITE) either
+        vma->vm_private_data = s;
+        vma->vm_ops = &snap_vm_ops;
+        snap_vm_open(vma);
+    }
+    kref_put(&s->ref, snap_free);
+    return ret;
+}
+
+
+// allocate the snapshot of the current session, snap_lock has to be held
+// returns the snapshot (one reference, for snap_cur) or an ERR_PTR
+static struct snap_session* snap_alloc(void)
+{
+    struct snap_session* s;
+    int n;
+
+    // loads the variable list if necessary
+    n = cfg_mgmt_n_vars();
+    if (n < 0)
+        return ERR_PTR(n);
+    s = kzalloc(sizeof(*s), GFP_KERNEL);
+    if (!s)
+        return ERR_PTR(-ENOMEM);
+    kref_init(&s->ref);
+    s->size = PAGE_ALIGN(sizeof(*s->snap) + n * sizeof(s->snap->values[0]));
+    s->snap = vmalloc_user(s->size);     // zeroed: gen 0 tells readers there is no snapshot yet
+    s->next = kcalloc(n ? n : 1, sizeof(s->next[0]), GFP_KERNEL);
+    if (!s->snap || !s->next) {
+        snap_free(&s->ref);
+        return ERR_PTR(-ENOMEM);
+    }
+    s->snap->n_vars = n;
+    return s;
+}
+
+
+static void snap_free(struct kref* ref)
+{
+    struct snap_session* s = container_of(ref, struct snap_session, ref);
+
+    vfree(s->snap);
+    kfree(s->next);
+    kfree(s);
+}
+
+
+// read all values (in chunks which are sent to the firmware at once) and publish them. The firmware's latency is
+// spent while collecting the values in s->next, readers only retry while they are copied to the shared snapshot.
+static void snap_refresh(struct work_struct* work)
+{
+    struct snap_session* s;
+    u32 gen;
+    int n, errors = 0;
+    int i, k, m;
+
+    mutex_lock(&snap_lock);
+    s = snap_cur;
+    if (!s || !s->users) {
+        mutex_unlock(&snap_lock);
+        return;
+    }
+    kref_get(&s->ref);
+    mutex_unlock(&snap_lock);
+
+    // this work item is the only writer of the current session
+    n = s->snap->n_vars;
+    gen = s->snap->gen + 1;
+    for (i=0; i<n; i+=m) {
+        m = min_t(int, SNAP_CHUNK, n - i);
+        for (k=0; k<m; k++) {
+            snap_ops[k].index = i + k;
+            snap_ops[k].write = false;
+            snap_ops[k].err = 0;
+        }
+        cfg_mgmt_batch(snap_ops, m);
+        for (k=0; k<m; k++) {
+            if (snap_ops[k].err) {
+                errors++;   // keeps the last value and its generation
+            } else {
+                s->next[i+k].value = snap_ops[k].val;
+                s->next[i+k].gen = gen;
+            }
+        }
+    }
+    snap_publish(s, gen, errors);
+
+    mutex_lock(&snap_lock);
+    if ((snap_cur == s) && s->users)
+        queue_delayed_work(snap_wq, &snap_work, msecs_to_jiffies(snapshot_ms));
+    mutex_unlock(&snap_lock);
+    kref_put(&s->ref, snap_free);
+}
+
+
+// copy the collected values to the shared snapshot. A plain counter with barriers works like a seqcount (which can't
+// be placed in memory shared with user space), there is only one writer.
+static void snap_publish(struct snap_session* s, u32 gen, int errors)
+{
+    struct cfg_mgmt_snap* snap = s->snap;
+
+    snap->seq++;
+    smp_wmb();
+    memcpy(snap->values, s->next, snap->n_vars * sizeof(snap->values[0]));
+    snap->errors = errors;
+    snap->time_ns = ktime_to_ns(ktime_get());
+    snap->gen = gen;
+    smp_wmb();
+    snap->seq++;
+}
+
+
+// called for each new mapping (also on fork and split), the first one of the current session starts the refresh
+static void snap_vm_open(struct vm_area_struct* vma)
+{
+    struct snap_session* s = vma->vm_private_data;
+
+    kref_get(&s->ref);
+    mutex_lock(&snap_lock);
+    if ((s->users++ == 0) && (s == snap_cur))
+        queue_delayed_work(snap_wq, &snap_work, 0);
+    mutex_unlock(&snap_lock);
+}
+
+
+// the refresh stops by itself once the last mapping is gone
+static void snap_vm_close(struct vm_area_struct* vma)
+{
+    struct snap_session* s = vma->vm_private_data;
+
+    mutex_lock(&snap_lock);
+    s->users--;
+    mutex_unlock(&snap_lock);
+    kref_put(&s->ref, snap_free);
+}
@@ -0,0 +1,120 @@
+/***********************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*
+* (c) 2015 Lukas Schrittwieser (LS)
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 2 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program; if not, write to the Free Software
+*    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*    Or see <http://www.gnu.org/licenses/>
+*
+************************************************************************************************************************
+*
+* cfg_mgmt_trace.h
+*
+* Trace events of the rpmsg link (ftrace / perf, system cfg_mgmt). They cost nothing while disabled, use them instead
+* of dev_dbg in the request path. Type is the request (REQ_*) or reply (RES_*) code of the protocol.
+*
+************************************************************************************************************************/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cfg_mgmt
+
+#if !defined(__CFG_MGMT_TRACE__) || defined(TRACE_HEADER_MULTI_READ)
+#define __CFG_MGMT_TRACE__
+
+#include <linux/tracepoint.h>
+
+
+DECLARE_EVENT_CLASS(cfg_mgmt_req,
+    TP_PROTO(u32 seq, u32 type, s32 index),
+    TP_ARGS(seq, type, index),
+    TP_STRUCT__entry(
+        __field(u32, seq)
+        __field(u32, type)
+        __field(s32, index)
+    ),
+    TP_fast_assign(
+        __entry->seq = seq;
+        __entry->type = type;
+        __entry->index = index;
+    ),
+    TP_printk("seq=%u type=%u index=%d", __entry->seq, __entry->type, __entry->index)
+);
+
+// request sent (or queued for sending if the caller can't sleep)
+DEFINE_EVENT(cfg_mgmt_req, cfg_mgmt_submit,
+    TP_PROTO(u32 seq, u32 type, s32 index),
+    TP_ARGS(seq, type, index)
+);
+
+// no reply before the deadline, the request is sent again
+DEFINE_EVENT(cfg_mgmt_req, cfg_mgmt_retry,
+    TP_PROTO(u32 seq, u32 type, s32 index),
+    TP_ARGS(seq, type, index)
+);
+
+// no reply before the deadline and no retries left, the request completes with -ETIMEDOUT
+DEFINE_EVENT(cfg_mgmt_req, cfg_mgmt_timeout,
+    TP_PROTO(u32 seq, u32 type, s32 index),
+    TP_ARGS(seq, type, index)
+);
+
+// message received from the firmware (reply or notification), before it is matched to a request
+TRACE_EVENT(cfg_mgmt_reply,
+    TP_PROTO(u32 seq, u32 type, s32 index, s32 val, u32 len),
+    TP_ARGS(seq, type, index, val, len),
+    TP_STRUCT__entry(
+        __field(u32, seq)
+        __field(u32, type)
+        __field(s32, index)
+        __field(s32, val)
+        __field(u32, len)
+    ),
+    TP_fast_assign(
+        __entry->seq = seq;
+        __entry->type = type;
+        __entry->index = index;
+        __entry->val = val;
+        __entry->len = len;
+    ),
+    TP_printk("seq=%u type=%u index=%d val=%d len=%u", __entry->seq, __entry->type, __entry->index, __entry->val,
+        __entry->len)
+);
+
+// a request completed with a reply, rtt is the time since it was sent (us)
+TRACE_EVENT(cfg_mgmt_complete,
+    TP_PROTO(u32 seq, int err, u32 rtt),
+    TP_ARGS(seq, err, rtt),
+    TP_STRUCT__entry(
+        __field(u32, seq)
+        __field(int, err)
+        __field(u32, rtt)
+    ),
+    TP_fast_assign(
+        __entry->seq = seq;
+        __entry->err = err;
+        __entry->rtt = rtt;
+    ),
+    TP_printk("seq=%u err=%d rtt=%uus", __entry->seq, __entry->err, __entry->rtt)
+);
+
+#endif
+
+// the module is built out of tree, the header is not in include/trace/events
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE cfg_mgmt_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,178 @@
+/***********************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*
+* (c) 2015 Lukas Schrittwieser (LS)
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 2 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program; if not, write to the Free Software
+*    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*    Or see <http://www.gnu.org/licenses/>
+*
+************************************************************************************************************************
+*
+* rpmsg_frag.c
+*
+* Transport of messages which are larger than one rpmsg buffer. Every message is prefixed with a struct rpmsg_frag_hdr
+* and split into as many buffers as needed, the receiver reassembles it. This is the counterpart of the bare metal
+* firmware's RPMSG_CH_F_FRAG channels.
+*
+************************************************************************************************************************/
+
+//#define DEBUG
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/rpmsg.h>
+
+#include "rpmsg_frag.h"
+
+
+
+/************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+// allocate the reassembly buffer
+int rpmsg_frag_rx_init(struct rpmsg_frag_rx* rx)
+{
+    memset(rx, 0, sizeof(*rx));
+    rx->buf = kmalloc(RPMSG_FRAG_MSG_MAX, GFP_KERNEL);
+    if (!rx->buf)
+        return -ENOMEM;
+    return 0;
+}
+
+
+void rpmsg_frag_rx_free(struct rpmsg_frag_rx* rx)
+{
+    kfree(rx->buf);
+    rx->buf = NULL;
+    rx->active = false;
+}
+
+
+// process a received buffer
+// data, len: message as passed to the rpmsg callback (including the fragment header)
+// msg: set to the start of the complete message, this is either within data (single fragment) or the reassembly
+//      buffer which is valid until the next call
+// returns the length of the complete message, -EAGAIN if more fragments are needed or another neg. error code
+int rpmsg_frag_recv(struct rpmsg_frag_rx* rx, void* data, int len, void** msg)
+{
+    struct rpmsg_frag_hdr* fh = data;
+    u8* payload = (u8*)data + sizeof(*fh);
+
+    if (len < (int)sizeof(*fh)) {
+        rx->errors++;
+        return -EINVAL;
+    }
+    len -= sizeof(*fh);
+
+    // single fragment message, no need to copy it. These may be interleaved with the fragments of a
+    // longer message (sent concurrently), so don't touch the reassembly state.
+    if ((fh->offset == 0) && (fh->total_len == len)) {
+        *msg = payload;
+        return len;
+    }
+
+    if (fh->offset == 0) {
+        // first fragment of a new message
+        if (rx->active)
+            rx->errors++;
+        rx->active = false;
+        if (!rx->buf || (fh->total_len > RPMSG_FRAG_MSG_MAX)) {
+            rx->errors++;
+            return -EMSGSIZE;
+        }
+        rx->active = true;
+        rx->msg_id = fh->msg_id;
+        rx->total = fh->total_len;
+        rx->received = 0;
+    }
+
+    if (!rx->active || (fh->msg_id != rx->msg_id) || (fh->offset != rx->received) ||
+            ((fh->offset + len) > rx->total)) {
+        // fragment does not belong to the message we are reassembling (lost fragment?)
+        rx->errors++;
+        rx->active = false;
+        return -EPROTO;
+    }
+
+    memcpy(rx->buf + rx->received, payload, len);
+    rx->received += len;
+    if (rx->received < rx->total)
+        return -EAGAIN;
+
+    rx->active = false;
+    *msg = rx->buf;
+    return rx->total;
+}
+
+
+void rpmsg_frag_tx_init(struct rpmsg_frag_tx* tx)
+{
+    mutex_init(&tx->lock);
+    atomic_set(&tx->msg_id, 0);
+}
+
+
+// send a message of up to RPMSG_FRAG_MSG_MAX bytes, blocks until all fragments are sent (may sleep)
+// returns 0 on success or a neg. error code
+int rpmsg_frag_send(struct rpmsg_channel* ch, struct rpmsg_frag_tx* tx, const void* data, int len)
+{
+    struct rpmsg_frag_hdr* fh;
+    int n, ret = 0;
+    bool multi = (len > RPMSG_FRAG_DATA_MAX);
+    // short messages (eg cfg_mgmt requests) are built on the stack, so concurrent senders don't allocate
+    u8 small[sizeof(*fh) + RPMSG_FRAG_SMALL_MAX] __aligned(4);
+
+    if ((len < 0) || (len > RPMSG_FRAG_MSG_MAX))
+        return -EMSGSIZE;
+
+    // one buffer for header and fragment payload, reused for all fragments
+    if (len <= RPMSG_FRAG_SMALL_MAX) {
+        fh = (struct rpmsg_frag_hdr*)small;
+    } else {
+        fh = kmalloc(sizeof(*fh) + min_t(int, len, RPMSG_FRAG_DATA_MAX), GFP_KERNEL);
+        if (!fh)
+            return -ENOMEM;
+    }
+
+    fh->msg_id = (u16)atomic_inc_return(&tx->msg_id);
+    fh->flags = 0;
+    fh->total_len = len;
+    fh->offset = 0;
+
+    // fragments of different messages must not be interleaved, the other side reassembles one at a time
+    if (multi)
+        mutex_lock(&tx->lock);
+
+    do {
+        n = min_t(int, len - fh->offset, RPMSG_FRAG_DATA_MAX);
+        memcpy(fh+1, (const u8*)data + fh->offset, n);
+        ret = rpmsg_send(ch, fh, sizeof(*fh) + n);
+        if (ret)
+            break;
+        fh->offset += n;
+    } while (fh->offset < len);
+
+    if (multi)
+        mutex_unlock(&tx->lock);
+
+    if ((u8*)fh != small)
+        kfree(fh);
+    return ret;
+}
@@ -0,0 +1,61 @@
+
+#ifndef __RPMSG_FRAG__
+#define __RPMSG_FRAG__
+
+
+#include <linux/types.h>
+#include <linux/mutex.h>
+#include <linux/rpmsg.h>
+
+
+// size of the buffers used by virtio_rpmsg_bus (RPMSG_BUF_SIZE in virtio_rpmsg_bus.c), including the rpmsg header
+#define RPMSG_FRAG_BUF_SIZE     512
+
+// max. total length of a fragmented message, this has to match the bare metal firmware (remoteproc_kernel.h)
+#define RPMSG_FRAG_MSG_MAX      4096
+
+
+// header in front of every message on a channel using fragmentation, the layout has to match the bare metal
+// firmware (struct rpmsg_frag_hdr in remoteproc_kernel.h)
+struct rpmsg_frag_hdr {
+    u16     msg_id;     // identifies all fragments of one message
+    u16     flags;      // reserved, 0
+    u32     total_len;  // total payload length of the message
+    u32     offset;     // position of this fragment's payload within the message
+} __attribute__((packed));
+
+// max. payload per fragment
+#define RPMSG_FRAG_DATA_MAX     (RPMSG_FRAG_BUF_SIZE - sizeof(struct rpmsg_hdr) - sizeof(struct rpmsg_frag_hdr))
+
+// messages up to this length are sent from a buffer on the stack (rpmsg_frag_send), longer ones from kmalloc'ed memory
+#define RPMSG_FRAG_SMALL_MAX    64
+
+
+// reassembly state of one channel (receive direction)
+struct rpmsg_frag_rx {
+    u8*     buf;        // RPMSG_FRAG_MSG_MAX bytes
+    bool    active;     // a message is being reassembled
+    u16     msg_id;
+    u32     total;
+    u32     received;
+    u32     errors;     // number of dropped fragments
+};
+
+// transmit state of one channel
+struct rpmsg_frag_tx {
+    struct mutex lock;  // keeps the fragments of one message together
+    atomic_t msg_id;
+};
+
+
+int rpmsg_frag_rx_init(struct rpmsg_frag_rx* rx);
+
+void rpmsg_frag_rx_free(struct rpmsg_frag_rx* rx);
+
+int rpmsg_frag_recv(struct rpmsg_frag_rx* rx, void* data, int len, void** msg);
+
+void rpmsg_frag_tx_init(struct rpmsg_frag_tx* tx);
+
+int rpmsg_frag_send(struct rpmsg_channel* ch, struct rpmsg_frag_tx* tx, const void* data, int len);
+
+#endif
@@ -40,8 +40,20 @@
 #include <linux/rpmsg.h>
 #include <linux/spinlock.h>
 #include <linux/slab.h>
+#include <linux/mempool.h>
+#include <linux/atomic.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/moduleparam.h>
 
 #include "rpmsg_link.h"
+#include "rpmsg_frag.h"
+#include "var_cache.h"
+
+#define CREATE_TRACE_POINTS
+#include "cfg_mgmt_trace.h"
 
 
 
@@ -55,6 +67,7 @@
 #define REQ_RD_MAX  5       // read max limit
 #define REQ_NAME    6       // read name of variable with given index (0..N_VARS-1)
 #define REQ_DESC    7       // read description text of variable with given index
+#define REQ_STATS   8       // read transport statistics (text), index 0: vrings, 1..n: channel index-1, tasks, boot
 
 
 // BM to kernel (response)
@@ -66,11 +79,21 @@
 #define RES_RD_MAX  133
 #define RES_NAME    134
 #define RES_DESC    135
+#define RES_STATS   136
+#define RES_RD_VOL  137     // like RES_RD_VAL, the value comes from a read callback and must not be cached
+#define RES_CHANGED 138     // notification (not a reply): the firmware modified the value of variable ind
 
 #define RES_REQ_ERR 255     // unknown request
 
 #define REQ_NONE 	0xffffffff	// invalid type code
 
+// number of slots for pending transactions, must be a power of 2. A transaction is stored in slot seq % PENDING_SLOTS,
+// so this limits the number of requests which may be in flight at the same time.
+#define PENDING_SLOTS   256
+
+// period of the deadline sweep (ms), a request times out at most this much later than its deadline
+#define SWEEP_PERIOD_MS 10
+
 
 
 
@@ -86,14 +109,55 @@ static struct rpmsg_channel* rpmsg_chnl = NULL;
 // number of variables exported via sysfs (after a query to remote side)
 int n_vars = -1;
 
-// list of all pending transactions (request sent, no response received yet)
-static struct list_head pending_list = LIST_HEAD_INIT(pending_list);
-// lits of unsued transaction structs (for recycling)
-LIST_HEAD(unused_list);
+// pending transactions (request sent, no response received yet), indexed by their sequence number
+static struct rpmsg_link_transaction* pending[PENDING_SLOTS];
+
+// transaction structs come from a slab cache, the pool keeps enough of them for all pending slots
+static struct kmem_cache* trans_cache = NULL;
+static mempool_t* trans_pool = NULL;
+// text buffers (IO_BUF_SIZE) of transactions which need one, see rpmsg_link_trans_buf
+static struct kmem_cache* buf_cache = NULL;
+
+// transactions can be allocated and requests sent while the link is alive (protected by pending_lock)
+static bool link_alive = false;
+
+// incremented for each channel (protected by pending_lock), a transaction can only send requests in the session it
+// was allocated in
+static u32 link_session = 0;
+
+// references to the pools: one of the link (init to exit) and one of each allocated transaction. Files, the kernel
+// API and the char device may still own transactions when the channel is removed, the pools are freed (free_pools_work)
+// once the last one is returned. A new channel reuses them if they are still there (pools_lock).
+static atomic_t n_trans = ATOMIC_INIT(0);
+static DEFINE_MUTEX(pools_lock);
+
+// sequence number of the next request
+static atomic_t next_seq = ATOMIC_INIT(0);
+
+// fragmentation state of the channel
+static struct rpmsg_frag_rx frag_rx;
+static struct rpmsg_frag_tx frag_tx;
+
+// protects pending, n_pending, link_stats and link_alive, the rpmsg callback runs in interrupt context
+static DEFINE_SPINLOCK(pending_lock);
+
+// number of used slots in pending, the sweep timer runs while it is not 0
+static int n_pending = 0;
+
+// checks the deadlines of pending transactions, expired reads are retransmitted by resend_work
+static struct hrtimer sweep_timer;
+static struct work_struct resend_work;
 
-static spinlock_t pending_list_lock;
-static spinlock_t unused_list_lock;
-static spinlock_t seq_lock;
+static struct rpmsg_link_stats link_stats;
+
+// time budget for a reply and retransmissions of reads, the values are applied when a request is sent
+static unsigned int timeout_ms = 1000;
+module_param(timeout_ms, uint, 0644);
+MODULE_PARM_DESC(timeout_ms, "time to wait for a reply of the firmware (ms)");
+
+static unsigned int retries = 2;
+module_param(retries, uint, 0644);
+MODULE_PARM_DESC(retries, "number of retransmissions of a read request which got no reply");
 
 
 
@@ -101,9 +165,27 @@ static spinlock_t seq_lock;
 *   P R O T O T Y P E S
 */
 
-static u32 get_next_seq_nr(void);
+static int add_pend_trans(struct rpmsg_link_transaction* t, bool queue);
+
+static int send_req(struct rpmsg_link_transaction* t, bool may_sleep);
+
+static void finish_async(struct rpmsg_link_transaction* t);
+
+static void finish_async_list(struct rpmsg_link_transaction* t);
+
+static struct rpmsg_link_transaction* __del_pend_trans(u32 seq);
 
-static inline void add_pend_trans(struct rpmsg_link_transaction* t);
+static struct rpmsg_link_transaction* del_pend_trans(u32 seq);
+
+static enum hrtimer_restart sweep(struct hrtimer* timer);
+
+static void resend(struct work_struct* work);
+
+static void put_pools(void);
+
+static void free_pools(struct work_struct* work);
+
+static DECLARE_WORK(free_pools_work, free_pools);
 
 
 
@@ -115,112 +197,201 @@ static inline void add_pend_trans(struct rpmsg_link_transaction* t);
 // must be called first, channel to be used for communication is passed as argument
 int rpmsg_link_init(struct rpmsg_channel *ch)
 {
-    struct rpmsg_link_transaction* t;
-    const int N = 16;
-    int i;
+    int ret;
+
+    BUILD_BUG_ON(sizeof(cfgReq_t) != CFG_MSG_HDR_LEN);
 
     rpmsg_chnl = ch;
 
-    spin_lock_init(&pending_list_lock);
-    spin_lock_init(&unused_list_lock);
-    spin_lock_init(&seq_lock);
+    memset(pending, 0, sizeof(pending));
+    n_pending = 0;
+    memset(&link_stats, 0, sizeof(link_stats));
+    hrtimer_init(&sweep_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    sweep_timer.function = sweep;
+    INIT_WORK(&resend_work, resend);
 
-    // add some transaction structs to the list of unused structs to speed things up on the first transactions
-    spin_lock(&pending_list_lock);
-    for (i=0; i<N; i++) {
-        t = kzalloc(sizeof(*t), GFP_KERNEL);
-        if (!t)
-            return -ENOMEM;
+    rpmsg_frag_tx_init(&frag_tx);
+    ret = rpmsg_frag_rx_init(&frag_rx);
+    if (ret)
+        return ret;
 
-        dev_dbg(&ch->dev, "%s: creating transaction struct at 0x%08x\n", __func__, (u32)t);
-        INIT_LIST_HEAD(&(t->list));
-        list_add(&t->list, &unused_list);
+    // transactions of the previous channel may still be around, they keep the pools
+    mutex_lock(&pools_lock);
+    if (!trans_pool) {
+        trans_cache = kmem_cache_create("cfg_mgmt_trans", sizeof(struct rpmsg_link_transaction), 0,
+            SLAB_HWCACHE_ALIGN, NULL);
+        buf_cache = kmem_cache_create("cfg_mgmt_buf", IO_BUF_SIZE, 0, 0, NULL);
+        if (trans_cache)
+            trans_pool = mempool_create_slab_pool(PENDING_SLOTS, trans_cache);
+        if (!trans_cache || !buf_cache || !trans_pool) {
+            dev_err(&ch->dev, "%s: can't create transaction cache\n", __func__);
+            if (buf_cache)
+                kmem_cache_destroy(buf_cache);
+            if (trans_cache)
+                kmem_cache_destroy(trans_cache);
+            trans_cache = NULL;
+            buf_cache = NULL;
+            mutex_unlock(&pools_lock);
+            rpmsg_frag_rx_free(&frag_rx);
+            rpmsg_chnl = NULL;
+            return -ENOMEM;
+        }
     }
-    spin_unlock(&pending_list_lock);
+    atomic_inc(&n_trans);   // reference of the link, dropped by rpmsg_link_exit
+    mutex_unlock(&pools_lock);
 
+    spin_lock_irq(&pending_lock);
+    link_session++;
+    link_alive = true;
+    spin_unlock_irq(&pending_lock);
     return 0;
 }
 
 
+// stop the link: no new transactions or requests, pending requests are completed with -ENODEV. Transactions which are
+// still owned (e.g. by open files) stay valid, the pools are freed when the last one is returned.
 void rpmsg_link_exit()
 {
-    struct list_head* pos;
-    struct list_head* temp;
+    struct rpmsg_link_transaction* done_list = NULL;
+    unsigned long flags;
+    int i;
 
-    // empty transactions list
-    spin_lock(&pending_list_lock);
-    spin_lock(&unused_list_lock);
-    list_for_each_safe(pos, temp, &pending_list) // we delete the object from the list -> use safe version
-    {
-        // convert list_head pointer to a pointer to the list object
-        struct rpmsg_link_transaction* t = list_entry ( pos, struct rpmsg_link_transaction , list );
+    spin_lock_irqsave(&pending_lock, flags);
+    if (!link_alive) {
+        // not started (or stopped already), the link holds no reference to the pools
+        spin_unlock_irqrestore(&pending_lock, flags);
+        return;
+    }
+    link_alive = false;
+    spin_unlock_irqrestore(&pending_lock, flags);
+
+    // no more timeouts or retransmissions, the channel goes away (add_pend_trans doesn't start the timer any more)
+    hrtimer_cancel(&sweep_timer);
+    cancel_work_sync(&resend_work);
 
+    // there should be no pending transactions left, wake their owners in case there are
+    spin_lock_irqsave(&pending_lock, flags);
+    for (i=0; i<PENDING_SLOTS; i++) {
+        struct rpmsg_link_transaction* t = pending[i];
+        if (!t)
+            continue;
         dev_err(&rpmsg_chnl->dev, "%s: found pending transcation: seq=%d\n", __func__, t->msg_seq_nr);
-        list_del(pos);
-        kfree(t);
-    }
-    // free all unused transaction structs
-    list_for_each_safe(pos, temp, &unused_list) // we delete the object from the list -> use safe version
-    {
-        // convert list_head pointer to a pointer to the list object
-        struct rpmsg_link_transaction* t = list_entry ( pos, struct rpmsg_link_transaction , list );
-        list_del(pos);
-        kfree(t);
+        __del_pend_trans(t->msg_seq_nr);
+        t->err = -ENODEV;
+        t->len = 0;
+        smp_wmb();
+        t->valid = true;
+        if (t->done) {
+            t->next_done = done_list;
+            done_list = t;
+        } else {
+            wake_up_interruptible(&t->wq);
+        }
     }
+    spin_unlock_irqrestore(&pending_lock, flags);
+    finish_async_list(done_list);
+
+    // owners see -ENODEV, e.g. open files keep their transaction until they are closed
+    put_pools();
+    rpmsg_frag_rx_free(&frag_rx);
     rpmsg_chnl = NULL;
-    spin_unlock(&unused_list_lock);
-    spin_unlock(&pending_list_lock);
+}
+
+
+// called at module exit, the channel is gone and all transactions were returned: make sure the pools are freed
+void rpmsg_link_cleanup(void)
+{
+    flush_work(&free_pools_work);
+}
+
+
+// drop a reference to the pools, the last one frees them. Transactions may be returned from atomic context, so this
+// is done by a work item.
+static void put_pools(void)
+{
+    if (atomic_dec_and_test(&n_trans))
+        schedule_work(&free_pools_work);
+}
+
+
+static void free_pools(struct work_struct* work)
+{
+    mutex_lock(&pools_lock);
+    // a new channel may have taken the pools over meanwhile
+    if (atomic_read(&n_trans) == 0) {
+        if (trans_pool)
+            mempool_destroy(trans_pool);
+        if (trans_cache)
+            kmem_cache_destroy(trans_cache);
+        if (buf_cache)
+            kmem_cache_destroy(buf_cache);
+        trans_pool = NULL;
+        trans_cache = NULL;
+        buf_cache = NULL;
+    }
+    mutex_unlock(&pools_lock);
 }
 
 
 // rpmsg callback function: receives messages from the bare metal application
 void cfg_mgmt_rpmsg_cb(struct rpmsg_channel *rpdev, void *data, int len, void *priv, u32 src)
 {
-    struct list_head* pos;
-    struct list_head* temp;
-    struct rpmsg_link_transaction* trans = NULL;
-    cfgMsg_t* response = data;
+    struct rpmsg_link_transaction* trans;
+    unsigned long flags;
+    cfgMsg_t* response;
+    void* msg;
+    u32 rtt;
 
     //dev_dbg(&rpdev->dev, "%s: starting\n", __func__);
 
+    // strip the fragment header, reassemble long messages
+    len = rpmsg_frag_recv(&frag_rx, data, len, &msg);
+    if (len == -EAGAIN)
+        return;     // more fragments to come
+    if (len < 0) {
+        dev_err(&rpdev->dev, "%s: dropped fragment: %d\n", __func__, len);
+        return;
+    }
+    response = msg;
+
 	// check length
-	if (len != sizeof(cfgMsg_t))
+	if ((len < CFG_MSG_HDR_LEN) || (len < (CFG_MSG_HDR_LEN + response->len)))
 	{
 		dev_info(&rpdev->dev, "CFG_MGMT %s: Message from BM application has wrong length.\n", __func__);
 		return;
 	}
 
-    dev_dbg(&rpdev->dev, "%s: processing reply with seq nr %d\n", __func__, response->seq);
-
-    // get the correct transaction struct
-    spin_lock(&pending_list_lock);
-    list_for_each_safe(pos, temp, &pending_list) // we delete the object from the list -> use safe version
-    {
-        // convert list_head pointer to a pointer to the list object
-        struct rpmsg_link_transaction* t = list_entry (pos, struct rpmsg_link_transaction, list);
+    trace_cfg_mgmt_reply(response->seq, response->type, response->ind, response->val, response->len);
 
-        if (t->msg_seq_nr == response->seq) {
-            // found it, remove it from the list
-            trans = t;
-            list_del(pos);
-            break;
-        }
+    // notifications don't belong to a request
+    if (response->type == RES_CHANGED) {
+        var_cache_invalidate(response->ind);
+        return;
     }
-    spin_unlock(&pending_list_lock);
+
+    // get the correct transaction struct and remove it from the pending ones
+    // The lock is held until the transaction is complete, so rpmsg_link_cancel can't recycle it meanwhile.
+    spin_lock_irqsave(&pending_lock, flags);
+    trans = __del_pend_trans(response->seq);
 
 	if (!trans)	{
-		dev_err(&rpdev->dev, "%s: cound not find a transaction for response with seq nr %d.\n",
+        // usually the reply to a request which timed out or was answered already (retransmission)
+        link_stats.unmatched++;
+        spin_unlock_irqrestore(&pending_lock, flags);
+        // expected with retransmissions, counted in the stats file
+		dev_dbg(&rpdev->dev, "%s: cound not find a transaction for response with seq nr %d.\n",
             __func__, response->seq);
 		return;
 	}
+    link_stats.replies++;
+    // round trip time from the first transmission, retransmissions don't restart it
+    rtt = (u32)ktime_us_delta(ktime_get(), trans->sent);
 
     // We could cross check that response type with the request type, however we don't know it
 
     switch (response->type) {
     case RES_OK:
-        dev_info(&rpmsg_chnl->dev, "%s: received OK responce", __func__);
         trans->len = 0;
-        trans->valid = true;
         trans->err = 0;
         break;
 
@@ -228,24 +399,28 @@ void cfg_mgmt_rpmsg_cb(struct rpmsg_channel *rpdev, void *data, int len, void *p
         // copy the number of variables to our global variable, no need to return it
         n_vars = response->val;
         trans->len = 0;        // no data in placed in io buffer
-        trans->valid = true;   // we got the answer
         break;
 
+    case RES_RD_VOL:
+        trans->no_cache = true;
+        // fall through
     case RES_RD_VAL:
     case RES_RD_MIN:
     case RES_RD_MAX:
-        // convert numerical results to a string for communication with the user space
-        trans->len =  scnprintf(trans->buf, IO_BUF_SIZE, "%d\n", response->val);
+        // convert numerical results to a string for communication with the user space, kernel users take the number
+        trans->val = response->val;
+        if (!trans->done)
+            trans->len =  scnprintf(trans->buf, trans->buf_size, "%d\n", response->val);
         trans->err = 0;
-        trans->valid = true;
         break;
 
     case RES_NAME:
     case RES_DESC:
-      if (response->len > IO_BUF_SIZE-1) {// -1 for \0 termination
+    case RES_STATS:
+      if (response->len > trans->buf_size-1) {// -1 for \0 termination
             dev_err(&rpdev->dev, "%s: data part of response too long\n", __func__);
             trans->err = -EINVAL;
-            trans->len = scnprintf(trans->buf, IO_BUF_SIZE-1, "data part of response too long\n");
+            trans->len = scnprintf(trans->buf, trans->buf_size-1, "data part of response too long\n");
 	    trans->buf[trans->len] = '\0';
         } else {
             // copy string response to io buffer
@@ -254,48 +429,57 @@ void cfg_mgmt_rpmsg_cb(struct rpmsg_channel *rpdev, void *data, int len, void *p
 	    trans->buf[trans->len] = '\0'; // make sure we have \0 termination
             trans->err = 0;
         }
-        trans->valid = true;
         break;
 
     case RES_ID_ERR:
-        trans->len = scnprintf(trans->buf, IO_BUF_SIZE,
+        trans->len = scnprintf(trans->buf, trans->buf_size,
             "received ID error for id %d in msg nr %d\n", response->ind, response->seq);
-        trans->valid = true;
         trans->err = RES_ID_ERR;
         break;
 
     case RES_REQ_ERR:
-        trans->len = scnprintf(trans->buf, IO_BUF_SIZE,
+        trans->len = scnprintf(trans->buf, trans->buf_size,
                 "received request error for msg nr %d\n", response->seq);
-        trans->valid = true;
         trans->err = RES_REQ_ERR;
         break;
 
     default:
-        trans->len = scnprintf(trans->buf, IO_BUF_SIZE,
+        trans->len = scnprintf(trans->buf, trans->buf_size,
             "unknonw type %d in msg nr %d\n", response->ind, response->seq);
-        trans->valid = true;
         trans->err = -1;
     }
 
-    dev_dbg(&rpdev->dev, "%s: waking waitqueue\n",__func__);
-
-    // wait any sleeping processes, a result is available
-    if (trans->wq)
-        wake_up_interruptible(trans->wq);
-    //wake_up(&(trans->wq));
-
-    dev_dbg(&rpdev->dev, "%s: done\n", __func__);
+    // always on statistics, bin 0: < 1us, bin i: 2^(i-1) to 2^i-1 us, the last bin includes all longer ones
+    link_stats.rtt_hist[min_t(int, fls(rtt), RPMSG_LINK_HIST_BINS-1)]++;
+    if (rtt > link_stats.rtt_max)
+        link_stats.rtt_max = rtt;
+    if (trans->err)
+        link_stats.errors++;
+    trace_cfg_mgmt_complete(trans->msg_seq_nr, trans->err, rtt);
+
+    // the result has to be complete before the owner sees valid, it doesn't take the lock
+    smp_wmb();
+    trans->valid = true;
+
+    if (trans->done) {
+        // submitted by rpmsg_link_submit, nobody else uses it. Call the owner without the lock, it may send the next
+        // request from done.
+        spin_unlock_irqrestore(&pending_lock, flags);
+        finish_async(trans);
+        return;
+    }
 
+    // wake the process waiting for this transaction only
+    wake_up_interruptible(&trans->wq);
+    spin_unlock_irqrestore(&pending_lock, flags);
 }
 
 
 // Query the number of config variables available at the remote side.
 // The process will be blocked until the answer from the bare metal application has arrived and the number of variables is returned.
-int get_n_vars(wait_queue_head_t* wq)
+int get_n_vars(void)
 {
     int ret;
-    static cfgMsg_t req;    // keep this static to save stack space
     struct rpmsg_link_transaction* t;
 
     if (!rpmsg_chnl)
@@ -303,13 +487,6 @@ int get_n_vars(wait_queue_head_t* wq)
 
 	dev_dbg(&rpmsg_chnl->dev, "%s: requesting n_vars\n", __func__);
 
-	// invalidate all request fields
-	req.seq = get_next_seq_nr();
-	req.ind = -1;
-	req.val = 0;
-	req.len = 0;
-	req.type = REQ_N_VARS;
-
 	// create a structure for this transaction
     t = rpmsg_link_alloc_trans();   // get an empty (or new) struct
     if (!t) {
@@ -317,25 +494,28 @@ int get_n_vars(wait_queue_head_t* wq)
         return -ENOMEM;
     }
 
-    t->msg_seq_nr = req.seq;    // rpmsg callback uses this for identification
-    t->wq = wq;
-
-    // add struct to list of pending transactions
-    add_pend_trans(t); // contains the necessary locking
-
-	// send the request to the other side,
-	ret = rpmsg_send(rpmsg_chnl, (void*)(&req), sizeof(req));
-	if (ret) {
-        dev_dbg(&rpmsg_chnl->dev, "%s: rpmsg send failed with %d\n", __func__, ret);
+	// invalidate all request fields
+	t->req.ind = -1;
+	t->req.val = 0;
+	t->req.len = 0;
+	t->req.type = REQ_N_VARS;
+
+	// send the request to the other side
+    ret = send_req(t, true);
+    if (ret) {
+        rpmsg_link_return_trans(t);
         return ret;
-	}
+    }
 
 	dev_dbg(&rpmsg_chnl->dev, "%s: message sent, waiting for reply\n", __func__);
 
 	// block calling user context until we receive a reply
-    ret = wait_event_interruptible((*wq), n_vars >= 0);
-    if (ret) {	// abort in case we got interrupted
-        dev_err(&rpmsg_chnl->dev, "%s: interrupted\n", __func__);
+    ret = rpmsg_link_wait(t);
+    if (!ret && t->err)
+        ret = -EIO;
+    rpmsg_link_return_trans(t);     // cancels the request if we got no reply
+    if (ret) {
+        dev_err(&rpmsg_chnl->dev, "%s: no reply: %d\n", __func__, ret);
         return ret;
     }
 
@@ -348,10 +528,11 @@ int get_n_vars(wait_queue_head_t* wq)
 int access_var(int index, access_t acc, struct rpmsg_link_transaction* t)
 {
     int ret;
-    static cfgMsg_t req;    // save stack space
+    cfgReq_t* req;          // kept in t, the sweep timer may have to send it again
+    long val;
 
     if (!rpmsg_chnl)
-        return -EINVAL;
+        return -ENODEV;
 
     if (!t) {
         dev_err(&rpmsg_chnl->dev, "%s: no transaction struct, abort\n", __func__);
@@ -359,116 +540,469 @@ int access_var(int index, access_t acc, struct rpmsg_link_transaction* t)
     }
 
   	// set all request fields
-	req.ind = index;
-	req.val = 0;
-	req.len = 0;
+    req = &t->req;
+	req->ind = index;
+	req->val = 0;
+	req->len = 0;
 	switch(acc) {
 	case ACC_VAL:
         if (t->rnw) {
-            req.type = REQ_RD_VAL;
+            req->type = REQ_RD_VAL;
         } else {
             // write
-            req.type = REQ_WR_VAL;
+            req->type = REQ_WR_VAL;
             // convert string to integer
-            ret = kstrtol(t->buf, 0, (long int*)&req.val);
+            ret = kstrtol(t->buf, 0, &val);
             if (ret) {
                 dev_err(&rpmsg_chnl->dev, "%s: can't parse string '%s' %d\n", __func__, t->buf, ret);
                 return ret;
             }
-            dev_dbg(&rpmsg_chnl->dev, "%s: writing val %ld to index %d\n", __func__, (long int)req.val, index);
+            req->val = val;
+            dev_dbg(&rpmsg_chnl->dev, "%s: writing val %ld to index %d\n", __func__, (long int)req->val, index);
         }
         break;
     case ACC_MIN:
-        req.type = REQ_RD_MIN;
+        req->type = REQ_RD_MIN;
         break;
 	case ACC_MAX:
-        req.type = REQ_RD_MAX;
+        req->type = REQ_RD_MAX;
         break;
     case ACC_DESC:
-        req.type = REQ_DESC;
+        req->type = REQ_DESC;
         break;
     case ACC_NAME:
-        req.type = REQ_NAME;
+        req->type = REQ_NAME;
+        break;
+    case ACC_STATS:
+        req->type = REQ_STATS;
         break;
     default:
         return -EINVAL;
 
 	}
-	req.seq = get_next_seq_nr();
-    t->msg_seq_nr = req.seq;    // rpmsg callback uses this for identification
-
-    // add struct to list of pending transactions
-    add_pend_trans(t); // contains the necessary locking
-
-    dev_dbg(&rpmsg_chnl->dev, "%s: sending message nr %d.\n", __func__, req.seq);
+    // text replies need a full size buffer, numbers fit into the small one
+    if ((req->type == REQ_DESC) || (req->type == REQ_NAME) || (req->type == REQ_STATS)) {
+        ret = rpmsg_link_trans_buf(t);
+        if (ret)
+            return ret;
+    }
 
-	// send the request to the other side,
-	ret = rpmsg_send(rpmsg_chnl, (void*)(&req), sizeof(req));
-	if (ret) {
-        dev_dbg(&rpmsg_chnl->dev, "%s: rpmsg send failed with %d\n", __func__, ret);
+    // send the request to the other side, on failure no reply will come and the caller still owns t
+    ret = send_req(t, true);
+    if (ret)
         return ret;
-	}
 
-    dev_dbg(&rpmsg_chnl->dev, "%s: done\n", __func__);
     return 0;
 }
 
 
-// get a pointer to an empty (unused) transaction struct or allocate a new one if necessary
+// send a request for variable index without the VFS and string conversions, done(priv, err, val) is called once it is
+// complete. acc is ACC_VAL, ACC_MIN or ACC_MAX, val is written if write is set (ACC_VAL only).
+// done is called from the rpmsg callback, the sweep timer or rpmsg_link_exit, so it must not sleep. It may submit the
+// next request. If gfp doesn't allow sleeping this may be called from atomic context, the request is sent from a work
+// item then.
+// returns 0 (done will be called) or a neg. error code (done is not called)
+int rpmsg_link_submit(int index, access_t acc, bool write, s32 val, rpmsg_link_done_t done, void* priv, gfp_t gfp)
+{
+    struct rpmsg_link_transaction* t;
+    u32 type;
+    int ret;
+
+    if (!done)
+        return -EINVAL;
+    // checked again when the transaction is allocated
+    if (!link_alive)
+        return -ENODEV;
+
+    switch (acc) {
+    case ACC_VAL:
+        type = write ? REQ_WR_VAL : REQ_RD_VAL;
+        break;
+    case ACC_MIN:
+        type = REQ_RD_MIN;
+        break;
+    case ACC_MAX:
+        type = REQ_RD_MAX;
+        break;
+    default:
+        return -EINVAL;
+    }
+    if (write && (acc != ACC_VAL))
+        return -EINVAL;
+
+    t = __rpmsg_link_alloc_trans(gfp);
+    if (!t)
+        return -ENOMEM;
+    t->rnw = !write;
+    t->done = done;
+    t->done_priv = priv;
+    t->req.ind = index;
+    t->req.val = write ? val : 0;
+    t->req.len = 0;
+    t->req.type = type;
+
+    ret = send_req(t, (gfp & __GFP_WAIT) != 0);
+    if (ret)
+        rpmsg_link_return_trans(t);
+    return ret;
+}
+
+
+// get an unused transaction struct from the pool, it has the small buffer only (see rpmsg_link_trans_buf)
+// Only the header is initialized, the buffer is not cleared. Must not be called from atomic context.
 // returns NULL if no memory is available
 struct rpmsg_link_transaction* rpmsg_link_alloc_trans()
 {
-    struct rpmsg_link_transaction* t = NULL;    // default assumption: no struct available
-
-    // try to reuse an empty struct
-    spin_lock(&unused_list_lock);
-    if (!list_empty(&unused_list)) {
-        // list is not empty, so simply grab the first entry
-        t = list_first_entry(&unused_list, struct rpmsg_link_transaction, list);
-        // remove it from the list of unused items, we will use it now ;)
-        list_del(&(t->list));
-    }
-    spin_unlock(&unused_list_lock);
+    return __rpmsg_link_alloc_trans(GFP_KERNEL);
+}
+
 
-    if (!(t)) {
-        // nothing found in the list, make a new one
-        t = kzalloc(sizeof(*t), GFP_KERNEL);
-        INIT_LIST_HEAD(&(t->list));
+// like rpmsg_link_alloc_trans, with GFP_ATOMIC this may be called from atomic context
+// Returns NULL if the link is not alive. The transaction keeps the pools, it may be returned after rpmsg_link_exit.
+struct rpmsg_link_transaction* __rpmsg_link_alloc_trans(gfp_t gfp)
+{
+    struct rpmsg_link_transaction* t;
+    unsigned long flags;
+    u32 session;
+
+    spin_lock_irqsave(&pending_lock, flags);
+    if (!link_alive) {
+        spin_unlock_irqrestore(&pending_lock, flags);
+        return NULL;
     }
+    // the link holds a reference while it is alive, so the pools exist
+    atomic_inc(&n_trans);
+    session = link_session;
+    spin_unlock_irqrestore(&pending_lock, flags);
 
-    memset((void*)t, 0, sizeof(*t));
+    t = mempool_alloc(trans_pool, gfp);
+    if (!t) {
+        put_pools();
+        return NULL;
+    }
 
+    t->session = session;
+    t->msg_seq_nr = 0;
+    t->len = 0;
+    t->buf = t->small;
+    t->buf_size = sizeof(t->small);
+    t->buf[0] = '\0';
+    t->dirty = false;
+    t->valid = false;
+    t->pending = false;
+    t->rnw = false;
+    t->err = 0;
+    t->val = 0;
+    t->no_cache = false;
+    t->cache_gen = 0;
+    t->done = NULL;
+    t->done_priv = NULL;
+    t->next_done = NULL;
+    t->file_index = -1;
+    t->file_acc = ACC_VAL;
+    init_waitqueue_head(&t->wq);
     return t;
 }
 
 
+// give t a buffer of IO_BUF_SIZE bytes (text replies), the content of the small buffer is not kept
+// returns 0 or -ENOMEM
+int rpmsg_link_trans_buf(struct rpmsg_link_transaction* t)
+{
+    char* buf;
+
+    if (t->buf != t->small)
+        return 0;   // has one already
+    buf = kmem_cache_alloc(buf_cache, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+    buf[0] = '\0';
+    t->buf = buf;
+    t->buf_size = IO_BUF_SIZE;
+    return 0;
+}
+
+
 void rpmsg_link_return_trans(struct rpmsg_link_transaction* trans)
 {
-    // recycle transaction struct
-    memset(trans, 0, sizeof(*trans));   // clear content, just to be sure
-    spin_lock(&unused_list_lock);
-    list_add(&(trans->list), &unused_list);
-    spin_unlock(&unused_list_lock);
+    // a reply must not be written to the struct once it is recycled
+    rpmsg_link_cancel(trans);
+
+    if (trans->buf != trans->small)
+        kmem_cache_free(buf_cache, trans->buf);
+    mempool_free(trans, trans_pool);
+    put_pools();
+}
+
+
+// wait until t is complete (t->valid): the reply has arrived or the sweep timer gave up on the request
+// returns 0, -ETIMEDOUT (no reply within the budget, see timeout_ms and retries), -ENODEV (channel removed) or
+// -ERESTARTSYS if a signal arrived (the request is still pending, so the caller may wait again,
+// rpmsg_link_return_trans cancels it)
+int rpmsg_link_wait(struct rpmsg_link_transaction* t)
+{
+    int ret;
+
+    ret = wait_event_interruptible(t->wq, t->valid);
+    if (ret)
+        return ret;
+    smp_rmb();  // don't read the result before valid
+    if ((t->err == -ETIMEDOUT) || (t->err == -ENODEV))
+        return t->err;
+    return 0;
+}
+
+
+void rpmsg_link_get_stats(struct rpmsg_link_stats* s)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&pending_lock, flags);
+    *s = link_stats;
+    s->pending = n_pending;
+    spin_unlock_irqrestore(&pending_lock, flags);
+}
+
+
+// returns true if t was allocated for a channel which has been removed meanwhile (its result belongs to the old firmware)
+bool rpmsg_link_trans_stale(struct rpmsg_link_transaction* t)
+{
+    unsigned long flags;
+    bool ret;
+
+    spin_lock_irqsave(&pending_lock, flags);
+    ret = !link_alive || (t->session != link_session);
+    spin_unlock_irqrestore(&pending_lock, flags);
+    return ret;
+}
+
+
+// remove t from the pending transactions (if it is), the rpmsg callback doesn't touch it afterwards
+void rpmsg_link_cancel(struct rpmsg_link_transaction* t)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&pending_lock, flags);
+    if (t->pending)
+        __del_pend_trans(t->msg_seq_nr);
+    spin_unlock_irqrestore(&pending_lock, flags);
+}
+
+
+// assign the next free sequence number to t (and t->req) and make it a pending transaction with a deadline
+// The sequence number is taken from an atomic counter. Its slot is usually free, if it is still used by an old
+// request (which never got a reply) further numbers are tried. Only reads are retransmitted, the firmware doesn't
+// detect duplicates so repeating a write is not safe.
+// queue: the request is sent by resend_work (the caller can't sleep)
+// returns 0, -EBUSY if all slots are in use or -ENODEV if the link is stopped (or t belongs to a removed channel)
+static int add_pend_trans(struct rpmsg_link_transaction* t, bool queue)
+{
+    unsigned long flags;
+    u32 seq;
+    int i;
+
+    for (i=0; i<PENDING_SLOTS; i++) {
+        seq = (u32)atomic_inc_return(&next_seq) - 1;
+        spin_lock_irqsave(&pending_lock, flags);
+        if (!link_alive || (t->session != link_session)) {
+            spin_unlock_irqrestore(&pending_lock, flags);
+            return -ENODEV;
+        }
+        if (!pending[seq & (PENDING_SLOTS-1)]) {
+            t->msg_seq_nr = seq;
+            t->req.seq = seq;
+            t->sent = ktime_get();
+            t->deadline = ktime_add_ms(t->sent, timeout_ms);
+            t->retries_left = (t->req.type == REQ_WR_VAL) ? 0 : retries;
+            t->resend = queue;
+            t->pending = true;
+            pending[seq & (PENDING_SLOTS-1)] = t;
+            link_stats.requests++;
+            // t may be completed and freed as soon as the lock is released (done callback)
+            trace_cfg_mgmt_submit(seq, t->req.type, t->req.ind);
+            if (n_pending++ == 0)
+                hrtimer_start(&sweep_timer, ms_to_ktime(SWEEP_PERIOD_MS), HRTIMER_MODE_REL);
+            spin_unlock_irqrestore(&pending_lock, flags);
+            if (queue)
+                schedule_work(&resend_work);
+            return 0;
+        }
+        spin_unlock_irqrestore(&pending_lock, flags);
+    }
+    return -EBUSY;
+}
+
+
+// remove the pending transaction with sequence number seq, returns it or NULL if there is none
+// pending_lock has to be held by the caller
+static struct rpmsg_link_transaction* __del_pend_trans(u32 seq)
+{
+    struct rpmsg_link_transaction* t = pending[seq & (PENDING_SLOTS-1)];
+
+    if (t && (t->msg_seq_nr == seq)) {
+        pending[seq & (PENDING_SLOTS-1)] = NULL;
+        t->pending = false;
+        t->resend = false;
+        n_pending--;
+        return t;
+    }
+    return NULL;
 }
 
 
-// returns the next message sequence number to be used (protected by in built in spin lock)
-static u32 get_next_seq_nr(void)
+static struct rpmsg_link_transaction* del_pend_trans(u32 seq)
 {
-    // message sequence number (for request / response matching) of next request to be sent
-    static u32 msg_seq_nr = 0;  // start a zero
-    u32 ret;
-    spin_lock(&seq_lock);
-    ret = msg_seq_nr;
-    msg_seq_nr++;
-    spin_unlock(&seq_lock);
+    struct rpmsg_link_transaction* t;
+    unsigned long flags;
+
+    spin_lock_irqsave(&pending_lock, flags);
+    t = __del_pend_trans(seq);
+    spin_unlock_irqrestore(&pending_lock, flags);
+    return t;
+}
+
+
+// make t pending and send its request (t->req). If the caller may not sleep the request is queued and sent from
+// resend_work.
+// returns 0 or a neg. error code, t is not pending in this case (except for a transaction with a done callback which
+// was completed meanwhile, 0 is returned then)
+static int send_req(struct rpmsg_link_transaction* t, bool may_sleep)
+{
+    bool async = (t->done != NULL);
+    u32 seq;
+    int ret;
+
+    // add struct to the pending transactions, this assigns the sequence number which the rpmsg callback uses for
+    // identification
+    t->valid = false;
+    t->err = 0;
+    ret = add_pend_trans(t, !may_sleep);
+    if (ret) {
+        if (ret == -EBUSY)
+            dev_err_ratelimited(&rpmsg_chnl->dev, "%s: too many pending requests\n", __func__);
+        return ret;
+    }
+    if (!may_sleep)
+        return 0;
+    seq = t->msg_seq_nr;
+
+    // requests have no data section. t must not be used after a successful send if it has a done callback, it may
+    // be completed and freed already.
+    ret = rpmsg_frag_send(rpmsg_chnl, &frag_tx, (void*)(&t->req), sizeof(t->req));
+    if (ret) {
+        dev_dbg(&rpmsg_chnl->dev, "%s: rpmsg send failed with %d\n", __func__, ret);
+        // rpmsg_send may wait for a buffer, the sweep timer could have completed t meanwhile
+        if (!del_pend_trans(seq) && async)
+            return 0;
+    }
     return ret;
 }
 
 
-static inline void add_pend_trans(struct rpmsg_link_transaction* t)
+// complete a transaction of rpmsg_link_submit: tell the owner and free t, pending_lock must not be held
+static void finish_async(struct rpmsg_link_transaction* t)
+{
+    int err = t->err;
+
+    // firmware error codes are positive
+    if (err == RES_ID_ERR)
+        err = -EINVAL;
+    else if (err && (err != -ETIMEDOUT) && (err != -ENODEV))
+        err = -EIO;
+    if (t->req.type == REQ_WR_VAL)
+        var_cache_invalidate(t->req.ind);
+    t->done(t->done_priv, err, t->val);
+    rpmsg_link_return_trans(t);
+}
+
+
+static void finish_async_list(struct rpmsg_link_transaction* t)
+{
+    struct rpmsg_link_transaction* next;
+
+    while (t) {
+        next = t->next_done;
+        finish_async(t);
+        t = next;
+    }
+}
+
+
+// sweep timer callback (hard irq context): completes pending transactions whose deadline has passed with
+// -ETIMEDOUT, or schedules a retransmission if it is a read with retries left. Runs while requests are pending.
+static enum hrtimer_restart sweep(struct hrtimer* timer)
 {
-    spin_lock(&pending_list_lock);
-    list_add(&t->list, &pending_list);
-    spin_unlock(&pending_list_lock);
+    struct rpmsg_link_transaction* t;
+    struct rpmsg_link_transaction* done_list = NULL;
+    ktime_t now = ktime_get();
+    bool resend_needed = false;
+    int i, n;
+
+    spin_lock(&pending_lock);
+    for (i=0; i<PENDING_SLOTS; i++) {
+        t = pending[i];
+        if (!t || ktime_before(now, t->deadline))
+            continue;
+        if (t->retries_left > 0) {
+            t->retries_left--;
+            t->deadline = ktime_add_ms(now, timeout_ms);
+            t->resend = true;
+            resend_needed = true;
+            link_stats.retries++;
+            trace_cfg_mgmt_retry(t->msg_seq_nr, t->req.type, t->req.ind);
+        } else {
+            __del_pend_trans(t->msg_seq_nr);
+            t->err = -ETIMEDOUT;
+            t->len = 0;
+            smp_wmb();
+            t->valid = true;
+            if (t->done) {
+                t->next_done = done_list;
+                done_list = t;
+            } else {
+                wake_up_interruptible(&t->wq);
+            }
+            link_stats.timeouts++;
+            trace_cfg_mgmt_timeout(t->msg_seq_nr, t->req.type, t->req.ind);
+        }
+    }
+    n = n_pending;
+    spin_unlock(&pending_lock);
+    finish_async_list(done_list);
+
+    if (resend_needed)
+        schedule_work(&resend_work);
+    // add_pend_trans restarts the timer when a new request is sent
+    if (n == 0)
+        return HRTIMER_NORESTART;
+    hrtimer_forward_now(timer, ms_to_ktime(SWEEP_PERIOD_MS));
+    return HRTIMER_RESTART;
+}
+
+
+// retransmit the requests marked by the sweep timer, sending may sleep so this is done in a work item
+static void resend(struct work_struct* work)
+{
+    struct rpmsg_link_transaction* t;
+    unsigned long flags;
+    cfgReq_t req;
+    int i, ret;
+
+    for (i=0; i<PENDING_SLOTS; i++) {
+        spin_lock_irqsave(&pending_lock, flags);
+        t = pending[i];
+        if (!t || !t->resend) {
+            spin_unlock_irqrestore(&pending_lock, flags);
+            continue;
+        }
+        // copy the request, t may complete and be returned as soon as the lock is released
+        t->resend = false;
+        req = t->req;
+        spin_unlock_irqrestore(&pending_lock, flags);
+
+        dev_dbg(&rpmsg_chnl->dev, "%s: retransmitting msg nr %d\n", __func__, req.seq);
+        ret = rpmsg_frag_send(rpmsg_chnl, &frag_tx, (void*)(&req), sizeof(req));
+        if (ret)
+            dev_err(&rpmsg_chnl->dev, "%s: rpmsg send failed with %d\n", __func__, ret);
+    }
 }
@@ -5,22 +5,32 @@
 
 
 #include <linux/wait.h>
+#include <linux/stddef.h>
+#include <linux/ktime.h>
 
 
 // configure size (max length) of the data field in messages exchanged with BM application
-//#define MSG_DATA_SIZE 	(DATA_LEN_MAX-sizeof(cfgMsg_t))
-// This is a super uggly hack, I have not found a good solution yet. (Total message length is 512 bytes, leave
-// space for headers
-#define MSG_DATA_SIZE 	(400)
+// Messages are fragmented (rpmsg_frag.c), so they are not limited to one rpmsg buffer. Only the used part of the
+// data field is transmitted. This has to match the BM firmware.
+#define MSG_DATA_SIZE 	(1024)
 
 
 // file IOs are made to a buffer in kernel space, define its length
 // as we read/write up to the max transport capability of the underlying comm channel reserve that amount
 #define IO_BUF_SIZE         MSG_DATA_SIZE
 
+// size of the buffer embedded in each transaction, enough for numbers and short error messages. Transactions which
+// transfer text get an IO_BUF_SIZE buffer (rpmsg_link_trans_buf)
+#define TRANS_SMALL_BUF_SIZE    48
+
+// number of bins of the round trip time histogram (struct rpmsg_link_stats): bin 0 counts requests which took less
+// than 1us, bin i (i>0) those which took 2^(i-1) to 2^i-1 us, the last bin includes all longer ones
+#define RPMSG_LINK_HIST_BINS    24
+
 
 // define an enum which tells the read/write functions what aspect of a var is accessed
-typedef enum {ACC_NAME, ACC_VAL, ACC_MIN, ACC_MAX, ACC_DESC} access_t;
+// ACC_STATS reads the firmware's transport statistics (as text), the index selects the part (see fw_stats file)
+typedef enum {ACC_NAME, ACC_VAL, ACC_MIN, ACC_MAX, ACC_DESC, ACC_STATS} access_t;
 
 
 // struct exchanged with bare metal firmware for communication (can be a request or a response)
@@ -31,21 +41,66 @@ typedef struct __attribute__((packed))       // make sure it has no holes (kerne
     int32_t     ind;    // config variable index (<0 means unkown/undefined)
     int32_t     val;    // numerical value (for WR req, RD resp, etc)
     uint32_t    len;    // length of data section (in bytes)
-    uint8_t     data[MSG_DATA_SIZE]; // opt. data section, total message has to fit into TX_BUFFER_SIZE of rpmsg
+    uint8_t     data[MSG_DATA_SIZE]; // opt. data section, only len bytes are transmitted
 } cfgMsg_t;
 
-// transaction struct: all information for one request, chained in a lists of pending, unused, etc transactions
-// also contains the buffers used for IO (communication with the user process)
+// length of a message without data section
+#define CFG_MSG_HDR_LEN     offsetof(cfgMsg_t, data)
+
+// requests sent to the firmware have no data section, they are just the header of cfgMsg_t
+typedef struct __attribute__((packed))
+{
+    uint32_t    seq;
+    uint32_t    type;
+    int32_t     ind;
+    int32_t     val;
+    uint32_t    len;    // always 0
+} cfgReq_t;
+
+// completion callback of rpmsg_link_submit, err is 0 or a neg. error code, val the value read
+typedef void (*rpmsg_link_done_t)(void* priv, int err, s32 val);
+
+// transaction struct: all information for one request, pending transactions are kept in a table indexed by their
+// sequence number. Also contains the buffer used for IO (communication with the user process)
 struct rpmsg_link_transaction {
-    struct  list_head list;  // used to chain the transactions
-    u32     msg_seq_nr;         // cfg_mgmt sequence number used in the request
+    u32     session;            // channel the transaction was allocated for, see add_pend_trans
+    u32     msg_seq_nr;         // cfg_mgmt sequence number used in the request (assigned by access_var)
     ssize_t len;                // length of string in buf
-    char    buf[IO_BUF_SIZE];
+    char*   buf;                // small or an IO_BUF_SIZE buffer
+    size_t  buf_size;
     bool    dirty;                 // true if buffer was modified (by user space application)
     bool    valid;                 // true once data has arrived (in case of async io)
+    bool    pending;               // request sent, waiting for the reply (protected by the pending lock)
     bool    rnw;                   // read-not-write flag to determine direction of var access
     int     err;                    // error code (neg value) if access failed
-    wait_queue_head_t* wq;       // wait queue used to block the process reading this file
+    s32     val;                    // numerical value of the reply (value, min, max)
+    bool    no_cache;               // the value must not be cached (read callback in the firmware)
+    u32     cache_gen;              // var_cache generation when the request was sent
+    int     file_index;             // variable index and access type of the debugfs file which owns the transaction,
+    access_t file_acc;              // copied at open (the file's inode data is freed with the channel)
+    rpmsg_link_done_t done;         // called on completion instead of waking wq (rpmsg_link_submit)
+    void*   done_priv;
+    struct rpmsg_link_transaction* next_done;   // list of completed transactions, done is called without the lock
+    wait_queue_head_t wq;        // the owner waits here for the reply (rpmsg_link_wait or poll)
+    cfgReq_t req;                   // the request as sent, kept for retransmissions
+    ktime_t sent;                   // first transmission of the request (round trip time)
+    ktime_t deadline;               // the sweep timer retransmits or times out the request after this
+    int     retries_left;
+    bool    resend;                 // marked for retransmission by the sweep timer
+    char    small[TRANS_SMALL_BUF_SIZE];
+};
+
+// counters of the link, see rpmsg_link_get_stats
+struct rpmsg_link_stats {
+    u32     requests;           // requests sent (not counting retransmissions)
+    u32     replies;            // replies matched to a pending request
+    u32     retries;            // retransmitted read requests
+    u32     timeouts;           // requests completed with -ETIMEDOUT
+    u32     unmatched;          // replies without pending request (late or duplicate)
+    u32     errors;             // replies reporting an error (unknown index or request)
+    u32     pending;            // requests waiting for a reply right now
+    u32     rtt_max;            // longest round trip time (us)
+    u32     rtt_hist[RPMSG_LINK_HIST_BINS];  // log2 histogram of the round trip times of all replies
 };
 
 
@@ -53,14 +108,30 @@ int rpmsg_link_init(struct rpmsg_channel *ch);
 
 void rpmsg_link_exit(void);
 
-int get_n_vars(wait_queue_head_t* wq);
+void rpmsg_link_cleanup(void);
+
+int get_n_vars(void);
 
 struct rpmsg_link_transaction* rpmsg_link_alloc_trans(void);
 
+struct rpmsg_link_transaction* __rpmsg_link_alloc_trans(gfp_t gfp);
+
+int rpmsg_link_trans_buf(struct rpmsg_link_transaction* t);
+
 void rpmsg_link_return_trans(struct rpmsg_link_transaction* trans);
 
 int access_var(int index, access_t acc, struct rpmsg_link_transaction* t);
 
+int rpmsg_link_submit(int index, access_t acc, bool write, s32 val, rpmsg_link_done_t done, void* priv, gfp_t gfp);
+
+int rpmsg_link_wait(struct rpmsg_link_transaction* t);
+
+void rpmsg_link_cancel(struct rpmsg_link_transaction* t);
+
+bool rpmsg_link_trans_stale(struct rpmsg_link_transaction* t);
+
+void rpmsg_link_get_stats(struct rpmsg_link_stats* s);
+
 void cfg_mgmt_rpmsg_cb(struct rpmsg_channel *rpdev, void *data, int len, void *priv, u32 src);
 
 #endif
@@ -0,0 +1,359 @@
+/***********************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*
+* (c) 2015 Lukas Schrittwieser (LS)
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 2 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program; if not, write to the Free Software
+*    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*    Or see <http://www.gnu.org/licenses/>
+*
+************************************************************************************************************************
+*
+* var_cache.c
+*
+* Cache of the config variables on the kernel side, so repeated reads don't have to cross to the other core.
+* Min, max and description don't change while the firmware runs, they are fetched once per session (probe to remove).
+* Values are invalidated when they are written (debugfs_write_var) and when the firmware reports a change
+* (RES_CHANGED notification), in addition a max. age can be given for each lookup. Values which the firmware reads
+* through a callback are never cached (RES_RD_VOL).
+* The variable names are kept as well, the kernel API looks variables up by name (cfg_mgmt_lookup).
+*
+************************************************************************************************************************/
+
+//#define DEBUG
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/jiffies.h>
+#include <linux/rpmsg.h>
+
+#include "rpmsg_link.h"
+#include "var_cache.h"
+
+
+// flags in var_cache_entry.valid
+#define VC_VAL      0x01
+#define VC_MIN      0x02
+#define VC_MAX      0x04
+
+
+
+/************************************************************************************************************************
+*   T Y P E S
+*/
+
+struct var_cache_entry {
+    u32     gen;            // incremented whenever the value is invalidated
+    u8      valid;          // VC_* flags
+    s32     val;
+    s32     min;
+    s32     max;
+    unsigned long val_time; // jiffies when val was stored
+    char*   desc;           // NULL until fetched
+    size_t  desc_len;
+    char*   name;           // set when the variable list is loaded, used for lookups
+};
+
+
+
+/************************************************************************************************************************
+*   G L O B A L S
+*/
+
+static struct var_cache_entry* entries = NULL;
+static int n_entries = 0;
+
+// protects entries, notifications are processed in the rpmsg callback
+static DEFINE_SPINLOCK(cache_lock);
+
+static struct var_cache_stats cache_stats;
+
+
+
+/************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+// allocate an empty cache for n_vars variables, a previous one is dropped
+int var_cache_init(int n_vars)
+{
+    struct var_cache_entry* e;
+    unsigned long flags;
+
+    e = kcalloc(n_vars, sizeof(*e), GFP_KERNEL);
+    if (!e)
+        return -ENOMEM;
+    var_cache_free();
+    spin_lock_irqsave(&cache_lock, flags);
+    entries = e;
+    n_entries = n_vars;
+    memset(&cache_stats, 0, sizeof(cache_stats));
+    spin_unlock_irqrestore(&cache_lock, flags);
+    return 0;
+}
+
+
+// drop the cache, this ends the session (the next firmware may have different variables)
+void var_cache_free(void)
+{
+    struct var_cache_entry* e;
+    unsigned long flags;
+    int i, n;
+
+    spin_lock_irqsave(&cache_lock, flags);
+    e = entries;
+    n = n_entries;
+    entries = NULL;
+    n_entries = 0;
+    spin_unlock_irqrestore(&cache_lock, flags);
+
+    if (!e)
+        return;
+    for (i=0; i<n; i++) {
+        kfree(e[i].desc);
+        kfree(e[i].name);
+    }
+    kfree(e);
+}
+
+
+// number of variables of this session, 0 if the variable list wasn't loaded
+int var_cache_size(void)
+{
+    return n_entries;
+}
+
+
+// remember the name of variable index (copied), may sleep
+void var_cache_set_name(int index, const char* name)
+{
+    unsigned long flags;
+    char* n;
+
+    n = kstrdup(name, GFP_KERNEL);
+    if (!n)
+        return;
+    spin_lock_irqsave(&cache_lock, flags);
+    if ((index >= 0) && (index < n_entries) && !entries[index].name) {
+        entries[index].name = n;
+        n = NULL;
+    }
+    spin_unlock_irqrestore(&cache_lock, flags);
+    kfree(n);
+}
+
+
+// returns the index of the variable called name or -ENOENT
+int var_cache_lookup(const char* name)
+{
+    unsigned long flags;
+    int i, ret = -ENOENT;
+
+    spin_lock_irqsave(&cache_lock, flags);
+    for (i=0; i<n_entries; i++) {
+        if (entries[i].name && !strcmp(entries[i].name, name)) {
+            ret = i;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&cache_lock, flags);
+    return ret;
+}
+
+
+// copy the name of variable index to buf (truncated to size-1 chars)
+// returns false if the name is unknown
+bool var_cache_get_name(int index, char* buf, size_t size)
+{
+    unsigned long flags;
+    bool ret = false;
+
+    spin_lock_irqsave(&cache_lock, flags);
+    if ((index >= 0) && (index < n_entries) && entries[index].name) {
+        strlcpy(buf, entries[index].name, size);
+        ret = true;
+    }
+    spin_unlock_irqrestore(&cache_lock, flags);
+    return ret;
+}
+
+
+// generation of the value of variable index, has to be read before the request is sent (see var_cache_put)
+u32 var_cache_gen(int index)
+{
+    unsigned long flags;
+    u32 gen = 0;
+
+    spin_lock_irqsave(&cache_lock, flags);
+    if ((index >= 0) && (index < n_entries))
+        gen = entries[index].gen;
+    spin_unlock_irqrestore(&cache_lock, flags);
+    return gen;
+}
+
+
+// complete t with the cached value of acc for variable index, values older than max_age_ms are not used
+// (0: values are not taken from the cache). For ACC_DESC t needs an IO_BUF_SIZE buffer (rpmsg_link_trans_buf).
+// returns 1 if t is complete (t->valid), 0 if the value has to be requested from the firmware
+int var_cache_get(int index, access_t acc, struct rpmsg_link_transaction* t, unsigned int max_age_ms)
+{
+    struct var_cache_entry* e;
+    unsigned long flags;
+    int hit = 0;
+    bool num = true;    // reply is a number, printed below
+    s32 val = 0;
+
+    spin_lock_irqsave(&cache_lock, flags);
+    if ((index < 0) || (index >= n_entries))
+        goto out;
+    e = &entries[index];
+
+    switch (acc) {
+    case ACC_VAL:
+        if ((e->valid & VC_VAL) && max_age_ms &&
+            time_before(jiffies, e->val_time + msecs_to_jiffies(max_age_ms))) {
+            val = e->val;
+            hit = 1;
+        }
+        break;
+    case ACC_MIN:
+        if (e->valid & VC_MIN) {
+            val = e->min;
+            hit = 1;
+        }
+        break;
+    case ACC_MAX:
+        if (e->valid & VC_MAX) {
+            val = e->max;
+            hit = 1;
+        }
+        break;
+    case ACC_DESC:
+        if (e->desc && (e->desc_len < t->buf_size)) {
+            memcpy(t->buf, e->desc, e->desc_len);
+            t->buf[e->desc_len] = '\0';
+            t->len = e->desc_len;
+            num = false;
+            hit = 1;
+        }
+        break;
+    default:
+        break;
+    }
+out:
+    if (hit)
+        cache_stats.hits++;
+    else
+        cache_stats.misses++;
+    spin_unlock_irqrestore(&cache_lock, flags);
+
+    if (!hit)
+        return 0;
+    if (num) {
+        t->val = val;
+        t->len = scnprintf(t->buf, t->buf_size, "%d\n", val);  // same format as the replies
+    }
+    t->err = 0;
+    t->valid = true;
+    return 1;
+}
+
+
+// store the reply of the completed read t (acc of variable index) in the cache. Values are stored only if they were not
+// invalidated since the request was sent (t->cache_gen), otherwise they might be stale already.
+void var_cache_put(int index, access_t acc, struct rpmsg_link_transaction* t)
+{
+    struct var_cache_entry* e;
+    unsigned long flags;
+    char* desc = NULL;
+
+    if (!t->valid || t->err || t->no_cache)
+        return;
+    if (acc == ACC_DESC) {
+        // allocate outside of the lock, the description is kept for the whole session
+        desc = kmalloc(t->len, GFP_KERNEL);
+        if (!desc)
+            return;
+        memcpy(desc, t->buf, t->len);
+    }
+
+    spin_lock_irqsave(&cache_lock, flags);
+    if ((index < 0) || (index >= n_entries))
+        goto out;
+    e = &entries[index];
+
+    switch (acc) {
+    case ACC_VAL:
+        if (e->gen == t->cache_gen) {
+            e->val = t->val;
+            e->val_time = jiffies;
+            e->valid |= VC_VAL;
+        }
+        break;
+    case ACC_MIN:
+        e->min = t->val;
+        e->valid |= VC_MIN;
+        break;
+    case ACC_MAX:
+        e->max = t->val;
+        e->valid |= VC_MAX;
+        break;
+    case ACC_DESC:
+        if (!e->desc) {
+            e->desc = desc;
+            e->desc_len = t->len;
+            desc = NULL;
+        }
+        break;
+    default:
+        break;
+    }
+out:
+    spin_unlock_irqrestore(&cache_lock, flags);
+    kfree(desc);    // not used
+}
+
+
+// the value of variable index has changed (or may have), index < 0 invalidates all values. May be called from the
+// rpmsg callback.
+void var_cache_invalidate(int index)
+{
+    unsigned long flags;
+    int i, first, last;
+
+    spin_lock_irqsave(&cache_lock, flags);
+    // a single entry (the usual case after a write) is indexed directly
+    first = (index < 0) ? 0 : index;
+    last = (index < 0) ? n_entries : min(index+1, n_entries);
+    for (i=first; i<last; i++) {
+        entries[i].gen++;
+        entries[i].valid &= ~VC_VAL;
+    }
+    cache_stats.invalidations++;
+    spin_unlock_irqrestore(&cache_lock, flags);
+}
+
+
+void var_cache_get_stats(struct var_cache_stats* s)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&cache_lock, flags);
+    *s = cache_stats;
+    spin_unlock_irqrestore(&cache_lock, flags);
+}
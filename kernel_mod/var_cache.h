@@ -0,0 +1,42 @@
+
+
+#ifndef __VAR_CACHE__
+#define __VAR_CACHE__
+
+
+#include <linux/types.h>
+
+#include "rpmsg_link.h"
+
+
+// counters of the cache, see var_cache_get_stats
+struct var_cache_stats {
+    u32     hits;           // lookups answered from the cache
+    u32     misses;         // lookups which need a request to the firmware
+    u32     invalidations;  // writes and change notifications of the firmware
+};
+
+
+int var_cache_init(int n_vars);
+
+void var_cache_free(void);
+
+int var_cache_size(void);
+
+void var_cache_set_name(int index, const char* name);
+
+int var_cache_lookup(const char* name);
+
+bool var_cache_get_name(int index, char* buf, size_t size);
+
+u32 var_cache_gen(int index);
+
+int var_cache_get(int index, access_t acc, struct rpmsg_link_transaction* t, unsigned int max_age_ms);
+
+void var_cache_put(int index, access_t acc, struct rpmsg_link_transaction* t);
+
+void var_cache_invalidate(int index);
+
+void var_cache_get_stats(struct var_cache_stats* s);
+
+#endif
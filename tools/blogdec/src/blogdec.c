@@ -0,0 +1,287 @@
+/******************************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*   Linux user space applications and cli tools
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   blogdec.c
+*
+*   Decoder for the firmware's binary log (bm_fw/src/blog.h): reads the records from the fw_blog debugfs file and the
+*   format strings from the .blog_fmt section of the firmware's ELF file and prints the messages oldest first.
+*
+******************************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <elf.h>
+
+#define DFLT_LOG    "/debug/cfg_mgmt/fw_blog"
+#define DFLT_ELF    "/lib/firmware/firmware"
+
+// the zynq's global timer runs at half the cpu clock
+#define DFLT_COUNTS_PER_SECOND  333333333
+
+// see bm_fw/src/blog.h
+#define BLOG_MAX_ARGS   5
+#define BLOG_FMT_ALIGN  8
+
+#define FMT_SECTION     ".blog_fmt"
+
+
+
+/******************************************************************************************************************************
+*   S T R U C T S
+*/
+
+// one log record (struct blog_rec in bm_fw/src/blog.h)
+struct blog_rec {
+    uint32_t fmt;
+    uint32_t time_lo;
+    uint32_t time_hi;
+    uint32_t arg[BLOG_MAX_ARGS];
+};
+
+// the format string section of the firmware
+struct fmt_section {
+    uint32_t addr;
+    uint32_t size;
+    char* data;
+};
+
+
+
+/******************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+char* load(const char* fn, size_t* len);
+
+int find_fmt_section(char* elf, size_t len, struct fmt_section* s);
+
+void print_rec(const struct blog_rec* r, const struct fmt_section* s, double cps);
+
+void help();
+
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+int main(int argc, char** argv)
+{
+    const char* log_fn = DFLT_LOG;
+    const char* elf_fn = DFLT_ELF;
+    double cps = DFLT_COUNTS_PER_SECOND;
+    struct fmt_section sec;
+    size_t elf_len, log_len;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:l:c:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'e':
+            elf_fn = optarg;
+            break;
+        case 'l':
+            log_fn = optarg;
+            break;
+        case 'c':
+            cps = strtod(optarg, NULL);
+            break;
+        default:
+            help();
+            return 1;
+        }
+    }
+    if (cps <= 0)
+    {
+        help();
+        return 1;
+    }
+
+    char* elf = load(elf_fn, &elf_len);
+    if (!elf)
+        return 1;
+    if (find_fmt_section(elf, elf_len, &sec))
+    {
+        fprintf(stderr, "%s has no valid %s section\n", elf_fn, FMT_SECTION);
+        return 1;
+    }
+
+    char* log = load(log_fn, &log_len);
+    if (!log)
+        return 1;
+    // the kernel module copies the records oldest first
+    for (size_t ofs=0; (ofs+sizeof(struct blog_rec)) <= log_len; ofs+=sizeof(struct blog_rec))
+    {
+        struct blog_rec r;
+        memcpy(&r, log+ofs, sizeof(r));
+        print_rec(&r, &sec, cps);
+    }
+
+    free(log);
+    free(elf);
+    return 0;
+}
+
+
+// read a whole file (debugfs files have no size, so read until eof), returns a malloced buffer or NULL
+char* load(const char* fn, size_t* len)
+{
+    FILE* fp = fopen(fn, "rb");
+    if (!fp)
+    {
+        perror(fn);
+        return NULL;
+    }
+
+    size_t size = 0x10000;
+    char* buf = malloc(size);
+    *len = 0;
+    while (buf)
+    {
+        *len += fread(buf + *len, 1, size - *len, fp);
+        if (*len < size)
+            break;
+        size *= 2;
+        char* p = realloc(buf, size);
+        if (!p)
+            free(buf);
+        buf = p;
+    }
+    if (!buf || ferror(fp))
+    {
+        fprintf(stderr, "can't read %s\n", fn);
+        free(buf);
+        buf = NULL;
+    }
+    fclose(fp);
+    return buf;
+}
+
+
+// locate the format strings in the firmware (32 bit little endian ELF), returns 0 on success
+int find_fmt_section(char* elf, size_t len, struct fmt_section* s)
+{
+    Elf32_Ehdr* eh = (Elf32_Ehdr*)elf;
+
+    if ((len < sizeof(*eh)) || memcmp(eh->e_ident, ELFMAG, SELFMAG) || (eh->e_ident[EI_CLASS] != ELFCLASS32) ||
+        (eh->e_ident[EI_DATA] != ELFDATA2LSB))
+        return -1;
+    if ((eh->e_shoff + (size_t)eh->e_shnum * sizeof(Elf32_Shdr)) > len || (eh->e_shstrndx >= eh->e_shnum))
+        return -1;
+
+    Elf32_Shdr* sh = (Elf32_Shdr*)(elf + eh->e_shoff);
+    Elf32_Shdr* strtab = &sh[eh->e_shstrndx];
+    for (int i=0; i<eh->e_shnum; i++)
+    {
+        if (sh[i].sh_name >= strtab->sh_size)
+            continue;
+        if (strcmp(elf + strtab->sh_offset + sh[i].sh_name, FMT_SECTION))
+            continue;
+        if ((sh[i].sh_type == SHT_NOBITS) || ((sh[i].sh_offset + (size_t)sh[i].sh_size) > len))
+            return -1;
+        s->addr = sh[i].sh_addr;
+        s->size = sh[i].sh_size;
+        s->data = elf + sh[i].sh_offset;
+        return 0;
+    }
+    return -1;
+}
+
+
+// print fmt with the integer arguments in arg (n of them), every conversion is formatted on its own so a bad format
+// string can't make us read beyond the arguments. Returns -1 if fmt has other than integer conversions.
+static int print_fmt(const char* fmt, const uint32_t* arg, int n)
+{
+    char spec[16];
+    int used = 0;
+
+    for (const char* p=fmt; *p; p++)
+    {
+        if (*p != '%')
+        {
+            putchar(*p);
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            putchar('%');
+            p++;
+            continue;
+        }
+        // flags, width and precision (no '*'), then the conversion
+        size_t l = 1 + strspn(p+1, "-+ #0123456789.");
+        if ((l >= (sizeof(spec)-1)) || !strchr("diouxXc", p[l]) || (used >= n))
+            return -1;
+        memcpy(spec, p, l+1);
+        spec[l+1] = 0;
+        if ((p[l] == 'd') || (p[l] == 'i'))
+            printf(spec, (int)(int32_t)arg[used++]);
+        else
+            printf(spec, (unsigned int)arg[used++]);
+        p += l;
+    }
+    return 0;
+}
+
+
+void print_rec(const struct blog_rec* r, const struct fmt_section* s, double cps)
+{
+    uint32_t addr = r->fmt & ~(BLOG_FMT_ALIGN-1);
+    int n = r->fmt & (BLOG_FMT_ALIGN-1);
+    uint64_t t = ((uint64_t)r->time_hi << 32) | r->time_lo;
+
+    printf("[%12.6f] ", t / cps);
+    if ((n <= BLOG_MAX_ARGS) && (addr >= s->addr) && ((addr - s->addr) < s->size) &&
+        memchr(s->data + (addr - s->addr), 0, s->size - (addr - s->addr)))
+    {
+        if (print_fmt(s->data + (addr - s->addr), r->arg, n) == 0)
+        {
+            putchar('\n');
+            return;
+        }
+        printf(" <bad format>");
+    }
+    // unknown format (ELF file doesn't match the firmware), print the raw record
+    printf(" fmt x%08x:", (unsigned int)r->fmt);
+    for (int i=0; i<BLOG_MAX_ARGS; i++)
+        printf(" x%08x", (unsigned int)r->arg[i]);
+    putchar('\n');
+}
+
+
+void help()
+{
+    puts("blogdec - print the binary log of the bare metal firmware");
+    puts("usage: blogdec [-e elf] [-l log] [-c counts]");
+    printf("  -e  firmware ELF file with the format strings (default %s)\n", DFLT_ELF);
+    printf("  -l  binary log (default %s)\n", DFLT_LOG);
+    printf("  -c  global timer counts per second (default %d)\n", DFLT_COUNTS_PER_SECOND);
+}
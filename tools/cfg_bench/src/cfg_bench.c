@@ -0,0 +1,691 @@
+/******************************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*   Linux user space applications and cli tools
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   cfg_bench.c
+*
+*   Load test for the cfg_mgmt kernel module: several threads read the value of a variable concurrently (open, read,
+*   close of its debugfs file) and the latency percentiles and context switches per read are reported for an
+*   increasing number of threads.
+*   The stress mode (-s) reads random files (value, min, max, description) of all variables from many threads at
+*   once and compares the results with a reference read before, which detects replies matched to the wrong request.
+*   The char device mode (-c) compares the value throughput of /dev/cfg_mgmt (batches of 1, 10 and 1000 values per
+*   ioctl) with reading the debugfs files.
+*   The snapshot mode (-m) maps the value snapshot of /dev/cfg_mgmt and measures how fast consistent copies of all
+*   values can be taken (no syscalls), how old the snapshot is and how many values are stale (last read failed).
+*
+******************************************************************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "cfg_mgmt_ioctl.h"
+
+#define DFLT_PATH       "/debug/cfg_mgmt"
+#define DFLT_DEV        "/dev/cfg_mgmt"
+
+#define DFLT_THREADS    16
+#define DFLT_READS      1000
+
+#define MAX_NAME_LEN    40
+
+// max. size of a file (IO_BUF_SIZE in kernel_mod/rpmsg_link.h)
+#define MAX_FILE_LEN    1024
+
+// files of a variable checked in stress mode
+#define N_KINDS         4
+static const char* kinds[N_KINDS] = {"val", "min", "max", "desc"};
+
+// values per ioctl in char device mode
+#define N_BATCH_SIZES   3
+static const int batch_sizes[N_BATCH_SIZES] = {1, 10, 1000};
+
+
+
+/******************************************************************************************************************************
+*   S T R U C T S
+*/
+
+// state and results of one reader thread
+struct reader {
+    pthread_t thread;
+    const char* fn;         // file to read
+    int n;                  // number of reads
+    uint32_t* lat;          // latency of each read in us
+    int errors;
+    long csw;               // voluntary and involuntary context switches of the thread
+};
+
+// reference contents of all files of all variables (stress mode)
+struct ref {
+    const char* path;
+    int n;                  // number of variables
+    char** names;
+    char** text[N_KINDS];   // text[kind][variable]
+};
+
+// state and results of one stress thread
+struct stresser {
+    pthread_t thread;
+    struct ref* ref;
+    int n;                  // number of reads
+    unsigned int seed;
+    uint32_t* lat;
+    int errors;             // open or read failed
+    int mismatches;         // content differs from the reference
+};
+
+
+
+/******************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+int run(const char* fn, int n_threads, int n_reads);
+
+void* reader_main(void* arg);
+
+int cmp_u32(const void* a, const void* b);
+
+int stress(const char* cfg_mgmt_path, int n_threads, int n_reads);
+
+void* stresser_main(void* arg);
+
+int load_ref(struct ref* ref);
+
+int read_file(const char* fn, char* buf, int len);
+
+int dev_bench(const char* cfg_mgmt_path, const char* dev, int n_values);
+
+int dev_run(int fd, int n_vars, int batch, int n_values);
+
+int debugfs_run(struct ref* ref, int n_values);
+
+int snap_bench(const char* dev, int n_copies);
+
+uint32_t snap_copy(const struct cfg_mgmt_snap* snap, struct cfg_mgmt_snap_val* vals, uint64_t* time_ns,
+            uint32_t* flags, int* retries);
+
+int first_var(const char* cfg_mgmt_path, char* name, int len);
+
+void help();
+
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+int main (int argc, char **argv)
+{
+    char* cfg_mgmt_path = DFLT_PATH;  // location where debugfs is mounted
+    char* dev = DFLT_DEV;
+    char name[MAX_NAME_LEN] = "";
+    int max_threads = DFLT_THREADS;
+    int n_reads = DFLT_READS;
+    int stress_mode = 0;
+    int dev_mode = 0;
+    int snap_mode = 0;
+    char fn[256];
+    int c;
+
+    opterr = 0;
+    while ((c = getopt (argc, argv, "hscmd:D:v:t:n:")) != -1) {
+        switch (c) {
+        case 's':
+            stress_mode = 1;
+            break;
+        case 'c':
+            dev_mode = 1;
+            break;
+        case 'm':
+            snap_mode = 1;
+            break;
+        case 'D':
+            dev = optarg;
+            break;
+        case 'd':
+            cfg_mgmt_path = optarg;
+            break;
+        case 'v':
+            snprintf(name, sizeof(name), "%s", optarg);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'n':
+            n_reads = atoi(optarg);
+            break;
+        case 'h':
+            help();
+            return 0;
+        default:
+            fprintf(stderr, "invalid option, see -h\n");
+            return 1;
+        }
+    }
+    if ((max_threads < 1) || (n_reads < 1)) {
+        fprintf(stderr, "invalid number of threads or reads\n");
+        return 1;
+    }
+    if (stress_mode)
+        return stress(cfg_mgmt_path, max_threads, n_reads) ? 1 : 0;
+    if (dev_mode)
+        return dev_bench(cfg_mgmt_path, dev, n_reads) ? 1 : 0;
+    if (snap_mode)
+        return snap_bench(dev, n_reads) ? 1 : 0;
+
+    // use the first variable if none was given
+    if ((name[0] == 0) && first_var(cfg_mgmt_path, name, sizeof(name)))
+        return 1;
+    snprintf(fn, sizeof(fn), "%s/val/%s", cfg_mgmt_path, name);
+
+    printf("reading %s, %d reads per thread\n", fn, n_reads);
+    printf("threads    reads/s   p50 us   p99 us   max us  csw/read  errors\n");
+    for (int t=1; t<=max_threads; t*=2) {
+        if (run(fn, t, n_reads))
+            return 1;
+    }
+    return 0;
+}
+
+
+// start n_threads readers, wait for them and print the results
+int run(const char* fn, int n_threads, int n_reads)
+{
+    struct reader* r = calloc(n_threads, sizeof(*r));
+    uint32_t* lat = malloc(n_threads * n_reads * sizeof(uint32_t));
+    struct timespec t0, t1;
+    int errors = 0;
+    long csw = 0;
+    int i;
+
+    if (!r || !lat) {
+        fprintf(stderr, "no memory\n");
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i=0; i<n_threads; i++) {
+        r[i].fn = fn;
+        r[i].n = n_reads;
+        r[i].lat = lat + i*n_reads;
+        if (pthread_create(&r[i].thread, NULL, reader_main, &r[i])) {
+            fprintf(stderr, "can't create thread: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    for (i=0; i<n_threads; i++) {
+        pthread_join(r[i].thread, NULL);
+        errors += r[i].errors;
+        csw += r[i].csw;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    int n = n_threads * n_reads;
+    double dt = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    qsort(lat, n, sizeof(uint32_t), cmp_u32);
+    printf("%7d %10.0f %8u %8u %8u %9.2f %7d\n", n_threads, n / dt, (unsigned int)lat[n/2],
+        (unsigned int)lat[(n*99)/100], (unsigned int)lat[n-1], (double)csw / n, errors);
+
+    free(lat);
+    free(r);
+    return 0;
+}
+
+
+// reader thread: open, read and close the file n times
+void* reader_main(void* arg)
+{
+    struct reader* r = arg;
+    struct rusage ru0, ru1;
+    struct timespec t0, t1;
+    char buf[MAX_NAME_LEN];
+
+    getrusage(RUSAGE_THREAD, &ru0);
+    for (int i=0; i<r->n; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        int fd = open(r->fn, O_RDONLY);
+        if (fd < 0) {
+            r->errors++;
+        } else {
+            if (read(fd, buf, sizeof(buf)) <= 0)
+                r->errors++;
+            close(fd);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        r->lat[i] = (t1.tv_sec - t0.tv_sec) * 1000000 + (t1.tv_nsec - t0.tv_nsec) / 1000;
+    }
+    getrusage(RUSAGE_THREAD, &ru1);
+    r->csw = (ru1.ru_nvcsw - ru0.ru_nvcsw) + (ru1.ru_nivcsw - ru0.ru_nivcsw);
+    return NULL;
+}
+
+
+// stress mode: n_threads threads do n_reads random reads each, returns 0 if all results were correct
+int stress(const char* cfg_mgmt_path, int n_threads, int n_reads)
+{
+    struct ref ref = {.path = cfg_mgmt_path};
+    struct stresser* st = calloc(n_threads, sizeof(*st));
+    uint32_t* lat = malloc(n_threads * n_reads * sizeof(uint32_t));
+    struct timespec t0, t1;
+    int errors = 0, mismatches = 0;
+    int i;
+
+    if (!st || !lat) {
+        fprintf(stderr, "no memory\n");
+        return -1;
+    }
+    if (load_ref(&ref))
+        return -1;
+
+    printf("stress: %d variables, %d threads, %d reads per thread\n", ref.n, n_threads, n_reads);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i=0; i<n_threads; i++) {
+        st[i].ref = &ref;
+        st[i].n = n_reads;
+        st[i].seed = i + 1;
+        st[i].lat = lat + i*n_reads;
+        if (pthread_create(&st[i].thread, NULL, stresser_main, &st[i])) {
+            fprintf(stderr, "can't create thread: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    for (i=0; i<n_threads; i++) {
+        pthread_join(st[i].thread, NULL);
+        errors += st[i].errors;
+        mismatches += st[i].mismatches;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    int n = n_threads * n_reads;
+    double dt = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    qsort(lat, n, sizeof(uint32_t), cmp_u32);
+    printf("reads/s %.0f, p50 %u us, p99 %u us, max %u us, errors %d, mismatches %d\n", n / dt,
+        (unsigned int)lat[n/2], (unsigned int)lat[(n*99)/100], (unsigned int)lat[n-1], errors, mismatches);
+
+    free(lat);
+    free(st);
+    return (errors || mismatches) ? -1 : 0;
+}
+
+
+// stress thread: read random files and compare them with the reference
+void* stresser_main(void* arg)
+{
+    struct stresser* st = arg;
+    struct ref* ref = st->ref;
+    struct timespec t0, t1;
+    char buf[MAX_FILE_LEN];
+    char fn[256];
+
+    for (int i=0; i<st->n; i++) {
+        int v = rand_r(&st->seed) % ref->n;
+        int k = rand_r(&st->seed) % N_KINDS;
+        snprintf(fn, sizeof(fn), "%s/%s/%s", ref->path, kinds[k], ref->names[v]);
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        int ret = read_file(fn, buf, sizeof(buf));
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        st->lat[i] = (t1.tv_sec - t0.tv_sec) * 1000000 + (t1.tv_nsec - t0.tv_nsec) / 1000;
+
+        if (ret < 0)
+            st->errors++;
+        else if (strcmp(buf, ref->text[k][v]) != 0) {
+            st->mismatches++;
+            fprintf(stderr, "mismatch in %s: '%s' instead of '%s'\n", fn, buf, ref->text[k][v]);
+        }
+    }
+    return NULL;
+}
+
+
+// char device mode: read n_values values through the debugfs files and through the char device with different
+// batch sizes, returns 0 if all reads succeeded
+int dev_bench(const char* cfg_mgmt_path, const char* dev, int n_values)
+{
+    struct ref ref = {.path = cfg_mgmt_path};
+    int fd, n_vars, errors;
+
+    fd = open(dev, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "can't open %s: %s\n", dev, strerror(errno));
+        return -1;
+    }
+    // this loads the variable list, so the debugfs files exist afterwards
+    n_vars = ioctl(fd, CFG_MGMT_IOC_N_VARS);
+    if (n_vars <= 0) {
+        fprintf(stderr, "can't get the number of variables: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (load_ref(&ref)) {
+        close(fd);
+        return -1;
+    }
+
+    printf("%d variables, %d values per test\n", n_vars, n_values);
+    printf("path     values/call   values/s    us/call  errors\n");
+    errors = debugfs_run(&ref, n_values);
+    for (int i=0; i<N_BATCH_SIZES; i++)
+        errors += dev_run(fd, n_vars, batch_sizes[i], n_values);
+    close(fd);
+    return errors ? -1 : 0;
+}
+
+
+// read at least n_values values with ioctls of batch values (variables in turn), returns the number of errors
+int dev_run(int fd, int n_vars, int batch, int n_values)
+{
+    struct cfg_mgmt_io_op* ops = calloc(batch, sizeof(*ops));
+    struct cfg_mgmt_io_batch b = {.n = batch};
+    struct timespec t0, t1;
+    int calls = (n_values + batch - 1) / batch;
+    int errors = 0;
+
+    if (!ops) {
+        fprintf(stderr, "no memory\n");
+        return 1;
+    }
+    b.ops = (uintptr_t)ops;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int c=0; c<calls; c++) {
+        for (int i=0; i<batch; i++) {
+            ops[i].index = (c*batch + i) % n_vars;
+            ops[i].op = CFG_MGMT_OP_GET;
+        }
+        if (ioctl(fd, CFG_MGMT_IOC_BATCH, &b) < 0) {
+            errors += batch;
+            continue;
+        }
+        for (int i=0; i<batch; i++)
+            errors += (ops[i].status != 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double dt = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("ioctl  %13d %10.0f %10.1f %7d\n", batch, calls * batch / dt, dt * 1e6 / calls, errors);
+    free(ops);
+    return errors;
+}
+
+
+// read n_values values through the debugfs files (variables in turn) and parse them, returns the number of errors
+// The files are opened with O_SYNC so the values are read from the firmware (like the ioctl), not from the cache.
+int debugfs_run(struct ref* ref, int n_values)
+{
+    struct timespec t0, t1;
+    char buf[MAX_NAME_LEN];
+    char fn[512];
+    char* end;
+    int errors = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i=0; i<n_values; i++) {
+        snprintf(fn, sizeof(fn), "%s/val/%s", ref->path, ref->names[i % ref->n]);
+        int fd = open(fn, O_RDONLY | O_SYNC);
+        int n = -1;
+        if (fd >= 0) {
+            n = read(fd, buf, sizeof(buf)-1);
+            close(fd);
+        }
+        if (n <= 0) {
+            errors++;
+            continue;
+        }
+        buf[n] = 0;
+        strtol(buf, &end, 0);
+        if (end == buf)
+            errors++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double dt = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("debugfs %12d %10.0f %10.1f %7d\n", 1, n_values / dt, dt * 1e6 / n_values, errors);
+    return errors;
+}
+
+
+// snapshot mode: take n_copies copies of the mapped snapshot back to back, returns 0 on success
+int snap_bench(const char* dev, int n_copies)
+{
+    struct cfg_mgmt_snap* snap;
+    struct timespec t0, t1;
+    size_t size;
+    struct cfg_mgmt_snap_val* vals;
+    uint64_t time_ns, age, max_age = 0;
+    uint32_t gen, first_gen, last_gen = 0, flags = 0;
+    int fd, n_vars, retries = 0, stale = 0;
+
+    fd = open(dev, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "can't open %s: %s\n", dev, strerror(errno));
+        return -1;
+    }
+    n_vars = ioctl(fd, CFG_MGMT_IOC_N_VARS);
+    if (n_vars <= 0) {
+        fprintf(stderr, "can't get the number of variables: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    size = sizeof(*snap) + n_vars * sizeof(struct cfg_mgmt_snap_val);
+    snap = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);      // the mapping stays valid
+    if (snap == MAP_FAILED) {
+        fprintf(stderr, "can't map %s: %s\n", dev, strerror(errno));
+        return -1;
+    }
+    vals = calloc(n_vars, sizeof(*vals));
+    if (!vals) {
+        fprintf(stderr, "no memory\n");
+        munmap(snap, size);
+        return -1;
+    }
+
+    // the first snapshot is taken once the device is mapped
+    while ((snap_copy(snap, vals, &time_ns, &flags, &retries) == 0) && !(flags & CFG_MGMT_SNAP_GONE))
+        usleep(1000);
+    retries = 0;
+
+    first_gen = snap_copy(snap, vals, &time_ns, &flags, &retries);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i=0; (i<n_copies) && !(flags & CFG_MGMT_SNAP_GONE); i++) {
+        gen = snap_copy(snap, vals, &time_ns, &flags, &retries);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        age = (t1.tv_sec * 1000000000ull + t1.tv_nsec) - time_ns;
+        if (age > max_age)
+            max_age = age;
+        last_gen = gen;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (flags & CFG_MGMT_SNAP_GONE) {
+        fprintf(stderr, "the channel was removed, the snapshot is not updated any more\n");
+        free(vals);
+        munmap(snap, size);
+        return -1;
+    }
+    // values of the last copy which were not read for it
+    for (int i=0; i<n_vars; i++)
+        stale += (vals[i].gen != last_gen);
+
+    double dt = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("%d variables, %d copies\n", n_vars, n_copies);
+    printf("copies/s   us/copy  retries  snapshots  snapshots/s  max age us  stale\n");
+    printf("%8.0f %9.2f %8d %10u %12.1f %11.0f %6d\n", n_copies / dt, dt * 1e6 / n_copies, retries,
+        last_gen - first_gen, (last_gen - first_gen) / dt, max_age * 1e-3, stale);
+
+    free(vals);
+    munmap(snap, size);
+    return 0;
+}
+
+
+// take a consistent copy of all values of the snapshot, returns its generation (0: no snapshot yet)
+uint32_t snap_copy(const struct cfg_mgmt_snap* snap, struct cfg_mgmt_snap_val* vals, uint64_t* time_ns,
+            uint32_t* flags, int* retries)
+{
+    uint32_t seq, gen;
+
+    for (;;) {
+        seq = __atomic_load_n(&snap->seq, __ATOMIC_ACQUIRE);
+        if ((seq & 1) == 0) {
+            gen = snap->gen;
+            *time_ns = snap->time_ns;
+            *flags = snap->flags;
+            memcpy(vals, snap->values, snap->n_vars * sizeof(*vals));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&snap->seq, __ATOMIC_RELAXED) == seq)
+                return gen;
+        }
+        (*retries)++;
+    }
+}
+
+
+// read all files of all variables once (single threaded)
+int load_ref(struct ref* ref)
+{
+    struct dirent** list;
+    char buf[MAX_FILE_LEN];
+    char fn[512];
+    int num, i, k;
+
+    snprintf(fn, sizeof(fn), "%s/val", ref->path);
+    num = scandir(fn, &list, NULL, alphasort);
+    if (num < 0) {
+        fprintf(stderr, "can't read %s: %s (is the variable list loaded?)\n", fn, strerror(errno));
+        return -1;
+    }
+    ref->names = malloc(num * sizeof(char*));
+    for (k=0; k<N_KINDS; k++)
+        ref->text[k] = malloc(num * sizeof(char*));
+    ref->n = 0;
+    for (i=0; i<num; i++) {
+        if (list[i]->d_name[0] != '.') {
+            ref->names[ref->n] = strdup(list[i]->d_name);
+            for (k=0; k<N_KINDS; k++) {
+                snprintf(fn, sizeof(fn), "%s/%s/%s", ref->path, kinds[k], list[i]->d_name);
+                if (read_file(fn, buf, sizeof(buf)) < 0) {
+                    fprintf(stderr, "can't read %s: %s\n", fn, strerror(errno));
+                    return -1;
+                }
+                ref->text[k][ref->n] = strdup(buf);
+            }
+            ref->n++;
+        }
+        free(list[i]);
+    }
+    free(list);
+    if (ref->n == 0) {
+        fprintf(stderr, "no variables found\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+// read a whole file to buf (\0 terminated), returns its length or -1 on error
+int read_file(const char* fn, char* buf, int len)
+{
+    int n = 0, ret = 0;
+    int fd = open(fn, O_RDONLY);
+
+    if (fd < 0)
+        return -1;
+    while ((n < (len-1)) && ((ret = read(fd, buf+n, len-1-n)) > 0))
+        n += ret;
+    close(fd);
+    if (ret < 0)
+        return -1;
+    buf[n] = 0;
+    return n;
+}
+
+
+int cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+
+// copy the name of the first variable (in alphabetical order) to name
+int first_var(const char* cfg_mgmt_path, char* name, int len)
+{
+    struct dirent** list;
+    char fn[256];
+    int num, i;
+
+    snprintf(fn, sizeof(fn), "%s/val", cfg_mgmt_path);
+    num = scandir(fn, &list, NULL, alphasort);
+    if (num < 0) {
+        fprintf(stderr, "can't read %s: %s (is the variable list loaded?)\n", fn, strerror(errno));
+        return -1;
+    }
+    name[0] = 0;
+    for (i=0; i<num; i++) {
+        if ((name[0] == 0) && (list[i]->d_name[0] != '.'))
+            snprintf(name, len, "%s", list[i]->d_name);
+        free(list[i]);
+    }
+    free(list);
+    if (name[0] == 0) {
+        fprintf(stderr, "no variables found in %s\n", fn);
+        return -1;
+    }
+    return 0;
+}
+
+
+void help()
+{
+    puts("cfg_bench: load test for the cfg_mgmt module, reads a variable from an increasing number of threads");
+    puts("options:");
+    puts("  -d path    location of the cfg_mgmt debugfs directory (default " DFLT_PATH ")");
+    puts("  -v name    variable to read (default: first one)");
+    puts("  -t n       max. number of threads, runs with 1, 2, 4, .. threads (default 16)");
+    puts("  -n n       number of reads per thread (default 1000)");
+    puts("  -s         stress mode: -t threads read random files of all variables at once and check the");
+    puts("             results (the values must not change meanwhile)");
+    puts("  -c         char device mode: -n values are read through debugfs and through the char device with");
+    puts("             1, 10 and 1000 values per ioctl");
+    puts("  -m         snapshot mode: -n consistent copies of the mapped value snapshot are taken");
+    puts("  -D dev     char device (default " DFLT_DEV ")");
+}
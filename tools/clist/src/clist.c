@@ -28,6 +28,8 @@
 *   clist.c
 *
 *   Top Level File, implements an cli application which lists all variable names, their values and descriptions
+*   All variables are read from the table file of the kernel module with a single read. If the module has none (old
+*   version) each variable's val, min, max and desc files are read.
 *
 ******************************************************************************************************************************/
 
@@ -61,6 +63,14 @@
 
 int show(const char* cfg_mgmt_path);
 
+int load_table(const char* cfg_mgmt_path, char*** names, char*** values, char*** minima, char*** maxima,
+            char*** descs);
+
+int load_files(const char* cfg_mgmt_path, char*** names, char*** values, char*** minima, char*** maxima,
+            char*** descs);
+
+int cmp_line(const void* a, const void* b);
+
 void puts_pad(const char* str, int len);
 
 int load(struct dirent** name_list, int num, const char* cfg_mgmt_path, char** names, char** values,
@@ -130,43 +140,18 @@ int show(const char* cfg_mgmt_path)
     char** maxima;
     char** descs;
     int num;    // number of variables (ie number of entries in each array)
-    const int fn_buf_len = 256;
-    int i, ret;
-
-    struct dirent** name_list;
-    char fn[fn_buf_len];
+    int i;
 
-    // read all file names in the directory, remove all which start with a . and sort them alphabetically
-    snprintf(fn, fn_buf_len, "%s/val", cfg_mgmt_path);
-    num = scandir(fn, &name_list, &no_dot_filter, alphasort);
-    if (num < 0) {
-        printf("scandir error: %d\n", errno);
-        return -errno;
-    }
+    num = load_table(cfg_mgmt_path, &names, &values, &minima, &maxima, &descs);
+    if (num == -ENOENT)
+        num = load_files(cfg_mgmt_path, &names, &values, &minima, &maxima, &descs);
+    if (num < 0)
+        return num;
     if (num == 0) {
         printf("no variables found\n");
         return 0;
     }
 
-    // get memory for the pointers
-    names = malloc(num*sizeof(char*));
-    values = malloc(num*sizeof(char*));
-    minima = malloc(num*sizeof(char*));
-    maxima = malloc(num*sizeof(char*));
-    descs = malloc(num*sizeof(char*));
-    // load all file contents
-    ret = load(name_list, num, cfg_mgmt_path, names, values, minima, maxima, descs);
-    if (ret) {
-        printf("load returned %d\n", ret);
-        return ret;
-    }
-
-    // free memory allocated by scandir
-    //printf("freeing scandir memory\n");
-    for (i=0; i<num; i++)
-        free(name_list[i]);
-    free(name_list);
-
 	// find max length of the columns (for pretty formatting)
     int nName=4, nVal=5, nMin=7, nMax=7;	// max size of the columns, start values represent header of table
 	for (i=0; i<num; i++) {
@@ -209,6 +194,132 @@ int show(const char* cfg_mgmt_path)
 }
 
 
+// read the table file (one line per variable, tab separated fields), the lines are sorted by name like the file
+// names of load_files. All strings point into the buffer of the file, it is kept until the program exits.
+// returns the number of variables or neg error code, -ENOENT if the kernel module has no table file
+int load_table(const char* cfg_mgmt_path, char*** names, char*** values, char*** minima, char*** maxima,
+            char*** descs)
+{
+    char fn[256];
+    char* buf = NULL;
+    size_t size = 0, len = 0;
+    int fd, ret;
+
+    snprintf(fn, sizeof(fn), "%s/table", cfg_mgmt_path);
+    fd = open(fn, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+    // the kernel module reads all variables on open, the file is read in one go
+    do {
+        if ((size - len) < 4096) {
+            size = size ? 2*size : 16384;
+            char* b = realloc(buf, size);
+            if (!b) {
+                close(fd);
+                free(buf);
+                return -ENOMEM;
+            }
+            buf = b;
+        }
+        ret = read(fd, buf+len, size-len-1);
+        if (ret > 0)
+            len += ret;
+    } while (ret > 0);
+    if (ret < 0) {
+        ret = -errno;
+        printf("%s: can't read %s: %d\n", __func__, fn, ret);
+        close(fd);
+        free(buf);
+        return ret;
+    }
+    close(fd);
+    buf[len] = '\0';
+
+    // split into lines, skip the header
+    int num = 0;
+    for (size_t i=0; i<len; i++) {
+        if (buf[i] == '\n')
+            num++;
+    }
+    char** lines = malloc((num+1)*sizeof(char*));
+    char* save;
+    char* line = strtok_r(buf, "\n", &save);
+    num = 0;
+    while (line && (line = strtok_r(NULL, "\n", &save)))
+        lines[num++] = line;
+    qsort(lines, num, sizeof(char*), &cmp_line);
+
+    *names = malloc(num*sizeof(char*));
+    *values = malloc(num*sizeof(char*));
+    *minima = malloc(num*sizeof(char*));
+    *maxima = malloc(num*sizeof(char*));
+    *descs = malloc(num*sizeof(char*));
+    for (int i=0; i<num; i++) {
+        char* p = lines[i];
+        char* f[5];
+        // the description is the rest of the line
+        for (int j=0; j<5; j++)
+            f[j] = (j < 4) ? strsep(&p, "\t") : p;
+        (*names)[i] = f[0] ? f[0] : "";
+        (*values)[i] = f[1] ? f[1] : "";
+        (*minima)[i] = f[2] ? f[2] : "";
+        (*maxima)[i] = f[3] ? f[3] : "";
+        (*descs)[i] = f[4] ? f[4] : "";
+    }
+    free(lines);
+    return num;
+}
+
+
+// sort the lines of the table by name (the first field)
+int cmp_line(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+
+// read the files of all variables, used if the kernel module has no table file
+// returns the number of variables or neg error code
+int load_files(const char* cfg_mgmt_path, char*** names, char*** values, char*** minima, char*** maxima,
+            char*** descs)
+{
+    int num;    // number of variables (ie number of entries in each array)
+    const int fn_buf_len = 256;
+    int i, ret;
+
+    struct dirent** name_list;
+    char fn[fn_buf_len];
+
+    // read all file names in the directory, remove all which start with a . and sort them alphabetically
+    snprintf(fn, fn_buf_len, "%s/val", cfg_mgmt_path);
+    num = scandir(fn, &name_list, &no_dot_filter, alphasort);
+    if (num < 0) {
+        printf("scandir error: %d\n", errno);
+        return -errno;
+    }
+
+    // get memory for the pointers
+    *names = malloc(num*sizeof(char*));
+    *values = malloc(num*sizeof(char*));
+    *minima = malloc(num*sizeof(char*));
+    *maxima = malloc(num*sizeof(char*));
+    *descs = malloc(num*sizeof(char*));
+    // load all file contents
+    ret = load(name_list, num, cfg_mgmt_path, *names, *values, *minima, *maxima, *descs);
+    if (ret) {
+        printf("load returned %d\n", ret);
+        return ret;
+    }
+
+    // free memory allocated by scandir
+    //printf("freeing scandir memory\n");
+    for (i=0; i<num; i++)
+        free(name_list[i]);
+    free(name_list);
+    return num;
+}
+
+
 int load(struct dirent** name_list, int num, const char* cfg_mgmt_path, char** names, char** values,
             char** minima, char** maxima, char** descs)
 {
@@ -0,0 +1,275 @@
+/******************************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*   Host test of the bare metal event ring
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   evring_test.c
+*
+*   Tests evring.h (the kick event queue of the firmware) on the host:
+*    - wraparound of the free running head and tail indices at 2^32
+*    - full ring: puts are rejected and counted in dropped, the queued events are not touched
+*    - stress: a producer and a consumer thread, once with a producer which retries on a full ring (the consumer
+*      has to see every event exactly once and in order) and once with one which drops events like the interrupt
+*      handler does (the consumer has to see increasing ids, received + dropped has to match the events sent)
+*   Each event carries its sequence number as id and the inverted sequence number as time, so torn entries show up.
+*   Returns 0 if all tests passed.
+*
+******************************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "evring.h"
+
+// number of events sent by the producer thread in each stress run
+#define STRESS_EVENTS       2000000
+
+// check a condition, count and report failures
+#define CHECK(cond)         do { if (!(cond)) { failures++; \
+                                fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); } } while (0)
+
+
+
+/******************************************************************************************************************************
+*   T Y P E S
+*/
+
+// state shared by the two threads of a stress run
+struct stress {
+    struct evring ring;
+    int retry;                  // producer retries a full ring instead of dropping the event
+    volatile int done;          // producer has sent all events
+    uint32_t received;          // number of events seen by the consumer
+    uint32_t errors;            // out of order or torn events seen by the consumer
+};
+
+
+
+/******************************************************************************************************************************
+*   G L O B A L S
+*/
+
+static int failures = 0;
+
+
+
+/******************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+void test_wrap(void);
+
+void test_full(void);
+
+void test_stress(int retry);
+
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+int main(void)
+{
+    printf("evring_test: EVRING_SIZE %d\n", EVRING_SIZE);
+    test_wrap();
+    test_full();
+    test_stress(1);
+    test_stress(0);
+
+    if (failures)
+    {
+        printf("evring_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("evring_test: all tests passed\n");
+    return 0;
+}
+
+
+// start the ring at index start (the firmware always starts at 0, this just skips the first 2^32 events)
+static void ring_init_at(struct evring* r, uint32_t start)
+{
+    evring_init(r);
+    r->head = start;
+    r->tail = start;
+}
+
+
+// put and get events one by one and in full ring batches while head and tail cross 2^32
+void test_wrap(void)
+{
+    struct evring r;
+    struct evring_event e = {0};
+    uint32_t seq = 0;
+    uint32_t next = 0;
+    int f = failures;
+
+    ring_init_at(&r, 0xFFFFFFFFu - 3);
+    for (int i=0; i<8; i++, seq++)
+    {
+        CHECK(evring_put(&r, seq, ~seq) == 0);
+        CHECK(evring_count(&r) == 1);
+        CHECK(evring_get(&r, &e) == 1);
+        CHECK((e.id == seq) && (e.time == ~seq));
+        CHECK(evring_get(&r, &e) == 0);
+    }
+    CHECK(r.tail == 4);
+    next = seq;
+
+    // fill the ring so that head wraps while the ring is full
+    ring_init_at(&r, 0xFFFFFFFFu - (EVRING_SIZE / 2));
+    for (int i=0; i<EVRING_SIZE; i++, seq++)
+        CHECK(evring_put(&r, seq, ~seq) == 0);
+    CHECK(evring_count(&r) == EVRING_SIZE);
+    CHECK(evring_put(&r, seq, ~seq) == -1);
+    CHECK(r.dropped == 1);
+    for (int i=0; i<EVRING_SIZE; i++, next++)
+    {
+        CHECK(evring_get(&r, &e) == 1);
+        CHECK((e.id == next) && (e.time == ~next));
+    }
+    CHECK(evring_get(&r, &e) == 0);
+    CHECK(evring_count(&r) == 0);
+    CHECK(r.head == (EVRING_SIZE / 2) - 1);
+    printf("wraparound: %s\n", (failures != f) ? "FAILED" : "ok");
+}
+
+
+// a full ring rejects and counts events, draining one entry makes room for exactly one more
+void test_full(void)
+{
+    struct evring r;
+    struct evring_event e = {0};
+    int f = failures;
+
+    ring_init_at(&r, 0);
+    for (uint32_t i=0; i<EVRING_SIZE; i++)
+        CHECK(evring_put(&r, i, ~i) == 0);
+    CHECK(r.dropped == 0);
+    for (uint32_t i=0; i<100; i++)
+        CHECK(evring_put(&r, 1000 + i, 0) == -1);
+    CHECK(r.dropped == 100);
+    CHECK(evring_count(&r) == EVRING_SIZE);
+
+    CHECK((evring_get(&r, &e) == 1) && (e.id == 0));
+    CHECK(evring_put(&r, EVRING_SIZE, ~(uint32_t)EVRING_SIZE) == 0);
+    CHECK(evring_put(&r, 2000, 0) == -1);
+    CHECK(r.dropped == 101);
+
+    // the rejected events must not have overwritten anything
+    for (uint32_t i=1; i<=EVRING_SIZE; i++)
+    {
+        CHECK(evring_get(&r, &e) == 1);
+        CHECK((e.id == i) && (e.time == ~i));
+    }
+    CHECK(evring_get(&r, &e) == 0);
+    printf("full ring: %s\n", (failures != f) ? "FAILED" : "ok");
+}
+
+
+static void* producer(void* arg)
+{
+    struct stress* s = arg;
+
+    for (uint32_t i=0; i<STRESS_EVENTS; i++)
+    {
+        while (evring_put(&s->ring, i, ~i) != 0)
+        {
+            // the ring is full: give the consumer some time, then retry or drop the event like the interrupt handler
+            sched_yield();
+            if (!s->retry)
+                break;
+        }
+    }
+    evring_barrier();
+    s->done = 1;
+    return NULL;
+}
+
+
+static void* consumer(void* arg)
+{
+    struct stress* s = arg;
+    struct evring_event e = {0};
+    uint32_t next = 0;  // lowest id which may be received next
+
+    while (1)
+    {
+        if (!evring_get(&s->ring, &e))
+        {
+            if (!s->done)
+            {
+                sched_yield();
+                continue;
+            }
+            // the producer is done, all its events are visible now
+            evring_barrier();
+            if (!evring_get(&s->ring, &e))
+                break;
+        }
+        // with retries every id has to show up, otherwise ids only have to increase
+        if ((e.time != ~e.id) || (s->retry ? (e.id != next) : (e.id < next)))
+            s->errors++;
+        next = e.id + 1;
+        s->received++;
+    }
+    return NULL;
+}
+
+
+// run a producer and a consumer thread on one ring, starting just before the indices wrap
+void test_stress(int retry)
+{
+    static struct stress s;
+    pthread_t prod, cons;
+    int f = failures;
+
+    ring_init_at(&s.ring, 0xFFFFFFFFu - (STRESS_EVENTS / 2));
+    s.retry = retry;
+    s.done = 0;
+    s.received = 0;
+    s.errors = 0;
+
+    if (pthread_create(&cons, NULL, consumer, &s) || pthread_create(&prod, NULL, producer, &s))
+    {
+        perror("pthread_create");
+        exit(1);
+    }
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+
+    CHECK(s.errors == 0);
+    CHECK(evring_count(&s.ring) == 0);
+    if (retry)
+        CHECK(s.received == STRESS_EVENTS);
+    else
+        CHECK((s.received + s.ring.dropped) == STRESS_EVENTS);
+    printf("stress (%s): %u events received, %u dropped%s: %s\n", retry ? "retry" : "drop", (unsigned int)s.received,
+        (unsigned int)s.ring.dropped, retry ? " (retries)" : "", (failures != f) ? "FAILED" : "ok");
+}
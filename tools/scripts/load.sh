@@ -1,6 +1,7 @@
 echo 7 > /proc/sys/kernel/printk
 mount -t debugfs none /debug
 mknod /dev/bm_stdio c 0 242
+mknod /dev/cfg_mgmt c 243 0
 #modprobe virtio
 #modprobe virtio_ring
 #modprobe virtio_rpmsg_bus
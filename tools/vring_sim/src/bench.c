@@ -0,0 +1,581 @@
+/******************************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*   Host simulator of the bare metal rpmsg transport
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   bench.c
+*
+*   Top Level File of the simulator: sets up the shared memory and the doorbells, forks the firmware process and
+*   measures the echo service from the kernel side. For each message size the round trip latency (one message in
+*   flight) and the throughput (a window of messages in flight) are reported.
+*   With -p the latency of the control vdev is measured while a bulk source keeps the firmware's tx vring full, once
+*   with the bulk source on the control vdev (sim_shared) and once on the bulk vdev (sim_bulk). The kernel side
+*   consumes the vdev carrying the bulk traffic at a limited rate (token bucket) to model a slow reader.
+*
+******************************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+
+#include "remoteproc.h"
+#include "sim.h"
+
+// default number of messages per size and mode
+#define DFLT_MSGS           20000
+
+// default number of messages in flight for the throughput test
+#define DFLT_WINDOW         32
+
+// defaults of the priority test (-p): number of echoes per case, messages per burst of the bulk source and the rate
+// at which the kernel side consumes the bulk vdev (messages per second)
+#define DFLT_PRIO_MSGS      500
+#define DFLT_BURST          (2*VRING_SIZE)
+#define DFLT_RATE           50000
+
+// max. number of messages the token bucket of the rate limited consumer can accumulate
+#define RATE_BUCKET_MAX     32
+
+#define MAX_SIZES           16
+
+// latency histogram: bucket i counts round trips < 2^i ns
+#define HIST_BUCKETS        32
+
+// give up if the firmware does not respond for this long
+#define TIMEOUT_MS          2000
+
+
+
+/******************************************************************************************************************************
+*   G L O B A L S
+*/
+
+struct sim_doorbells sim_db;
+
+// state of the current run, updated by the rx callback
+static struct {
+    uint32_t fw_addr;       // address of the echo channel, 0 until announced
+    uint32_t bulk_addr;     // address of sim_bulk, 0 until announced
+    uint32_t shared_addr;   // address of sim_shared, 0 until announced
+    uint32_t bulk_rcvd;     // number of messages received from the bulk sources
+    uint32_t size;          // expected echo length
+    uint32_t received;
+    uint32_t errors;        // echoes with wrong length or sequence number
+    uint64_t* t_sent;       // send time of each message (by sequence number)
+    uint32_t* rtt;          // round trip time of each message
+} run;
+
+
+
+/******************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+int setup(int driver_ok);
+
+void wait_announce(void);
+
+void run_size(uint32_t size, uint32_t n, uint32_t window);
+
+void run_prio(const char* label, uint32_t bulk_addr, int bulk_vdev, uint32_t n, uint32_t burst, uint32_t rate);
+
+void print_latency(uint32_t* rtt, uint32_t n);
+
+void help();
+
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+int main(int argc, char** argv)
+{
+    uint32_t n = DFLT_MSGS;
+    uint32_t window = DFLT_WINDOW;
+    uint32_t burst = DFLT_BURST;
+    uint32_t rate = DFLT_RATE;
+    int prio = 0;
+    int n_set = 0;
+    uint32_t sizes[MAX_SIZES] = { 8, 64, 256, DATA_LEN_MAX };
+    int n_sizes = 4;
+    int verbose = 0;
+    int driver_ok = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:w:s:pb:r:dvh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n = strtoul(optarg, NULL, 0);
+            n_set = 1;
+            break;
+        case 'w':
+            window = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+        {
+            char* tok = strtok(optarg, ",");
+            n_sizes = 0;
+            while ((tok != NULL) && (n_sizes < MAX_SIZES))
+            {
+                sizes[n_sizes++] = strtoul(tok, NULL, 0);
+                tok = strtok(NULL, ",");
+            }
+            break;
+        }
+        case 'p':
+            prio = 1;
+            break;
+        case 'b':
+            burst = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            rate = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            driver_ok = 0;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            help();
+            return 1;
+        }
+    }
+    if (prio && !n_set)
+        n = DFLT_PRIO_MSGS;
+    if ((n == 0) || (window == 0) || (window > VRING_SIZE) || (burst == 0) || (rate == 0))
+    {
+        fprintf(stderr, "invalid message count, window (max. %d), burst or rate\n", VRING_SIZE);
+        return 1;
+    }
+
+    if (setup(driver_ok))
+        return 1;
+
+    pid_t fw = fork();
+    if (fw < 0)
+    {
+        perror("fork");
+        return 1;
+    }
+    if (fw == 0)
+    {
+        // firmware process
+        if (!verbose)
+        {
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        sim_fw_main();
+        exit(0);
+    }
+
+    run.t_sent = calloc(n, sizeof(uint64_t));
+    run.rtt = calloc(n, sizeof(uint32_t));
+    if ((run.t_sent == NULL) || (run.rtt == NULL))
+    {
+        kill(fw, SIGKILL);
+        return 1;
+    }
+
+    wait_announce();
+
+    if (prio)
+    {
+        printf("vring_sim: VRING_SIZE %d, PACKET_LEN_MAX %d, RPMSG_N_VDEV %d, %u echoes per case, "
+            "burst %u msgs, bulk consumer %u msgs/s\n", VRING_SIZE, PACKET_LEN_MAX, RPMSG_N_VDEV, (unsigned int)n,
+            (unsigned int)burst, (unsigned int)rate);
+        printf("%-14s %9s %9s %9s %10s\n", "bulk source", "rtt p50", "rtt p99", "rtt max", "bulk msg/s");
+        run_prio("none", 0, 0, n, burst, rate);
+        run_prio("control vdev", run.shared_addr, RPMSG_VDEV_CTRL, n, burst, rate);
+        run_prio("bulk vdev", run.bulk_addr, RPMSG_VDEV_BULK, n, burst, rate);
+        kill(fw, SIGKILL);
+        waitpid(fw, NULL, 0);
+        return 0;
+    }
+
+    printf("vring_sim: VRING_SIZE %d, PACKET_LEN_MAX %d, %u msgs per run, window %u\n",
+        VRING_SIZE, PACKET_LEN_MAX, (unsigned int)n, (unsigned int)window);
+    printf("%6s %6s %10s %10s %9s %9s %9s %6s\n", "size", "window", "msgs/s", "kB/s", "rtt p50", "rtt p99", "rtt max", "errors");
+    for (int i=0; i<n_sizes; i++)
+    {
+        if ((sizes[i] < sizeof(uint32_t)) || (sizes[i] > DATA_LEN_MAX))
+        {
+            fprintf(stderr, "skipping size %u (must be %u..%u)\n", (unsigned int)sizes[i],
+                (unsigned int)sizeof(uint32_t), (unsigned int)DATA_LEN_MAX);
+            continue;
+        }
+        run_size(sizes[i], n, 1);
+        print_latency(run.rtt, run.received);
+        run_size(sizes[i], n, window);
+        if (waitpid(fw, NULL, WNOHANG) == fw)
+        {
+            fprintf(stderr, "firmware process has terminated\n");
+            return 1;
+        }
+    }
+
+    kill(fw, SIGKILL);
+    waitpid(fw, NULL, 0);
+    return 0;
+}
+
+
+// create the shared memory and doorbells and do what the kernel does before it starts the firmware
+// driver_ok: set DRIVER_OK in the vdev status (like the rpmsg driver at the end of its probe)
+// returns 0 on success
+int setup(int driver_ok)
+{
+    char name[32];
+
+    snprintf(name, sizeof(name), "/vring_sim.%d", (int)getpid());
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        perror("shm_open");
+        return -1;
+    }
+    shm_unlink(name);   // the mapping keeps it alive
+    if (ftruncate(fd, SIM_SHM_SIZE))
+    {
+        perror("ftruncate");
+        return -1;
+    }
+    void* p = mmap((void*)(uintptr_t)SIM_SHM_ADDR, SIM_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p != (void*)(uintptr_t)SIM_SHM_ADDR)
+    {
+        fprintf(stderr, "can't map shared memory at x%08x\n", (unsigned int)SIM_SHM_ADDR);
+        return -1;
+    }
+    close(fd);
+
+    sim_db.to_linux = eventfd(0, 0);
+    sim_db.txvring = eventfd(0, 0);
+    sim_db.rxvring = eventfd(0, 0);
+    if ((sim_db.to_linux < 0) || (sim_db.txvring < 0) || (sim_db.rxvring < 0))
+    {
+        perror("eventfd");
+        return -1;
+    }
+
+    // fill in the resource table like remoteproc does
+    for (int v=0; v<RPMSG_N_VDEV; v++)
+    {
+        rpmsg_get_vring_rsc(v, 0)->da = SIM_SHM_ADDR + SIM_VDEV_OFS(v) + SIM_VRING0_OFS;
+        rpmsg_get_vring_rsc(v, 1)->da = SIM_SHM_ADDR + SIM_VDEV_OFS(v) + SIM_VRING1_OFS;
+        rpmsg_get_vdev_rsc(v)->gfeatures = (1<<VIRTIO_RPMSG_F_NS);
+        rpmsg_get_vdev_rsc(v)->status = VIRTIO_CONFIG_S_ACKNOWLEDGE | VIRTIO_CONFIG_S_DRIVER |
+            (driver_ok ? VIRTIO_CONFIG_S_DRIVER_OK : 0);
+    }
+
+    peer_init();
+    return 0;
+}
+
+
+// rx callback of the kernel side
+static void rx_cb(uint32_t src, uint32_t dst, uint8_t* data, uint32_t len, void* priv)
+{
+    if (dst == LINUX_SERVICE_ANNOUNCEMENT_ADDR)
+    {
+        struct rpmsg_ns_msg* ns = (struct rpmsg_ns_msg*)data;
+        if (len < sizeof(*ns))
+            return;
+        if (strncmp(ns->name, SIM_ECHO_CH, RPMSG_NAME_SIZE) == 0)
+            run.fw_addr = ns->addr;
+        else if (strncmp(ns->name, SIM_BULK_CH, RPMSG_NAME_SIZE) == 0)
+            run.bulk_addr = ns->addr;
+        else if (strncmp(ns->name, SIM_SHARED_CH, RPMSG_NAME_SIZE) == 0)
+            run.shared_addr = ns->addr;
+        return;
+    }
+    if ((src == run.bulk_addr) || (src == run.shared_addr))
+    {
+        run.bulk_rcvd++;
+        return;
+    }
+
+    uint32_t seq;
+    memcpy(&seq, data, sizeof(seq));
+    if ((len != run.size) || (seq != run.received))
+    {
+        run.errors++;
+        return;
+    }
+    run.rtt[seq] = (uint32_t)(now_ns() - run.t_sent[seq]);
+    run.received++;
+}
+
+
+static int cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+
+// process the messages of all vdevs without limit, returns the number of messages
+static int poll_all(void)
+{
+    int n = 0;
+    for (int v=0; v<RPMSG_N_VDEV; v++)
+        n += peer_poll(v, 0, &rx_cb, NULL);
+    return n;
+}
+
+
+// round trip time percentiles of the samples in run.rtt
+static void percentiles(uint32_t n, uint32_t* p50, uint32_t* p99, uint32_t* pmax)
+{
+    *p50 = *p99 = *pmax = 0;
+    if (n == 0)
+        return;
+    // the samples are sorted in a copy
+    uint32_t* s = malloc(n * sizeof(uint32_t));
+    if (s == NULL)
+        return;
+    memcpy(s, run.rtt, n * sizeof(uint32_t));
+    qsort(s, n, sizeof(uint32_t), &cmp_u32);
+    *p50 = s[n / 2];
+    *p99 = s[(n * 99) / 100];
+    *pmax = s[n - 1];
+    free(s);
+}
+
+
+// wait until the firmware has announced all its channels
+void wait_announce(void)
+{
+    uint64_t t0 = now_ns();
+    while ((run.fw_addr == 0) || (run.bulk_addr == 0) || (run.shared_addr == 0))
+    {
+        if (!poll_all())
+            peer_wait(10);
+        if ((now_ns() - t0) > (TIMEOUT_MS * 1000000ULL))
+        {
+            fprintf(stderr, "firmware has not announced its channels\n");
+            exit(1);
+        }
+    }
+}
+
+
+// echo n messages of size bytes with up to window messages in flight
+void run_size(uint32_t size, uint32_t n, uint32_t window)
+{
+    uint8_t msg[DATA_LEN_MAX];
+    uint32_t sent = 0;
+    uint64_t t_last;
+
+    memset(msg, 0xA5, sizeof(msg));
+    run.size = size;
+    run.received = 0;
+    run.errors = 0;
+
+    uint64_t t0 = now_ns();
+    t_last = t0;
+    while (run.received < n)
+    {
+        while ((sent < n) && ((sent - run.received) < window))
+        {
+            memcpy(msg, &sent, sizeof(sent));
+            run.t_sent[sent] = now_ns();
+            if (peer_send(RPMSG_VDEV_CTRL, run.fw_addr, msg, size))
+                break;  // no tx buffer, the firmware has to consume some first
+            sent++;
+        }
+
+        uint32_t before = run.received;
+        if (!poll_all())
+            peer_wait(1);
+        if (run.received != before)
+            t_last = now_ns();
+        else if ((now_ns() - t_last) > (TIMEOUT_MS * 1000000ULL))
+        {
+            fprintf(stderr, "timeout: %u of %u echoes received\n", (unsigned int)run.received, (unsigned int)n);
+            break;
+        }
+    }
+    uint64_t t = now_ns() - t0;
+    if (t == 0)
+        t = 1;
+
+    uint32_t p50, p99, pmax;
+    percentiles(run.received, &p50, &p99, &pmax);
+
+    printf("%6u %6u %10llu %10llu %7uus %7uus %7uus %6u\n", (unsigned int)size, (unsigned int)window,
+        (unsigned long long)(run.received * 1000000000ULL / t),
+        (unsigned long long)((uint64_t)run.received * size * 1000000000ULL / t / 1024),
+        (unsigned int)(p50 / 1000), (unsigned int)(p99 / 1000), (unsigned int)(pmax / 1000), (unsigned int)run.errors);
+}
+
+
+// echo n small messages one at a time on the control vdev while the bulk source bulk_addr (0: none) on bulk_vdev
+// sends bursts of burst messages, the next burst is requested when the previous one has been received. The kernel
+// side consumes the messages of bulk_vdev at no more than rate messages per second.
+void run_prio(const char* label, uint32_t bulk_addr, int bulk_vdev, uint32_t n, uint32_t burst, uint32_t rate)
+{
+    uint8_t msg[8];
+    uint32_t sent = 0;
+    uint32_t bulk_req = 0;  // number of bulk messages requested so far
+    double tokens = RATE_BUCKET_MAX;
+
+    memset(msg, 0xA5, sizeof(msg));
+    run.size = sizeof(msg);
+    run.received = 0;
+    run.errors = 0;
+    run.bulk_rcvd = 0;
+
+    uint64_t t0 = now_ns();
+    uint64_t t_tok = t0;
+    uint64_t t_last = t0;
+    while ((run.received < n) || (run.bulk_rcvd < bulk_req))
+    {
+        // keep one burst in flight as long as echoes are measured
+        if ((bulk_addr != 0) && (run.received < n) && (run.bulk_rcvd == bulk_req))
+        {
+            if (peer_send(bulk_vdev, bulk_addr, &burst, sizeof(burst)) == 0)
+                bulk_req += burst;
+        }
+        // one echo in flight
+        if ((sent < n) && (sent == run.received))
+        {
+            memcpy(msg, &sent, sizeof(sent));
+            run.t_sent[sent] = now_ns();
+            if (peer_send(RPMSG_VDEV_CTRL, run.fw_addr, msg, sizeof(msg)) == 0)
+                sent++;
+        }
+
+        // refill the token bucket of the rate limited vdev
+        uint64_t t = now_ns();
+        tokens += (double)(t - t_tok) * rate / 1e9;
+        if (tokens > RATE_BUCKET_MAX)
+            tokens = RATE_BUCKET_MAX;
+        t_tok = t;
+
+        uint32_t before = run.received + run.bulk_rcvd;
+        int got = 0;
+        for (int v=0; v<RPMSG_N_VDEV; v++)
+        {
+            if ((bulk_addr != 0) && (v == bulk_vdev))
+            {
+                if (tokens >= 1)
+                {
+                    int k = peer_poll(v, (uint32_t)tokens, &rx_cb, NULL);
+                    tokens -= k;
+                    got += k;
+                }
+            }
+            else
+                got += peer_poll(v, 0, &rx_cb, NULL);
+        }
+        if (!got)
+            peer_wait(1);
+
+        if ((run.received + run.bulk_rcvd) != before)
+            t_last = now_ns();
+        else if ((now_ns() - t_last) > (TIMEOUT_MS * 1000000ULL))
+        {
+            fprintf(stderr, "timeout: %u of %u echoes, %u of %u bulk messages received\n", (unsigned int)run.received,
+                (unsigned int)n, (unsigned int)run.bulk_rcvd, (unsigned int)bulk_req);
+            break;
+        }
+    }
+    uint64_t t = now_ns() - t0;
+    if (t == 0)
+        t = 1;
+
+    uint32_t p50, p99, pmax;
+    percentiles(run.received, &p50, &p99, &pmax);
+    printf("%-14s %7uus %7uus %7uus %10llu\n", label, (unsigned int)(p50 / 1000), (unsigned int)(p99 / 1000),
+        (unsigned int)(pmax / 1000), (unsigned long long)(run.bulk_rcvd * 1000000000ULL / t));
+    if (run.errors)
+        printf("%-14s %u echo errors\n", "", (unsigned int)run.errors);
+}
+
+
+// print a log2 histogram of the round trip times
+void print_latency(uint32_t* rtt, uint32_t n)
+{
+    uint32_t hist[HIST_BUCKETS] = {0};
+
+    for (uint32_t i=0; i<n; i++)
+    {
+        int b = 0;
+        while ((b < (HIST_BUCKETS-1)) && (rtt[i] >= (1u << b)))
+            b++;
+        hist[b]++;
+    }
+
+    printf("       rtt histogram:");
+    for (int b=0; b<HIST_BUCKETS; b++)
+    {
+        if (hist[b] == 0)
+            continue;
+        if (b >= 10)
+            printf(" <%uus:%u", (1u << b) / 1000, (unsigned int)hist[b]);
+        else
+            printf(" <%uns:%u", 1u << b, (unsigned int)hist[b]);
+    }
+    printf("\n");
+}
+
+
+void help()
+{
+    puts("vring_sim - host simulation of the bare metal rpmsg transport");
+    puts("usage: vring_sim [-n msgs] [-w window] [-s size,size,...] [-d] [-v]");
+    puts("       vring_sim -p [-n msgs] [-b burst] [-r rate] [-d] [-v]");
+    printf("  -n  number of messages per size and mode (default %d, %d with -p)\n", DFLT_MSGS, DFLT_PRIO_MSGS);
+    printf("  -w  number of messages in flight for the throughput run (default %d, max. %d)\n", DFLT_WINDOW, VRING_SIZE);
+    printf("  -s  message sizes in bytes (default 8,64,256,%d)\n", (int)DATA_LEN_MAX);
+    puts("  -p  measure the control vdev's latency while a bulk source is active (see top of bench.c)");
+    printf("  -b  messages per burst of the bulk source (default %d)\n", DFLT_BURST);
+    printf("  -r  rate at which the vdev with the bulk traffic is consumed, in msgs/s (default %d)\n", DFLT_RATE);
+    puts("  -d  don't set DRIVER_OK in the vdev status, the firmware has to use the rx buffer fallback");
+    puts("  -v  show the firmware's output");
+}
@@ -0,0 +1,237 @@
+/******************************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*   Host simulator of the bare metal rpmsg transport
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   peer.c
+*
+*   Kernel side of the simulator: the driver half of the split vrings as implemented by virtio_ring.c and
+*   virtio_rpmsg_bus.c in the kernel, one instance per vdev. vring0 carries messages from the firmware, it is filled
+*   with empty buffers which are posted again after a message was read. vring1 carries messages to the firmware, its
+*   buffers are taken from a free list and returned to it once the firmware has marked them used.
+*
+******************************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include "remoteproc.h"
+#include "remoteproc_kernel.h"
+#include "virtio_ring.h"
+#include "sim.h"
+
+
+/******************************************************************************************************************************
+*   S T R U C T S
+*/
+
+// driver side state of one split vring
+struct peer_vq {
+    volatile struct vring_desc* desc;
+    volatile struct vring_avail* avail;
+    volatile struct vring_used* used;
+    uint16_t avail_idx;     // free running, copy of avail->avail_idx
+    uint16_t last_used;     // free running, used entries up to here have been processed
+};
+
+
+
+// driver side state of one vdev (vring pair)
+struct peer_vdev {
+    struct peer_vq rx_vq;   // vring0: firmware -> kernel
+    struct peer_vq tx_vq;   // vring1: kernel -> firmware
+    // free tx buffers (descriptor indices of vring1)
+    uint16_t tx_free[VRING_SIZE];
+    int tx_free_cnt;
+};
+
+
+
+/******************************************************************************************************************************
+*   G L O B A L S
+*/
+
+static struct peer_vdev vdevs[RPMSG_N_VDEV];
+
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+// same layout as vring_init() in bm_fw/src/virtio_ring.c
+static void vq_init(struct peer_vq* vq, uint32_t addr)
+{
+    vq->desc = (void*)(uintptr_t)addr;
+    addr += VRING_SIZE * sizeof(struct vring_desc);
+    vq->avail = (void*)(uintptr_t)addr;
+    addr += sizeof(struct vring_avail);
+    addr = (addr + 0xFFF) & ~0xFFF;
+    vq->used = (void*)(uintptr_t)addr;
+    vq->avail_idx = 0;
+    vq->last_used = 0;
+}
+
+// make descriptor id available to the firmware
+static void vq_post(struct peer_vq* vq, uint16_t id)
+{
+    vq->avail->ring[vq->avail_idx % VRING_SIZE] = id;
+    __sync_synchronize();
+    vq->avail_idx++;
+    vq->avail->avail_idx = vq->avail_idx;
+}
+
+// get the next descriptor the firmware has marked used, returns -1 if there is none
+static int32_t vq_get_used(struct peer_vq* vq, uint32_t* len)
+{
+    if (vq->last_used == vq->used->idx)
+        return -1;
+    __sync_synchronize();
+    volatile struct vring_used_elem* e = &(vq->used->ring[vq->last_used % VRING_SIZE]);
+    vq->last_used++;
+    if (len != NULL)
+        *len = e->len;
+    return e->id;
+}
+
+
+// kick the firmware for notify id nid, mapped onto the two doorbells like the zynq remoteproc driver does
+static void peer_kick(uint32_t nid)
+{
+    sim_ring((nid == 0) ? sim_db.txvring : sim_db.rxvring);
+}
+
+
+// set up the vrings of all vdevs in shared memory and post all rx buffers, called before the firmware is started
+void peer_init(void)
+{
+    for (int v=0; v<RPMSG_N_VDEV; v++)
+    {
+        struct peer_vdev* vd = &vdevs[v];
+        uint32_t base = SIM_SHM_ADDR + SIM_VDEV_OFS(v);
+        uint32_t buf = base + SIM_BUF_OFS;
+
+        memset((void*)(uintptr_t)base, 0, SIM_BUF_OFS);
+        vq_init(&vd->rx_vq, base + SIM_VRING0_OFS);
+        vq_init(&vd->tx_vq, base + SIM_VRING1_OFS);
+
+        for (int i=0; i<VRING_SIZE; i++, buf += PACKET_LEN_MAX)
+        {
+            vd->rx_vq.desc[i].addr = buf;
+            vd->rx_vq.desc[i].len = PACKET_LEN_MAX;
+            vd->rx_vq.desc[i].flags = 2;    // VRING_DESC_F_WRITE
+            vq_post(&vd->rx_vq, i);
+        }
+        for (int i=0; i<VRING_SIZE; i++, buf += PACKET_LEN_MAX)
+        {
+            vd->tx_vq.desc[i].addr = buf;
+            vd->tx_vq.desc[i].len = PACKET_LEN_MAX;
+            vd->tx_free[i] = VRING_SIZE - 1 - i;
+        }
+        vd->tx_free_cnt = VRING_SIZE;
+    }
+}
+
+
+// send a message to the firmware on vdev (like rpmsg_trysend)
+// returns 0 on success, -1 if there is no free tx buffer
+int peer_send(int vdev, uint32_t dst, const void* data, uint32_t len)
+{
+    struct peer_vdev* vd = &vdevs[vdev];
+    int32_t id;
+
+    // reclaim buffers the firmware has consumed
+    while ((id = vq_get_used(&vd->tx_vq, NULL)) >= 0)
+        vd->tx_free[vd->tx_free_cnt++] = id;
+
+    if (vd->tx_free_cnt == 0)
+        return -1;
+    if (len > DATA_LEN_MAX)
+        len = DATA_LEN_MAX;
+
+    id = vd->tx_free[--vd->tx_free_cnt];
+    struct rpmsg_hdr* hdr = (struct rpmsg_hdr*)(uintptr_t)vd->tx_vq.desc[id].addr;
+    hdr->src = SIM_LINUX_ADDR;
+    hdr->dst = dst;
+    hdr->reserved = 0;
+    hdr->len = len;
+    hdr->flags = 0;
+    memcpy(hdr->data, data, len);
+    vd->tx_vq.desc[id].len = sizeof(*hdr) + len;
+    vq_post(&vd->tx_vq, id);
+
+    peer_kick(2*vdev + 1);
+    return 0;
+}
+
+
+// process the messages the firmware has sent on vdev, at most budget of them (0: no limit), cb is called for each
+// returns the number of messages
+int peer_poll(int vdev, uint32_t budget, peer_rx_callback* cb, void* priv)
+{
+    struct peer_vdev* vd = &vdevs[vdev];
+    int32_t id;
+    uint32_t n = 0;
+
+    while (((budget == 0) || (n < budget)) && ((id = vq_get_used(&vd->rx_vq, NULL)) >= 0))
+    {
+        struct rpmsg_hdr* hdr = (struct rpmsg_hdr*)(uintptr_t)vd->rx_vq.desc[id].addr;
+        if (cb != NULL)
+            cb(hdr->src, hdr->dst, hdr->data, hdr->len, priv);
+        vq_post(&vd->rx_vq, id);
+        n++;
+    }
+
+    // the firmware might be waiting for buffers
+    if (n > 0)
+        peer_kick(2*vdev);
+    return n;
+}
+
+
+// wait until the firmware kicks us or timeout_ms has passed
+void peer_wait(int timeout_ms)
+{
+    struct pollfd fd = { sim_db.to_linux, POLLIN, 0 };
+    uint64_t cnt;
+
+    if ((poll(&fd, 1, timeout_ms) > 0) && (fd.revents & POLLIN))
+    {
+        if (read(sim_db.to_linux, &cnt, sizeof(cnt)) != sizeof(cnt))
+            return;
+    }
+}
+
+
+// ring a doorbell
+void sim_ring(int fd)
+{
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) != sizeof(one))
+        perror("sim_ring");
+}
@@ -0,0 +1,108 @@
+/******************************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*   Host simulator of the bare metal rpmsg transport
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   sim.h
+*
+*   Definitions shared by the simulated firmware (sim_fw.c, runs bm_fw/src/remoteproc.c) and the simulated kernel side
+*   (peer.c). Both run in their own process, the carveout is a POSIX shared memory segment which is mapped at the same
+*   (32 bit) address in both of them. Interrupts are eventfd doorbells.
+*
+******************************************************************************************************************************/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+
+/******************************************************************************************************************************
+*   C O N F I G
+*/
+
+// address and size of the shared memory, the firmware keeps addresses in 32 bit integers so this must be below 4GB
+#define SIM_SHM_ADDR        0x30000000
+#define SIM_SHM_SIZE        (4*1024*1024)
+
+// layout of the shared memory: one block of SIM_VDEV_SIZE bytes per vdev, each has the two vrings followed by the
+// message buffers (kernel rx buffers first)
+#define SIM_VDEV_SIZE       0x200000
+#define SIM_VDEV_OFS(v)     ((v) * SIM_VDEV_SIZE)
+#define SIM_VRING0_OFS      0x00000     // firmware -> kernel
+#define SIM_VRING1_OFS      0x40000     // kernel -> firmware
+#define SIM_BUF_OFS         0x80000
+
+// rpmsg address of the simulated kernel endpoint
+#define SIM_LINUX_ADDR      0x400
+
+// name of the echo channel announced by the simulated firmware (control vdev)
+#define SIM_ECHO_CH         "sim_echo"
+// channels which answer each message (uint32_t count) with count messages of DATA_LEN_MAX bytes, sim_bulk uses the
+// bulk vdev, sim_shared the control vdev (ie the same vrings as sim_echo)
+#define SIM_BULK_CH         "sim_bulk"
+#define SIM_SHARED_CH       "sim_shared"
+
+
+
+/******************************************************************************************************************************
+*   S T R U C T S
+*/
+
+// eventfd doorbells, created before fork so both processes share them
+// Like the zynq remoteproc driver the peer rings txvring for notify id 0 and rxvring for all other notify ids
+// (vring0 of vdev v has notify id 2*v, vring1 has 2*v+1), see peer_kick().
+struct sim_doorbells {
+    int to_linux;   // NOTIFY_LINUX_IRQ
+    int txvring;    // TXVRING_IRQ (notify id 0: kernel has returned buffers to vring0 of vdev 0)
+    int rxvring;    // RXVRING_IRQ (all other notify ids)
+};
+
+extern struct sim_doorbells sim_db;
+
+// called by the peer for each received message
+typedef void (peer_rx_callback)(uint32_t src, uint32_t dst, uint8_t* data, uint32_t len, void* priv);
+
+
+
+/******************************************************************************************************************************
+*   P R O T O T Y P E S
+*/
+
+// sim_fw.c: firmware process, does not return
+void sim_fw_main(void);
+
+// peer.c: kernel side (split vrings only), vdev selects the vring pair (0..RPMSG_N_VDEV-1)
+void peer_init(void);
+
+int peer_send(int vdev, uint32_t dst, const void* data, uint32_t len);
+
+int peer_poll(int vdev, uint32_t budget, peer_rx_callback* cb, void* priv);
+
+void peer_wait(int timeout_ms);
+
+void sim_ring(int fd);
+
+#endif // SIM_H
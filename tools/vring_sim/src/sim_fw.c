@@ -0,0 +1,174 @@
+/******************************************************************************************************************************
+*
+*   CFG_MGMT  -  Configuration Variable Management for AMP using RPMSG
+*   Host simulator of the bare metal rpmsg transport
+*
+*   Copyright (c) 2015 Lukas Schrittwieser
+*
+*   Permission is hereby granted, free of charge, to any person obtaining a copy
+*   of this software and associated documentation files (the "Software"), to deal
+*   in the Software without restriction, including without limitation the rights
+*   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*   copies of the Software, and to permit persons to whom the Software is
+*   furnished to do so, subject to the following conditions:
+*
+*   The above copyright notice and this permission notice shall be included in
+*   all copies or substantial portions of the Software.
+*
+*   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+*   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+*   THE SOFTWARE.
+*
+*******************************************************************************************************************************
+*
+*   sim_fw.c
+*
+*   Firmware process of the simulator: implements the BSP functions used by remoteproc.c (interrupt controller,
+*   timer) on top of the doorbells and runs an echo service and two bulk sources (one on the bulk vdev, one sharing
+*   the control vdev with the echo service) on the unmodified rpmsg stack.
+*
+******************************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <xscugic.h>
+#include <xtime_l.h>
+
+#include "remoteproc.h"
+#include "sim.h"
+
+
+/******************************************************************************************************************************
+*   G L O B A L S
+*/
+
+// interrupt controller instance, remoteproc.c expects this to be defined by the main file
+XScuGic IntcInst;
+
+// handlers connected by XScuGic_Connect, indexed by interrupt id
+#define SIM_IRQS        16
+static struct {
+    Xil_InterruptHandler handler;
+    void* data;
+} irqs[SIM_IRQS];
+
+
+
+/******************************************************************************************************************************
+*   I M P L E M E N T A T I O N
+*/
+
+int XScuGic_Connect(XScuGic *InstancePtr, unsigned int Int_Id, Xil_InterruptHandler Handler, void *CallBackRef)
+{
+    if (Int_Id >= SIM_IRQS)
+        return -1;
+    irqs[Int_Id].handler = Handler;
+    irqs[Int_Id].data = CallBackRef;
+    return 0;
+}
+
+void XScuGic_Enable(XScuGic *InstancePtr, unsigned int Int_Id)
+{
+}
+
+// the firmware only sends interrupts to linux
+int XScuGic_SoftwareIntr(XScuGic *InstancePtr, unsigned int Int_Id, unsigned int Cpu_Id)
+{
+    sim_ring(sim_db.to_linux);
+    return 0;
+}
+
+void XTime_GetTime(XTime *Xtime)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    *Xtime = (XTime)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void run_irq(int fd, unsigned int irq)
+{
+    uint64_t cnt;
+    if (read(fd, &cnt, sizeof(cnt)) != sizeof(cnt))
+        return;
+    if (irqs[irq].handler != NULL)
+        irqs[irq].handler(irqs[irq].data);
+}
+
+// replaces wfe: sleep until the kernel side rings one of our doorbells and run the connected interrupt handlers
+void sim_wait_irq(void)
+{
+    struct pollfd fds[2] = {
+        { sim_db.txvring, POLLIN, 0 },
+        { sim_db.rxvring, POLLIN, 0 },
+    };
+
+    if (poll(fds, 2, -1) <= 0)
+        return;
+    if (fds[0].revents & POLLIN)
+        run_irq(sim_db.txvring, TXVRING_IRQ);
+    if (fds[1].revents & POLLIN)
+        run_irq(sim_db.rxvring, RXVRING_IRQ);
+}
+
+
+// echo every message back to the sender
+static void echo_cb(struct rpmsg_channel* ch, uint8_t* data, uint32_t len)
+{
+    if (rpmsg_send_async(ch, data, len, NULL, NULL) == RPMSG_ERR_QFULL)
+        rpmsg_send(ch, data, len);  // queue is full, wait until linux returns buffers
+}
+
+
+// answer a message with a burst of messages (count is the first word), blocks until all of them are in the vring
+static void bulk_cb(struct rpmsg_channel* ch, uint8_t* data, uint32_t len)
+{
+    uint8_t msg[DATA_LEN_MAX];
+    uint32_t cnt;
+
+    if (len < sizeof(cnt))
+        return;
+    memcpy(&cnt, data, sizeof(cnt));
+    memset(msg, 0x5A, sizeof(msg));
+    for (uint32_t i=0; i<cnt; i++)
+    {
+        memcpy(msg, &i, sizeof(i));
+        rpmsg_send(ch, msg, sizeof(msg));
+    }
+}
+
+
+// firmware process main loop
+void sim_fw_main(void)
+{
+    // the resource table and the rx buffers are set up before the fork, so there is no need to wait. Without
+    // DRIVER_OK (-d) only the fallback can succeed
+    int ret = remoteproc_ready(0);
+    if (ret == 0)
+        ret = remoteproc_ready(1);
+    fprintf(stderr, "sim_fw: vdevs ready (%s)\n", (ret == RPROC_READY_RX_BUF) ? "rx buffer" : "DRIVER_OK");
+    if ((ret <= 0) || (remoteproc_init() != RPMSG_OK))
+    {
+        fprintf(stderr, "sim_fw: remoteproc_init failed\n");
+        exit(1);
+    }
+
+    rpmsg_create_ch(SIM_ECHO_CH, &echo_cb);
+    rpmsg_create_ch_ex(SIM_BULK_CH, &bulk_cb, RPMSG_CH_F_BULK);
+    rpmsg_create_ch(SIM_SHARED_CH, &bulk_cb);
+
+    while (1)
+    {
+        if (!rpmsg_poll())
+            sim_wait_irq();
+    }
+}
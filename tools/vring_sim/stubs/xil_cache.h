@@ -0,0 +1,9 @@
+// host simulator stub of the Xilinx BSP header, caches are coherent on the host
+#ifndef XIL_CACHE_H
+#define XIL_CACHE_H
+
+#define Xil_DCacheFlush()                   __sync_synchronize()
+#define Xil_DCacheFlushRange(adr, len)      __sync_synchronize()
+#define Xil_DCacheInvalidateRange(adr, len) __sync_synchronize()
+
+#endif
@@ -0,0 +1,9 @@
+// host simulator stub of the Xilinx BSP header, caches are coherent on the host
+#ifndef XIL_CACHE_L_H
+#define XIL_CACHE_L_H
+
+#define Xil_L1DCacheFlush()                 __sync_synchronize()
+#define Xil_L1DCacheFlushRange(adr, len)    __sync_synchronize()
+#define Xil_L1DCacheInvalidateRange(adr, len)   __sync_synchronize()
+
+#endif
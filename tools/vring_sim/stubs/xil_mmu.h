@@ -0,0 +1,7 @@
+// host simulator stub of the Xilinx BSP header
+#ifndef XIL_MMU_H
+#define XIL_MMU_H
+
+#define Xil_SetTlbAttributes(addr, attrib)  do {} while (0)
+
+#endif
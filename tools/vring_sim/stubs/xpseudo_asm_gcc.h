@@ -0,0 +1,11 @@
+// host simulator stub of the Xilinx BSP header
+#ifndef XPSEUDO_ASM_GCC_H
+#define XPSEUDO_ASM_GCC_H
+
+#define dsb()       __sync_synchronize()
+
+// sleep until the peer rings a doorbell and run the connected interrupt handlers (see sim_fw.c)
+void sim_wait_irq(void);
+#define wfe()       sim_wait_irq()
+
+#endif
@@ -0,0 +1,15 @@
+// host simulator stub of the Xilinx BSP header, interrupts are doorbells between the two processes (see sim_fw.c)
+#ifndef XSCUGIC_H
+#define XSCUGIC_H
+
+typedef void (*Xil_InterruptHandler)(void *data);
+
+typedef struct {
+    int dummy;
+} XScuGic;
+
+int XScuGic_Connect(XScuGic *InstancePtr, unsigned int Int_Id, Xil_InterruptHandler Handler, void *CallBackRef);
+void XScuGic_Enable(XScuGic *InstancePtr, unsigned int Int_Id);
+int XScuGic_SoftwareIntr(XScuGic *InstancePtr, unsigned int Int_Id, unsigned int Cpu_Id);
+
+#endif
@@ -0,0 +1,11 @@
+// host simulator stub of the Xilinx BSP header, the global timer counts nanoseconds
+#ifndef XTIME_L_H
+#define XTIME_L_H
+
+typedef unsigned long long XTime;
+
+#define COUNTS_PER_SECOND   1000000000ULL
+
+void XTime_GetTime(XTime *Xtime);
+
+#endif